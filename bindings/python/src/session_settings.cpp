@@ -23,7 +23,9 @@ void bind_session_settings()
         .def_readwrite("peer_timeout", &session_settings::peer_timeout)
         .def_readwrite("urlseed_timeout", &session_settings::urlseed_timeout)
         .def_readwrite("urlseed_pipeline_size", &session_settings::urlseed_pipeline_size)
+        .def_readwrite("urlseed_max_connections", &session_settings::urlseed_max_connections)
         .def_readwrite("file_pool_size", &session_settings::file_pool_size)
+        .def_readwrite("disable_os_cache", &session_settings::disable_os_cache)
         .def_readwrite("allow_multiple_connections_per_ip", &session_settings::allow_multiple_connections_per_ip)
         .def_readwrite("max_failcount", &session_settings::max_failcount)
         .def_readwrite("min_reconnect_time", &session_settings::min_reconnect_time)
@@ -37,6 +39,7 @@ void bind_session_settings()
         .def_readwrite("active_downloads", &session_settings::active_downloads)
         .def_readwrite("active_seeds", &session_settings::active_seeds)
         .def_readwrite("active_limit", &session_settings::active_limit)
+        .def_readwrite("active_checking", &session_settings::active_checking)
         .def_readwrite("dont_count_slow_torrents", &session_settings::dont_count_slow_torrents)
         .def_readwrite("auto_manage_interval", &session_settings::auto_manage_interval)
         .def_readwrite("share_ratio_limit", &session_settings::share_ratio_limit)
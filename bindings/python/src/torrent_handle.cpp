@@ -297,6 +297,7 @@ void bind_torrent_handle()
         .def("use_interface", &torrent_handle::use_interface)
         .def("write_resume_data", _(&torrent_handle::write_resume_data))
         .def("save_resume_data", _(&torrent_handle::save_resume_data))
+        .def("need_save_resume_data", _(&torrent_handle::need_save_resume_data))
         .def("force_reannounce", _(force_reannounce0))
         .def("force_reannounce", force_reannounce)
         .def("scrape_tracker", _(&torrent_handle::scrape_tracker))
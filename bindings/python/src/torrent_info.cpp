@@ -55,10 +55,8 @@ namespace
   list files(torrent_info const& ti, bool storage) {
       list result;
 
-      typedef std::vector<file_entry> list_type;
-
-      for (list_type::const_iterator i = ti.begin_files(); i != ti.end_files(); ++i)
-          result.append(*i);
+      for (int i = 0; i < ti.num_files(); ++i)
+          result.append(ti.file_at(i));
 
       return result;
   }
@@ -91,7 +89,7 @@ void bind_torrent_info()
         .def("piece_size", &torrent_info::piece_size)
 
         .def("num_files", &torrent_info::num_files, (arg("storage")=false))
-        .def("file_at", &torrent_info::file_at, return_internal_reference<>())
+        .def("file_at", &torrent_info::file_at)
         .def("files", &files, (arg("storage")=false))
 
         .def("priv", &torrent_info::priv)
@@ -25,6 +25,7 @@ void bind_torrent_status()
         .def_readonly("state", &torrent_status::state)
         .def_readonly("paused", &torrent_status::paused)
         .def_readonly("progress", &torrent_status::progress)
+        .def_readonly("allocation_progress", &torrent_status::allocation_progress)
         .add_property(
             "next_announce"
           , make_getter(
@@ -1087,9 +1087,15 @@ int main(int ac, char* av[])
 						torrent_handle& h = i->second;
 						if (!h.is_valid() || !h.has_metadata()) continue;
 
+						// check this before pausing, since pausing
+						// sets the flag
+						bool need_save = h.need_save_resume_data();
+
 						// pause
 						std::cout << "pausing " << h.name() << std::endl;
 						h.pause();
+						// the resume data on disk is still current
+						if (!need_save) continue;
 						// save_resume_data will generate an alert when it's done
 						h.save_resume_data();
 						++num_resume_data;
@@ -1458,18 +1464,18 @@ int main(int ac, char* av[])
 				{
 					std::vector<size_type> file_progress;
 					h.file_progress(file_progress);
-					torrent_info const& info = h.get_torrent_info();
-					for (int i = 0; i < info.num_files(); ++i)
+					file_storage const& files = h.get_torrent_info().files();
+					for (int i = 0; i < files.num_files(); ++i)
 					{
-						float progress = info.file_at(i).size > 0
-							?float(file_progress[i]) / info.file_at(i).size:1;
-						if (file_progress[i] == info.file_at(i).size)
+						float progress = files.file_size(i) > 0
+							?float(file_progress[i]) / files.file_size(i):1;
+						if (file_progress[i] == files.file_size(i))
 							out << progress_bar(1.f, 100, "32");
 						else
 							out << progress_bar(progress, 100, "33");
 						out << " " << to_string(progress * 100.f, 5) << "% "
 							<< add_suffix(file_progress[i]) << " "
-							<< info.file_at(i).path.leaf() << "\n";
+							<< files.file_name(i) << "\n";
 					}
 
 					out << "___________________________________\n";
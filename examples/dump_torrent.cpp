@@ -113,7 +113,7 @@ int main(int argc, char* argv[])
 			int first = t.map_file(index, 0, 1).piece;
 			int last = t.map_file(index, i->size - 1, 1).piece;
 			std::cout << "  " << std::setw(11) << i->size
-				<< " " << i->path.string() << "[ " << first << ", "
+				<< " " << t.files().file_path(*i).string() << "[ " << first << ", "
 				<< last << " ]\n";
 		}
 
@@ -34,7 +34,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_ALERT_HPP_INCLUDED
 
 #include <memory>
-#include <queue>
+#include <deque>
+#include <vector>
 #include <string>
 #include <typeinfo>
 
@@ -113,10 +114,29 @@ namespace libtorrent {
 		alert_manager();
 		~alert_manager();
 
+		enum { default_queue_size_limit = 1000 };
+
 		void post_alert(const alert& alert_);
+
+		// takes ownership of an alert allocated with new. This
+		// saves the copy made by clone() in post_alert(), the
+		// alert is queued exactly where it was constructed
+		void post_alert_ptr(alert* alert_);
+
+		// like post_alert_ptr(), but ignores the queue size limit.
+		// This is used for alerts that answer an explicit request
+		// from the client, which would otherwise wait forever
+		void post_reply_ptr(alert* alert_);
+
 		bool pending() const;
 		std::auto_ptr<alert> get();
 
+		// moves all queued alerts into the alerts vector. The
+		// caller takes ownership of the alerts and is responsible
+		// for deleting them. The lock is only held while the
+		// internal queue is swapped out
+		void get_all(std::vector<alert*>& alerts);
+
 		template <class T>
 		bool should_post() const { return (m_alert_mask & T::static_category) != 0; }
 
@@ -124,11 +144,15 @@ namespace libtorrent {
 
 		void set_alert_mask(int m) { m_alert_mask = m; }
 
+		// returns the previous limit
+		int set_alert_queue_size_limit(int queue_size_limit_);
+
 	private:
-		std::queue<alert*> m_alerts;
+		std::deque<alert*> m_alerts;
 		mutable boost::mutex m_mutex;
 		boost::condition m_condition;
 		int m_alert_mask;
+		int m_queue_size_limit;
 	};
 
 	struct TORRENT_EXPORT unhandled_alert : std::exception
@@ -1103,6 +1103,70 @@ namespace libtorrent
 		}
 	};
 
+	struct TORRENT_EXPORT peer_info_alert: torrent_alert
+	{
+		peer_info_alert(torrent_handle const& h
+			, std::vector<peer_info> const& peers_)
+			: torrent_alert(h)
+			, peers(peers_)
+		{}
+
+		std::vector<peer_info> peers;
+
+		virtual std::auto_ptr<alert> clone() const
+		{ return std::auto_ptr<alert>(new peer_info_alert(*this)); }
+		virtual char const* what() const { return "peer info"; }
+		const static int static_category = alert::status_notification;
+		virtual int category() const { return static_category; }
+		virtual std::string message() const
+		{
+			return torrent_alert::message() + " "
+				+ boost::lexical_cast<std::string>(peers.size()) + " peers";
+		}
+	};
+
+	struct TORRENT_EXPORT torrent_status_alert: torrent_alert
+	{
+		torrent_status_alert(torrent_handle const& h
+			, torrent_status const& status_)
+			: torrent_alert(h)
+			, status(status_)
+		{}
+
+		torrent_status status;
+
+		virtual std::auto_ptr<alert> clone() const
+		{ return std::auto_ptr<alert>(new torrent_status_alert(*this)); }
+		virtual char const* what() const { return "torrent status"; }
+		const static int static_category = alert::status_notification;
+		virtual int category() const { return static_category; }
+		virtual std::string message() const
+		{
+			return torrent_alert::message() + " status";
+		}
+	};
+
+	struct TORRENT_EXPORT file_progress_alert: torrent_alert
+	{
+		file_progress_alert(torrent_handle const& h
+			, std::vector<size_type> const& progress_)
+			: torrent_alert(h)
+			, progress(progress_)
+		{}
+
+		std::vector<size_type> progress;
+
+		virtual std::auto_ptr<alert> clone() const
+		{ return std::auto_ptr<alert>(new file_progress_alert(*this)); }
+		virtual char const* what() const { return "file progress"; }
+		const static int static_category = alert::status_notification;
+		virtual int category() const { return static_category; }
+		virtual std::string message() const
+		{
+			return torrent_alert::message() + " file progress";
+		}
+	};
+
 	struct TORRENT_EXPORT peer_blocked_alert: alert
 	{
 		peer_blocked_alert(address const& ip_)
@@ -53,6 +53,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <boost/filesystem/path.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/function.hpp>
+#include <boost/weak_ptr.hpp>
 
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -86,6 +88,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/lsd.hpp"
 #include "libtorrent/socket_type.hpp"
 #include "libtorrent/connection_queue.hpp"
+#include "libtorrent/resolver.hpp"
 #include "libtorrent/disk_io_thread.hpp"
 #include "libtorrent/assert.hpp"
 
@@ -115,7 +118,8 @@ namespace libtorrent
 #endif
 			friend struct checker_impl;
 			friend class invariant_access;
-			typedef std::set<boost::intrusive_ptr<peer_connection> > connection_map;
+			// the list holds a reference to every connection in it
+			typedef intrusive_list<peer_connection, session_peer_tag, true> connection_map;
 			typedef std::map<sha1_hash, boost::shared_ptr<torrent> > torrent_map;
 
 			session_impl(
@@ -135,9 +139,7 @@ namespace libtorrent
 #ifndef NDEBUG
 			bool has_peer(peer_connection const* p) const
 			{
-				return std::find_if(m_connections.begin(), m_connections.end()
-					, boost::bind(&boost::intrusive_ptr<peer_connection>::get, _1) == p)
-					!= m_connections.end();
+				return m_connections.contains(p);
 			}
 #endif
 			void operator()();
@@ -207,12 +209,21 @@ namespace libtorrent
 			void remove_torrent(torrent_handle const& h, int options);
 
 			std::vector<torrent_handle> get_torrents();
+
+			void get_torrent_status(std::vector<torrent_status>* ret
+				, boost::function<bool(torrent_status const&)> const& pred) const;
+			void get_updated_torrent_status(std::vector<torrent_status>* ret);
 			
 			void check_torrent(boost::shared_ptr<torrent> const& t);
 			void done_checking(boost::shared_ptr<torrent> const& t);
+			// starts checking queued torrents, as long as there
+			// are fewer than active_checking being checked
+			void start_checking_torrents();
 
 			void set_alert_mask(int m);
 			std::auto_ptr<alert> pop_alert();
+			void pop_alerts(std::vector<alert*>* alerts);
+			int set_alert_queue_size_limit(int queue_size_limit_);
 
 			alert const* wait_for_alert(time_duration max_wait);
 
@@ -286,6 +297,11 @@ namespace libtorrent
 			bool load_country_db(char const* file);
 			bool has_country_db() const { return m_country_db; }
 			char const* country_for_ip(address const& a);
+
+			// the number of entries in each of the
+			// AS and country lookup caches. geoip_cache_slot()
+			// indexes them with the top 10 bits of a 32 bit hash
+			enum { geoip_cache_size = 1024 };
 #endif
 
 			void load_state(entry const& ses_state);
@@ -383,6 +399,11 @@ namespace libtorrent
 			// members to be destructed
 			connection_queue m_half_open;
 
+			// caches host name lookups for trackers, web seeds
+			// and DHT routers. It's shared by the tracker_manager
+			// and the torrents, so it's constructed before them
+			resolver m_host_resolver;
+
 			// the bandwidth manager is responsible for
 			// handing out bandwidth to connections that
 			// asks for it, it can also throttle the
@@ -394,12 +415,32 @@ namespace libtorrent
 
 			tracker_manager m_tracker_manager;
 			torrent_map m_torrents;
-			typedef std::list<boost::shared_ptr<torrent> > check_queue_t;
+
+			// torrents whose status may have changed since the
+			// last call to get_updated_torrent_status(). Torrents
+			// add themselves with torrent::state_updated()
+			std::vector<boost::weak_ptr<torrent> > m_state_updates;
+
+			// a torrent waiting to be checked, or being checked.
+			// The storage device its save path is on is looked
+			// up when it's queued, and again only if the save
+			// path changes while it's in the queue
+			struct check_queue_entry
+			{
+				boost::shared_ptr<torrent> t;
+				fs::path save_path;
+				std::string device;
+			};
+
+			// returns the storage device of the queued torrent
+			std::string const& check_device(check_queue_entry& e);
+
+			typedef std::list<check_queue_entry> check_queue_t;
 			check_queue_t m_queued_for_checking;
 
-			// this maps sockets to their peer_connection
-			// object. It is the complete list of all connected
-			// peers.
+			// the complete list of all connected peers. It is
+			// linked through the peer_connection objects, so
+			// connecting and disconnecting peers never allocates
 			connection_map m_connections;
 			
 			// filters incoming connections
@@ -517,6 +558,14 @@ namespace libtorrent
 			// statistics gathered from all torrents.
 			stat m_stat;
 
+			// the number of protocol messages sent and
+			// received, and the number of socket writes
+			// and reads issued by all peer connections
+			stat_channel m_sent_messages;
+			stat_channel m_received_messages;
+			stat_channel m_send_calls;
+			stat_channel m_receive_calls;
+
 			// is false by default and set to true when
 			// the first incoming connection is established
 			// this is used to know if the client is behind
@@ -613,6 +662,28 @@ namespace libtorrent
 			GeoIP* m_asnum_db;
 			GeoIP* m_country_db;
 
+			// small direct mapped caches of recent AS and
+			// country lookups, indexed by a hash of the IPv4
+			// address. An ip of 0 marks an empty slot. They
+			// spare repeated walks of the database for peers
+			// that connect over and over
+			struct as_cache_entry
+			{
+				unsigned long ip;
+				int as;
+			};
+			struct country_cache_entry
+			{
+				unsigned long ip;
+				char const* country;
+			};
+			as_cache_entry m_as_cache[geoip_cache_size];
+			country_cache_entry m_country_cache[geoip_cache_size];
+
+			// maps AS number to the AS name, for every AS
+			// that has been looked up
+			std::map<int, std::string> m_as_names;
+
 			// maps AS number to the peak download rate
 			// we've seen from it. Entries are never removed
 			// from this map. Pointers to its elements
@@ -640,6 +711,7 @@ namespace libtorrent
 
 			void tracker_response(tracker_request const&
 				, std::vector<peer_entry>& peers
+				, std::vector<tcp::endpoint> const& endpoints
 				, int interval
 				, int complete
 				, int incomplete
@@ -657,6 +729,12 @@ namespace libtorrent
 					if (!i->pid.is_all_zeros()) s << " " << i->pid;
 					s << "\n";
 				}
+				for (std::vector<tcp::endpoint>::const_iterator i = endpoints.begin();
+					i != endpoints.end(); ++i)
+				{
+					s << "  " << std::setfill(' ') << std::setw(16) << i->address()
+						<< " " << std::setw(5) << std::dec << i->port() << "\n";
+				}
 				s << "external ip: " << external_ip << "\n";
 				debug_log(s.str());
 			}
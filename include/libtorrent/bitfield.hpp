@@ -36,6 +36,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/assert.hpp"
 #include "libtorrent/config.hpp"
 
+#include <boost/cstdint.hpp>
+#include <cstring> // for memcpy
+
 namespace libtorrent
 {
 	struct TORRENT_EXPORT bitfield
@@ -97,33 +100,80 @@ namespace libtorrent
 			return *this;
 		}
 
+		// the number of set bits. Full words are counted 32 bits at a
+		// time, only the last partial word is counted byte by byte
 		int count() const
 		{
-			// 0000, 0001, 0010, 0011, 0100, 0101, 0110, 0111,
-			// 1000, 1001, 1010, 1011, 1100, 1101, 1110, 1111
-			const static char num_bits[] =
-			{
-				0, 1, 1, 2, 1, 2, 2, 3,
-				1, 2, 2, 3, 2, 3, 3, 4
-			};
+			int ret = 0;
+			const int num_words = m_size / 32;
+			for (int i = 0; i < num_words; ++i)
+				ret += popcount(load_word(m_bytes, i));
+
+			for (int i = num_words * 4; i < (m_size + 7) / 8; ++i)
+				ret += popcount(m_bytes[i] & tail_mask(i));
+
+			TORRENT_ASSERT(ret <= m_size);
+			TORRENT_ASSERT(ret >= 0);
+			return ret;
+		}
+
+		// returns the number of bits that are set in both this
+		// bitfield and rhs. The bitfields must have the same size
+		int count_common(bitfield const& rhs) const
+		{
+			TORRENT_ASSERT(rhs.m_size == m_size);
 
 			int ret = 0;
-			const int num_bytes = m_size / 8;
-			for (int i = 0; i < num_bytes; ++i)
-			{
-				ret += num_bits[m_bytes[i] & 0xf] + num_bits[m_bytes[i] >> 4];
-			}
+			const int num_words = m_size / 32;
+			for (int i = 0; i < num_words; ++i)
+				ret += popcount(load_word(m_bytes, i) & load_word(rhs.m_bytes, i));
+
+			for (int i = num_words * 4; i < (m_size + 7) / 8; ++i)
+				ret += popcount(m_bytes[i] & rhs.m_bytes[i] & tail_mask(i));
 
-			int rest = m_size - num_bytes * 8;
-			for (int i = 0; i < rest; ++i)
-			{
-				ret += (m_bytes[num_bytes] >> (7-i)) & 1;
-			}
 			TORRENT_ASSERT(ret <= m_size);
 			TORRENT_ASSERT(ret >= 0);
 			return ret;
 		}
 
+		// clears all bits in this bitfield that are set in rhs
+		// (this = this & ~rhs). The bitfields must have the same size
+		void clear_bits(bitfield const& rhs)
+		{
+			TORRENT_ASSERT(rhs.m_size == m_size);
+			const int num_bytes = (m_size + 7) / 8;
+			for (int i = 0; i < num_bytes; ++i)
+				m_bytes[i] &= ~rhs.m_bytes[i];
+		}
+
+		// returns the index of the first set bit at or after
+		// 'start', or -1 if there is none. Words that are all
+		// zero are skipped without looking at the individual bits
+		int find_next_set(int start) const
+		{
+			TORRENT_ASSERT(start >= 0);
+			if (start >= m_size) return -1;
+
+			const int num_bytes = (m_size + 7) / 8;
+			int i = start / 8;
+			unsigned char b = m_bytes[i] & (0xff >> (start & 7));
+			for (;;)
+			{
+				if (b)
+				{
+					// the padding bits in the last byte may be set
+					int ret = i * 8 + first_bit(b);
+					return ret < m_size ? ret : -1;
+				}
+				++i;
+				while ((i & 3) == 0 && i + 4 <= num_bytes
+					&& load_word(m_bytes, i / 4) == 0)
+					i += 4;
+				if (i >= num_bytes) return -1;
+				b = m_bytes[i];
+			}
+		}
+
 		struct const_iterator
 		{
 		friend struct bitfield;
@@ -203,7 +253,8 @@ namespace libtorrent
 	
 		void resize(int bits)
 		{
-			const int bytes = (bits + 7) / 8;
+			// the storage is allocated in whole 32 bit words
+			const int bytes = (bits + 31) / 32 * 4;
 			if (m_bytes)
 			{
 				if (m_own)
@@ -229,6 +280,44 @@ namespace libtorrent
 
 	private:
 
+		static int popcount(boost::uint32_t v)
+		{
+#ifdef __GNUC__
+			return __builtin_popcount(v);
+#else
+			v = v - ((v >> 1) & 0x55555555);
+			v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+			return (((v + (v >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+#endif
+		}
+
+		// loads the i:th 32 bit word. The byte order is the
+		// host's, so this can only be used where the order of
+		// the bits doesn't matter
+		static boost::uint32_t load_word(unsigned char const* bytes, int i)
+		{
+			boost::uint32_t ret;
+			memcpy(&ret, bytes + i * 4, 4);
+			return ret;
+		}
+
+		// the mask of the valid bits in byte i
+		unsigned char tail_mask(int i) const
+		{
+			if ((i + 1) * 8 <= m_size) return 0xff;
+			return (unsigned char)(0xff << ((i + 1) * 8 - m_size));
+		}
+
+		// the index of the most significant set bit, where
+		// 0x80 is bit 0. b must not be 0
+		static int first_bit(unsigned char b)
+		{
+			TORRENT_ASSERT(b != 0);
+			int ret = 0;
+			while ((b & (0x80 >> ret)) == 0) ++ret;
+			return ret;
+		}
+
 		void dealloc() { if (m_own) free(m_bytes); m_bytes = 0; }
 		unsigned char* m_bytes;
 		int m_size; // in bits
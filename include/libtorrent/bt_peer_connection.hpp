@@ -110,6 +110,8 @@ namespace libtorrent
 #ifndef TORRENT_DISABLE_ENCRYPTION
 		bool supports_encryption() const
 		{ return m_encrypted; }
+		bool rc4_encrypted() const
+		{ return m_rc4_encrypted; }
 #endif
 
 		enum message_type
@@ -150,6 +152,10 @@ namespace libtorrent
 		virtual void get_specific_peer_info(peer_info& p) const;
 		virtual bool in_handshake() const;
 
+		// once the handshake is complete, messages are read in batches.
+		// Before that, the encryption may change between messages
+		virtual bool can_read_ahead() const { return !in_handshake(); }
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		bool support_extensions() const { return m_supports_extensions; }
 
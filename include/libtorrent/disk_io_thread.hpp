@@ -49,6 +49,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/config.hpp"
 #ifndef TORRENT_DISABLE_POOL_ALLOCATOR
 #include <boost/pool/pool.hpp>
+#include "libtorrent/allocator.hpp"
 #endif
 
 namespace libtorrent
@@ -88,6 +89,7 @@ namespace libtorrent
 			, rename_file
 			, abort_thread
 			, clear_read_cache
+			, allocate
 		};
 
 		action_t action;
@@ -244,6 +246,10 @@ namespace libtorrent
 			, mutex_t::scoped_lock& l);
 		int try_read_from_cache(disk_io_job const& j);
 
+		// moves one out of place piece of the first storage
+		// in the defrag queue into its own slot
+		void defrag_step();
+
 		// this mutex only protects m_jobs, m_queue_buffer_size
 		// and m_abort
 		mutable mutex_t m_queue_mutex;
@@ -284,12 +290,18 @@ namespace libtorrent
 		bool m_coalesce_reads;
 		bool m_use_read_cache;
 
+		// compact storages that have pieces that were written
+		// out of place. They are moved into place one piece at a
+		// time, only when the disk has been idle for a while.
+		// This is only used by the disk thread
+		std::list<boost::intrusive_ptr<piece_manager> > m_defrag_queue;
+
 		// this only protects the pool allocator
 		mutable mutex_t m_pool_mutex;
 #ifndef TORRENT_DISABLE_POOL_ALLOCATOR
 		// memory pool for read and write operations
 		// and disk cache
-		boost::pool<> m_pool;
+		boost::pool<page_aligned_allocator> m_pool;
 #endif
 
 		// number of bytes per block. The BitTorrent
@@ -180,6 +180,10 @@ namespace libtorrent
 		// called aproximately once every second
 		virtual void tick() {}
 
+		// called when the connection is closed, before it
+		// is detached from the torrent
+		virtual void on_disconnect() {}
+
 		// called each time a request message is to be sent. If true
 		// is returned, the original request message won't be sent and
 		// no other plugin will have this function called.
@@ -101,6 +101,9 @@ namespace libtorrent
 
 		static const open_mode in;
 		static const open_mode out;
+		// bypass the operating system's page cache for reads
+		// and writes, where it's supported
+		static const open_mode no_buffer;
 
 		file();
 		file(fs::path const& p, open_mode m, error_code& ec);
@@ -110,6 +113,12 @@ namespace libtorrent
 		bool is_open() const;
 		void close();
 		bool set_size(size_type size, error_code& ec);
+		// reserves disk space for the given range of the file,
+		// without changing its size or any data already in it.
+		// returns false if the space wasn't reserved. ec is only
+		// set on errors, if it's clear the filesystem can't reserve
+		// space without writing to the file
+		bool allocate(size_type offset, size_type len, error_code& ec);
 
 		size_type write(const char*, size_type num_bytes, error_code& ec);
 		size_type read(char*, size_type num_bytes, error_code& ec);
@@ -117,12 +126,24 @@ namespace libtorrent
 		size_type seek(size_type pos, seek_mode m, error_code& ec);
 		size_type tell(error_code& ec);
 
+		// true if the last read or write bypassed the page cache
+		// with O_DIRECT. Always false where that isn't used
+		bool direct_io() const;
+
 	private:
 
+		// turns O_DIRECT on or off for the next read or write,
+		// depending on whether it's aligned
+		void update_direct_io(char const* buf, size_type num_bytes);
+
 #ifdef TORRENT_WINDOWS
 		HANDLE m_file_handle;
 #else
 		int m_fd;
+		// set if the file was opened in no_buffer mode
+		bool m_no_buffer;
+		// true while O_DIRECT is set on the file descriptor
+		bool m_direct_io;
 #endif
 #ifndef NDEBUG
 		open_mode m_open_mode;
@@ -63,7 +63,7 @@ namespace libtorrent
 
 	struct TORRENT_EXPORT file_pool : boost::noncopyable
 	{
-		file_pool(int size = 40): m_size(size) {}
+		file_pool(int size = 40): m_size(size), m_no_buffer(false) {}
 
 		boost::shared_ptr<file> open_file(void* st, fs::path const& p
 			, file::open_mode m, error_code& ec);
@@ -71,8 +71,13 @@ namespace libtorrent
 		void release(fs::path const& p);
 		void resize(int size);
 
+		// if set, files are opened in no_buffer mode. This
+		// affects files opened after it's changed
+		void set_no_buffer(bool b) { m_no_buffer = b; }
+
 	private:
 		int m_size;
+		bool m_no_buffer;
 
 		struct lru_file_entry
 		{
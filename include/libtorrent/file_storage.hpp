@@ -41,6 +41,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include <boost/filesystem/path.hpp>
+#include <boost/cstdint.hpp>
 
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -67,6 +68,29 @@ namespace libtorrent
 		size_type file_base;
 	};
 
+	// this is the compact representation of a file used internally
+	// by file_storage. The file name is stored as an offset into a
+	// string pool shared by all files, and the directory it lives in
+	// as an index into a list of directories. The full path is only
+	// built on demand, by file_storage::file_path()
+	struct TORRENT_EXPORT internal_file_entry
+	{
+		internal_file_entry()
+			: offset(0), size(0), file_base(0)
+			, name_offset(0), path_index(-1) {}
+
+		size_type offset; // the offset of this file inside the torrent
+		size_type size; // the size of this file
+		// the offset in the file where the storage starts.
+		size_type file_base;
+		// the offset into file_storage::m_name_pool of the
+		// null terminated filename
+		boost::uint32_t name_offset;
+		// index into file_storage::m_paths of the directory
+		// this file is in. -1 means the file is in the root
+		int path_index;
+	};
+
 	struct TORRENT_EXPORT file_slice
 	{
 		int file_index;
@@ -91,8 +115,8 @@ namespace libtorrent
 			, int size) const;
 		peer_request map_file(int file, size_type offset, int size) const;
 		
-		typedef std::vector<file_entry>::const_iterator iterator;
-		typedef std::vector<file_entry>::const_reverse_iterator reverse_iterator;
+		typedef std::vector<internal_file_entry>::const_iterator iterator;
+		typedef std::vector<internal_file_entry>::const_reverse_iterator reverse_iterator;
 
 		iterator file_at_offset(size_type offset) const;
 		iterator begin() const { return m_files.begin(); }
@@ -102,11 +126,28 @@ namespace libtorrent
 		int num_files() const
 		{ return int(m_files.size()); }
 
-		file_entry const& at(int index) const
+		// returns a copy of the file entry, with the path
+		// reconstructed. Prefer file_size(), file_offset() and
+		// file_path() when only some of the fields are needed
+		file_entry at(int index) const;
+
+		internal_file_entry const& internal_at(int index) const
 		{
 			TORRENT_ASSERT(index >= 0 && index < int(m_files.size()));
 			return m_files[index];
 		}
+
+		size_type file_size(int index) const { return internal_at(index).size; }
+		size_type file_offset(int index) const { return internal_at(index).offset; }
+		char const* file_name(int index) const { return file_name(internal_at(index)); }
+		char const* file_name(internal_file_entry const& fe) const
+		{ return &m_name_pool[fe.name_offset]; }
+		fs::path file_path(int index) const { return file_path(internal_at(index)); }
+		fs::path file_path(internal_file_entry const& fe) const;
+
+		// an estimate of the number of bytes of heap memory
+		// used by this object
+		size_type memory_usage() const;
 		
 		size_type total_size() const { TORRENT_ASSERT(m_piece_length > 0); return m_total_size; }
 		void set_num_pieces(int n) { m_num_pieces = n; }
@@ -123,16 +164,41 @@ namespace libtorrent
 			using std::swap;
 			swap(ti.m_piece_length, m_piece_length);
 			swap(ti.m_files, m_files);
+			swap(ti.m_name_pool, m_name_pool);
+			swap(ti.m_name_pool_waste, m_name_pool_waste);
+			swap(ti.m_paths, m_paths);
 			swap(ti.m_total_size, m_total_size);
 			swap(ti.m_num_pieces, m_num_pieces);
 			swap(ti.m_name, m_name);
 		}
 
 	private:
+
+		// stores the filename in the name pool and the directory
+		// in the path list and updates e to refer to them
+		void set_file_path(internal_file_entry& e, fs::path const& p);
+
+		// rebuilds the name pool with only the names that are
+		// still referenced, dropping the ones left behind by
+		// rename_file()
+		void compact_name_pool();
+
 		int m_piece_length;
 
 		// the list of files that this torrent consists of
-		std::vector<file_entry> m_files;
+		std::vector<internal_file_entry> m_files;
+
+		// all filenames, each one null terminated. The
+		// name_offset of internal_file_entry points into this
+		std::string m_name_pool;
+
+		// the number of bytes in m_name_pool that no file refers
+		// to anymore, because the file was renamed
+		int m_name_pool_waste;
+
+		// the unique directories files are stored in. Files
+		// in the same directory share the same path string
+		std::vector<std::string> m_paths;
 
 		// the sum of all filesizes
 		size_type m_total_size;
@@ -38,6 +38,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <vector>
 #include <list>
 #include <string>
@@ -48,6 +49,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/assert.hpp"
 #include "libtorrent/socket_type.hpp"
 #include "libtorrent/session_settings.hpp"
+#include "libtorrent/resolver.hpp"
 
 #ifdef TORRENT_USE_OPENSSL
 #include "libtorrent/ssl_stream.hpp"
@@ -59,6 +61,56 @@ namespace libtorrent
 
 struct http_connection;
 class connection_queue;
+
+// keeps connections to HTTP servers open after a response
+// has been received, so that the next request to the same
+// host and port can be sent right away, without a name
+// lookup or connect. Only plain (not ssl) connections that
+// don't go through a proxy are kept
+struct http_connection_pool : boost::noncopyable
+{
+	http_connection_pool(int max_idle = 20
+		, time_duration idle_timeout = seconds(30))
+		: m_max_idle(max_idle)
+		, m_idle_timeout(idle_timeout)
+	{}
+
+	// returns an idle connection to the given host and
+	// port, or an empty pointer if there isn't one
+	boost::shared_ptr<socket_type> take(std::string const& hostname
+		, std::string const& port);
+
+	// hands an open connection that's done with its response
+	// to the pool. If there are too many idle connections,
+	// the one that's been idle the longest is closed
+	void put(std::string const& hostname, std::string const& port
+		, boost::shared_ptr<socket_type> s);
+
+	// closes all idle connections
+	void clear();
+
+	int num_idle() const;
+
+private:
+
+	struct idle_connection
+	{
+		std::string key;
+		boost::shared_ptr<socket_type> sock;
+		ptime idle_since;
+	};
+
+	// closes the connections that have been idle for too long
+	void expire(ptime now);
+
+	// sorted by idle_since, the one idle the longest first
+	std::list<idle_connection> m_idle;
+	int m_max_idle;
+	time_duration m_idle_timeout;
+
+	typedef boost::mutex mutex_t;
+	mutable mutex_t m_mutex;
+};
 	
 typedef boost::function<void(error_code const&
 	, http_parser const&, char const* data, int size, http_connection&)> http_handler;
@@ -73,10 +125,13 @@ struct http_connection : boost::enable_shared_from_this<http_connection>, boost:
 {
 	http_connection(io_service& ios, connection_queue& cc
 		, http_handler const& handler, bool bottled = true
-		, http_connect_handler const& ch = http_connect_handler())
+		, http_connect_handler const& ch = http_connect_handler()
+		, http_connection_pool* pool = 0
+		, resolver* r = 0)
 		: m_sock(ios)
 		, m_read_pos(0)
 		, m_resolver(ios)
+		, m_host_resolver(r)
 		, m_handler(handler)
 		, m_connect_handler(ch)
 		, m_timer(ios)
@@ -93,6 +148,8 @@ struct http_connection : boost::enable_shared_from_this<http_connection>, boost:
 		, m_ssl(false)
 		, m_priority(0)
 		, m_abort(false)
+		, m_pool(pool)
+		, m_reused(false)
 	{
 		TORRENT_ASSERT(!m_handler.empty());
 	}
@@ -125,6 +182,9 @@ private:
 
 	void on_resolve(error_code const& e
 		, tcp::resolver::iterator i);
+	void on_name_lookup(error_code const& e
+		, std::vector<address> const& addresses);
+	void sort_endpoints();
 	void queue_connect();
 	void connect(int ticket, tcp::endpoint target_address);
 	void on_connect_timeout();
@@ -137,6 +197,15 @@ private:
 
 	void callback(error_code const& e, char const* data = 0, int size = 0);
 
+	// returns true if the socket may be handed to the
+	// pool once the current response is complete
+	bool can_keep_alive() const;
+	// moves the socket into the connection pool
+	void release_to_pool();
+	// called when a connection from the pool turned out
+	// to be closed by the server. Opens a new one
+	void reconnect();
+
 	std::vector<char> m_recvbuffer;
 #ifdef TORRENT_USE_OPENSSL
 	variant_stream<socket_type, ssl_stream<socket_type> > m_sock;
@@ -145,6 +214,9 @@ private:
 #endif
 	int m_read_pos;
 	tcp::resolver m_resolver;
+	// if set, host names are looked up through this
+	// (caching) resolver instead of m_resolver
+	resolver* m_host_resolver;
 	http_parser m_parser;
 	http_handler m_handler;
 	http_connect_handler m_connect_handler;
@@ -202,6 +274,16 @@ private:
 	int m_priority;
 
 	bool m_abort;
+
+	// if set, idle connections are taken from and
+	// returned to this pool
+	http_connection_pool* m_pool;
+
+	// true if the socket was taken from m_pool and we
+	// haven't received anything on it yet. The server
+	// may have closed it in the meantime, in which case
+	// the request is sent again over a new connection
+	bool m_reused;
 };
 
 }
@@ -53,7 +53,7 @@ namespace libtorrent
 {
 	
 	struct http_connection;
-	class entry;
+	struct lazy_entry;
 	class http_parser;
 	class connection_queue;
 	struct session_settings;
@@ -87,8 +87,8 @@ namespace libtorrent
 
 		virtual void on_timeout() {}
 
-		void parse(int status_code, const entry& e);
-		bool extract_peer_info(const entry& e, peer_entry& ret);
+		void parse(int status_code, lazy_entry const& e);
+		bool extract_peer_info(lazy_entry const& e, peer_entry& ret);
 
 		tracker_manager& m_man;
 		boost::shared_ptr<http_connection> m_tracker_connection;
@@ -0,0 +1,179 @@
+/*
+
+Copyright (c) 2008, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_INTRUSIVE_LIST_HPP_INCLUDED
+#define TORRENT_INTRUSIVE_LIST_HPP_INCLUDED
+
+#include <iterator>
+#include <cstddef>
+#include <boost/noncopyable.hpp>
+#include "libtorrent/assert.hpp"
+
+namespace libtorrent
+{
+	template <class T, class Tag, bool Owning> class intrusive_list;
+	template <class T, class Tag> struct intrusive_list_iterator;
+
+	// an object that can be linked into an intrusive_list<T, Tag>
+	// derives from list_hook<Tag>. The tag makes it possible for
+	// the same object to be a member of more than one list at a
+	// time, one per tag.
+	template <class Tag>
+	struct list_hook
+	{
+		list_hook(): m_prev(0), m_next(0), m_owner(0) {}
+		~list_hook() { TORRENT_ASSERT(m_owner == 0); }
+	private:
+		template <class T, class U, bool O> friend class intrusive_list;
+		template <class T, class U> friend struct intrusive_list_iterator;
+
+		list_hook* m_prev;
+		list_hook* m_next;
+		// the list this node is linked into, or 0
+		void const* m_owner;
+	};
+
+	// a forward iterator over the objects in an intrusive_list.
+	// dereferencing it yields a plain pointer to the object, just
+	// like iterating over a std::set<T*>. Unlinking the object an
+	// iterator refers to invalidates only that iterator.
+	template <class T, class Tag>
+	struct intrusive_list_iterator
+	{
+		typedef std::forward_iterator_tag iterator_category;
+		typedef T* value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef T* const* pointer;
+		typedef T* reference;
+
+		intrusive_list_iterator(): m_node(0) {}
+		explicit intrusive_list_iterator(list_hook<Tag>* n): m_node(n) {}
+
+		T* operator*() const { return static_cast<T*>(m_node); }
+
+		intrusive_list_iterator& operator++()
+		{
+			TORRENT_ASSERT(m_node);
+			m_node = m_node->m_next;
+			return *this;
+		}
+
+		intrusive_list_iterator operator++(int)
+		{
+			intrusive_list_iterator ret(*this);
+			++*this;
+			return ret;
+		}
+
+		bool operator==(intrusive_list_iterator const& rhs) const
+		{ return m_node == rhs.m_node; }
+		bool operator!=(intrusive_list_iterator const& rhs) const
+		{ return m_node != rhs.m_node; }
+
+	private:
+		list_hook<Tag>* m_node;
+	};
+
+	// a doubly linked list whose links live in the objects
+	// themselves. Inserting and removing objects never allocates
+	// and removal is O(1). If Owning is true, the list holds a
+	// reference (intrusive_ptr_add_ref) to every object in it, and
+	// releases it when the object is erased.
+	template <class T, class Tag, bool Owning = false>
+	class intrusive_list : boost::noncopyable
+	{
+	public:
+		typedef T* value_type;
+		typedef intrusive_list_iterator<T, Tag> iterator;
+		typedef intrusive_list_iterator<T, Tag> const_iterator;
+
+		intrusive_list(): m_first(0), m_last(0), m_size(0) {}
+		~intrusive_list() { TORRENT_ASSERT(m_size == 0); }
+
+		iterator begin() const { return iterator(m_first); }
+		iterator end() const { return iterator(); }
+
+		int size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+		T* front() const
+		{
+			TORRENT_ASSERT(m_first);
+			return static_cast<T*>(m_first);
+		}
+
+		// returns true if p is linked into this list
+		bool contains(T const* p) const
+		{
+			return static_cast<list_hook<Tag> const*>(p)->m_owner == this;
+		}
+
+		void push_back(T* p)
+		{
+			list_hook<Tag>* n = p;
+			TORRENT_ASSERT(n->m_owner == 0);
+			n->m_owner = this;
+			n->m_prev = m_last;
+			n->m_next = 0;
+			if (m_last) m_last->m_next = n;
+			else m_first = n;
+			m_last = n;
+			++m_size;
+			if (Owning) intrusive_ptr_add_ref(p);
+		}
+
+		void erase(T const* p)
+		{
+			list_hook<Tag>* n = const_cast<list_hook<Tag>*>(
+				static_cast<list_hook<Tag> const*>(p));
+			TORRENT_ASSERT(n->m_owner == this);
+			if (n->m_prev) n->m_prev->m_next = n->m_next;
+			else m_first = n->m_next;
+			if (n->m_next) n->m_next->m_prev = n->m_prev;
+			else m_last = n->m_prev;
+			n->m_prev = 0;
+			n->m_next = 0;
+			n->m_owner = 0;
+			--m_size;
+			// this may delete p, so it must be the last thing we do
+			if (Owning) intrusive_ptr_release(p);
+		}
+
+	private:
+		list_hook<Tag>* m_first;
+		list_hook<Tag>* m_last;
+		int m_size;
+	};
+}
+
+#endif // TORRENT_INTRUSIVE_LIST_HPP_INCLUDED
+
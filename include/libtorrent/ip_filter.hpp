@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_IP_FILTER_HPP
 
 #include <set>
+#include <vector>
 #include <iostream>
 
 #ifdef _MSC_VER
@@ -43,6 +44,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <boost/limits.hpp>
 #include <boost/utility.hpp>
 #include <boost/tuple/tuple.hpp>
+#include <boost/cstdint.hpp>
 
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -137,6 +139,70 @@ namespace detail
 	inline boost::uint16_t max_addr<boost::uint16_t>()
 	{ return (std::numeric_limits<boost::uint16_t>::max)(); }
 
+	// an IPv6 address as two integers, most significant first
+	struct v6_key
+	{
+		boost::uint64_t hi;
+		boost::uint64_t lo;
+	};
+
+	// written with bitwise operators to avoid branches
+	// in the binary search
+	inline bool operator<=(v6_key const& lhs, v6_key const& rhs)
+	{
+		return (lhs.hi < rhs.hi) | ((lhs.hi == rhs.hi) & (lhs.lo <= rhs.lo));
+	}
+
+	// converts addresses to and from the integer keys
+	// used by the compiled lookup table, which compare
+	// in one or two instructions
+	template<class Addr> struct filter_key;
+
+	template<>
+	struct filter_key<address_v4::bytes_type>
+	{
+		typedef boost::uint32_t type;
+		static type make(address_v4::bytes_type const& a)
+		{
+			return (type(a[0]) << 24) | (type(a[1]) << 16)
+				| (type(a[2]) << 8) | type(a[3]);
+		}
+		static address_v4::bytes_type addr(type k)
+		{
+			address_v4::bytes_type a;
+			for (int i = 3; i >= 0; --i, k >>= 8) a[i] = k & 0xff;
+			return a;
+		}
+	};
+
+	template<>
+	struct filter_key<address_v6::bytes_type>
+	{
+		typedef v6_key type;
+		static type make(address_v6::bytes_type const& a)
+		{
+			type k = {0, 0};
+			for (int i = 0; i < 8; ++i) k.hi = (k.hi << 8) | a[i];
+			for (int i = 8; i < 16; ++i) k.lo = (k.lo << 8) | a[i];
+			return k;
+		}
+		static address_v6::bytes_type addr(type k)
+		{
+			address_v6::bytes_type a;
+			for (int i = 15; i >= 8; --i, k.lo >>= 8) a[i] = k.lo & 0xff;
+			for (int i = 7; i >= 0; --i, k.hi >>= 8) a[i] = k.hi & 0xff;
+			return a;
+		}
+	};
+
+	template<>
+	struct filter_key<boost::uint16_t>
+	{
+		typedef boost::uint16_t type;
+		static type make(boost::uint16_t a) { return a; }
+		static boost::uint16_t addr(type k) { return k; }
+	};
+
 	// this is the generic implementation of
 	// a filter for a specific address type.
 	// it works with IPv4 and IPv6
@@ -156,6 +222,8 @@ namespace detail
 			using boost::next;
 			using boost::prior;
 
+			decompile();
+
 			TORRENT_ASSERT(!m_access_list.empty());
 			TORRENT_ASSERT(first < last || first == last);
 			
@@ -209,8 +277,44 @@ namespace detail
 			TORRENT_ASSERT(!m_access_list.empty());
 		}
 
+		// moves the rules from the set into sorted arrays of
+		// range start keys and flags. They take a fraction of
+		// the memory of the set and are searched without
+		// chasing pointers. The next call to add_rule() moves
+		// the rules back into the set
+		void compile()
+		{
+			if (m_access_list.empty()) return;
+			m_keys.reserve(m_access_list.size());
+			m_flags.reserve(m_access_list.size());
+			for (typename range_t::const_iterator i = m_access_list.begin()
+				, end(m_access_list.end()); i != end; ++i)
+			{
+				m_keys.push_back(key_traits::make(i->start));
+				m_flags.push_back(i->access);
+			}
+			range_t().swap(m_access_list);
+		}
+
 		int access(Addr const& addr) const
 		{
+			if (!m_keys.empty())
+			{
+				// binary search for the last range starting at or
+				// before addr. The first range always starts at
+				// zero, so base[0] <= k holds throughout
+				typename key_traits::type k = key_traits::make(addr);
+				typename key_traits::type const* base = &m_keys[0];
+				int n = int(m_keys.size());
+				while (n > 1)
+				{
+					int half = n / 2;
+					base = (base[half] <= k) ? base + half : base;
+					n -= half;
+				}
+				return m_flags[base - &m_keys[0]];
+			}
+
 			TORRENT_ASSERT(!m_access_list.empty());
 			typename range_t::const_iterator i = m_access_list.upper_bound(addr);
 			if (i != m_access_list.begin()) --i;
@@ -224,6 +328,24 @@ namespace detail
 		std::vector<ip_range<ExternalAddressType> > export_filter() const
 		{
 			std::vector<ip_range<ExternalAddressType> > ret;
+
+			if (!m_keys.empty())
+			{
+				ret.reserve(m_keys.size());
+				for (int i = 0; i < int(m_keys.size()); ++i)
+				{
+					ip_range<ExternalAddressType> r;
+					r.first = ExternalAddressType(key_traits::addr(m_keys[i]));
+					r.flags = m_flags[i];
+					if (i + 1 == int(m_keys.size()))
+						r.last = ExternalAddressType(max_addr<Addr>());
+					else
+						r.last = ExternalAddressType(minus_one(key_traits::addr(m_keys[i + 1])));
+					ret.push_back(r);
+				}
+				return ret;
+			}
+
 			ret.reserve(m_access_list.size());
 
 			for (typename range_t::const_iterator i = m_access_list.begin()
@@ -245,6 +367,23 @@ namespace detail
 		}
 
 	private:
+
+		typedef filter_key<Addr> key_traits;
+
+		// moves the rules from the compiled arrays back
+		// into the set, to be able to modify them
+		void decompile()
+		{
+			if (m_keys.empty()) return;
+			TORRENT_ASSERT(m_access_list.empty());
+			for (int i = 0; i < int(m_keys.size()); ++i)
+			{
+				m_access_list.insert(m_access_list.end()
+					, range(key_traits::addr(m_keys[i]), m_flags[i]));
+			}
+			std::vector<typename key_traits::type>().swap(m_keys);
+			std::vector<int>().swap(m_flags);
+		}
 	
 		struct range
 		{
@@ -260,7 +399,16 @@ namespace detail
 		};
 
 		typedef std::set<range> range_t;
+
+		// the rules are either in m_access_list or, once the
+		// filter has been compiled, in m_keys and m_flags.
+		// The other one is empty
 		range_t m_access_list;
+
+		// the start of every range, sorted, and the flags
+		// of the range at the same index
+		std::vector<typename key_traits::type> m_keys;
+		std::vector<int> m_flags;
 	
 	};
 
@@ -280,6 +428,11 @@ public:
 	void add_rule(address first, address last, int flags);
 	int access(address const& addr) const;
 
+	// converts the rules into compact sorted arrays that
+	// are quicker to search. Adding a rule afterwards
+	// converts them back
+	void compile();
+
 	typedef boost::tuple<std::vector<ip_range<address_v4> >
 		, std::vector<ip_range<address_v6> > > filter_tuple_t;
 	
@@ -53,6 +53,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/session_settings.hpp"
 #include "libtorrent/session_status.hpp"
 #include "libtorrent/udp_socket.hpp"
+#include "libtorrent/resolver.hpp"
 #include "libtorrent/socket.hpp"
 
 namespace libtorrent { namespace dht
@@ -72,7 +73,7 @@ namespace libtorrent { namespace dht
 		friend void intrusive_ptr_add_ref(dht_tracker const*);
 		friend void intrusive_ptr_release(dht_tracker const*);
 		dht_tracker(udp_socket& sock, dht_settings const& settings
-			, entry const& bootstrap);
+			, resolver& host_resolver, entry const& bootstrap);
 		void stop();
 
 		void add_node(udp::endpoint node);
@@ -98,9 +99,9 @@ namespace libtorrent { namespace dht
 		{ return boost::intrusive_ptr<dht_tracker>(this); }
 
 		void on_name_lookup(error_code const& e
-			, udp::resolver::iterator host);
+			, std::vector<address> const& addresses, int port);
 		void on_router_name_lookup(error_code const& e
-			, udp::resolver::iterator host);
+			, std::vector<address> const& addresses, int port);
 		void connection_timeout(error_code const& e);
 		void refresh_timeout(error_code const& e);
 		void tick(error_code const& e);
@@ -126,8 +127,9 @@ namespace libtorrent { namespace dht
 		mutable mutex_t m_mutex;
 		bool m_abort;
 
-		// used to resolve hostnames for nodes
-		udp::resolver m_host_resolver;
+		// the session's shared resolver, used to resolve
+		// hostnames for nodes
+		resolver& m_host_resolver;
 
 		// used to ignore abusive dht nodes
 		struct node_ban_entry
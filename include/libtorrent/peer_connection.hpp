@@ -77,12 +77,19 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/chained_buffer.hpp"
 #include "libtorrent/disk_buffer_holder.hpp"
 #include "libtorrent/bitfield.hpp"
+#include "libtorrent/intrusive_list.hpp"
 
 namespace libtorrent
 {
 	class torrent;
 	struct peer_plugin;
 
+	// tags for the intrusive lists of connections kept by the
+	// torrent (torrent::m_connections) and the session
+	// (session_impl::m_connections)
+	struct torrent_peer_tag;
+	struct session_peer_tag;
+
 	namespace detail
 	{
 		struct session_impl;
@@ -90,11 +97,15 @@ namespace libtorrent
 
 	struct pending_block
 	{
-		pending_block(piece_block const& b): skipped(0), block(b) {}
+		pending_block(piece_block const& b)
+			: skipped(0), block(b), send_time(min_time()) {}
 		int skipped;
 		// the number of times the request
 		// has been skipped by out of order blocks
 		piece_block block;
+		// the time the request was sent. Used to
+		// measure the request round trip time
+		ptime send_time;
 	};
 
 	struct has_block
@@ -107,6 +118,8 @@ namespace libtorrent
 
 	class TORRENT_EXPORT peer_connection
 		: public intrusive_ptr_base<peer_connection>
+		, public list_hook<torrent_peer_tag>
+		, public list_hook<session_peer_tag>
 		, public boost::noncopyable
 	{
 	friend class invariant_access;
@@ -231,8 +244,19 @@ namespace libtorrent
 		bool is_peer_interested() const { return m_peer_interested; }
 		bool has_peer_choked() const { return m_peer_choked; }
 
+		// updates our interested state in this peer. This only
+		// looks at m_num_wanted, it doesn't scan the pieces
 		void update_interest();
 
+		// recounts the number of pieces this peer has that are
+		// set in 'wanted'. This is used when many piece priorities
+		// change at once
+		void update_wanted(bitfield const& wanted);
+
+		// the piece at 'index' either became wanted or stopped
+		// being wanted (because we got it or it was filtered)
+		void piece_wanted(int index, bool wanted);
+
 		virtual void get_peer_info(peer_info& p) const;
 
 		// returns the torrent this connection is a part of
@@ -397,6 +421,11 @@ namespace libtorrent
 		// speaks our protocol (be it bittorrent or http).
 		virtual bool in_handshake() const = 0;
 
+		// returns true if the receive path may read past the end
+		// of the current message. The bytes read ahead are passed
+		// on to on_receive() one message at a time
+		virtual bool can_read_ahead() const { return false; }
+
 		// returns the block currently being
 		// downloaded. And the progress of that
 		// block. If the peer isn't downloading
@@ -418,6 +447,17 @@ namespace libtorrent
 		virtual buffer::interval allocate_send_buffer(int size);
 		virtual void setup_send();
 
+		// schedules a call to setup_send() once the current
+		// handler returns, so that all messages queued while
+		// handling one event are sent with a single write
+		void defer_send();
+
+		// counts one peer protocol message towards the session's
+		// sent message rate. A message may be queued by several
+		// calls to the functions above, so the message builders
+		// call this once per message
+		void sent_message();
+
 		template <class Destructor>
 		void append_send_buffer(char* buffer, int size, Destructor const& destructor)
 		{
@@ -488,8 +528,8 @@ namespace libtorrent
 			TORRENT_ASSERT(!m_disk_recv_buffer);
 			TORRENT_ASSERT(m_disk_recv_buffer_size == 0);
 			if (m_recv_buffer.empty()) return buffer::interval(0,0);
-			return buffer::interval(&m_recv_buffer[0]
-				, &m_recv_buffer[0] + m_recv_pos);
+			return buffer::interval(&m_recv_buffer[0] + m_recv_start
+				, &m_recv_buffer[0] + m_recv_start + m_recv_pos);
 		}
 
 		std::pair<buffer::interval, buffer::interval> wr_recv_buffers(int bytes);
@@ -498,8 +538,8 @@ namespace libtorrent
 		buffer::const_interval receive_buffer() const
 		{
 			if (m_recv_buffer.empty()) return buffer::const_interval(0,0);
-			return buffer::const_interval(&m_recv_buffer[0]
-				, &m_recv_buffer[0] + m_recv_pos);
+			return buffer::const_interval(&m_recv_buffer[0] + m_recv_start
+				, &m_recv_buffer[0] + m_recv_start + m_recv_pos);
 		}
 
 		bool allocate_disk_receive_buffer(int disk_buffer_size);
@@ -507,6 +547,7 @@ namespace libtorrent
 		bool has_disk_receive_buffer() const { return m_disk_recv_buffer; }
 		void cut_receive_buffer(int size, int packet_size);
 		void reset_recv_buffer(int packet_size);
+		void compact_recv_buffer();
 
 		void setup_receive();
 
@@ -531,6 +572,7 @@ namespace libtorrent
 		// work to do.
 		void on_send_data(error_code const& error
 			, std::size_t bytes_transferred);
+		void on_deferred_send();
 		void on_receive_data(error_code const& error
 			, std::size_t bytes_transferred);
 
@@ -630,6 +672,11 @@ namespace libtorrent
 		// they sent us
 		size_type m_downloaded_at_last_unchoke;
 
+		// the total number of payload bytes downloaded
+		// at the last second_tick(). Used to measure the
+		// download rate over the last tick alone
+		size_type m_downloaded_last_tick;
+
 #ifndef TORRENT_DISABLE_GEO_IP
 		std::string m_inet_as_name;
 #endif
@@ -697,6 +744,12 @@ namespace libtorrent
 		// m_have_piece.end(), true)
 		int m_num_pieces;
 
+		// the number of pieces this peer has that we
+		// don't have and that have a priority > 0. This
+		// is maintained incrementally, and when it's
+		// non-zero we're interested in the peer
+		int m_num_wanted;
+
 		// the timeout in seconds
 		int m_timeout;
 
@@ -708,6 +761,20 @@ namespace libtorrent
 		// we've received so far
 		int m_recv_pos;
 
+		// the number of bytes received into m_recv_buffer,
+		// including bytes that have been read ahead, past the
+		// end of the current message. The bytes in the range
+		// [m_recv_pos, m_recv_end) have not been passed on to
+		// on_receive() yet
+		int m_recv_end;
+
+		// the offset in m_recv_buffer where the current message
+		// starts. m_recv_pos and m_recv_end are relative to it.
+		// Finished messages are cut off the front by advancing
+		// this offset, and the remaining bytes are moved to the
+		// front of the buffer once per read, by compact_recv_buffer()
+		int m_recv_start;
+
 		int m_disk_recv_buffer_size;
 
 		// the number of bytes we are currently reading
@@ -769,6 +836,29 @@ namespace libtorrent
 		// was called. The rtt is specified in milliseconds
 		boost::uint16_t m_rtt;
 
+		// the shortest time from sending a request to
+		// receiving the block, in milliseconds, seen in
+		// the current and the previous measurement window.
+		// Together with the download rate this determines
+		// the request queue size. 0 means there hasn't been
+		// any sample yet
+		boost::uint16_t m_request_rtt;
+
+		// the shortest request round trip seen in the
+		// current window. It replaces m_request_rtt once
+		// the window ends, to let the estimate grow again
+		// if the path to the peer gets slower
+		boost::uint16_t m_request_rtt_window;
+
+		// the number of ticks left in the current
+		// request round trip window
+		boost::uint8_t m_rtt_window_ticks;
+
+		// the download rate measured over the previous
+		// tick, in bytes per second. Used to tell when
+		// slow start stops increasing the rate
+		int m_slow_start_rate;
+
 		// if set to non-zero, this peer will always prefer
 		// to request entire n pieces, rather than blocks.
 		// where n is the value of this variable.
@@ -778,8 +868,10 @@ namespace libtorrent
 		boost::uint8_t m_prefer_whole_pieces;
 		
 		// the number of request we should queue up
-		// at the remote end.
-		boost::uint8_t m_desired_queue_size;
+		// at the remote end. This is bounded by
+		// max_out_request_queue, which may be set
+		// to anything, so it's a full int
+		int m_desired_queue_size;
 
 		// if this is true, the disconnection
 		// timestamp is not updated when the connection
@@ -823,6 +915,17 @@ namespace libtorrent
 		// is used to fill the bitmask in init()
 		bool m_have_all:1;
 
+		// this is true while a call to on_deferred_send()
+		// is posted to the io_service. Messages queued in
+		// the meantime go out in the same write
+		bool m_send_deferred:1;
+
+		// this is true from the time the connection is
+		// made until the download rate stops growing. While
+		// in slow start, the request queue grows by one for
+		// every block received
+		bool m_slow_start:1;
+
 		// this is true if this connection has been added
 		// to the list of connections that will be closed.
 		bool m_disconnecting:1;
@@ -58,7 +58,8 @@ namespace libtorrent
 			seed = 0x400,
 			optimistic_unchoke = 0x800,
 			snubbed = 0x1000,
-			upload_only = 0x2000
+			upload_only = 0x2000,
+			slow_start = 0x4000
 #ifndef TORRENT_DISABLE_ENCRYPTION
 			, rc4_encrypted = 0x100000,
 			plaintext_encrypted = 0x200000
@@ -193,6 +194,10 @@ namespace libtorrent
 		// estimated rtt to peer, in milliseconds
 		int rtt;
 
+		// the shortest time from sending a request
+		// to receiving the block, in milliseconds
+		int request_rtt;
+
 		// the highest transfer rates seen for this peer
 		int download_rate_peak;
 		int upload_rate_peak;
@@ -183,6 +183,11 @@ namespace libtorrent
 		// returns the current piece priorities for all pieces
 		void piece_priorities(std::vector<int>& pieces) const;
 
+		// sets the bits of the pieces we don't have and that
+		// have a priority > 0. These are the pieces that makes
+		// a peer interesting
+		void wanted_pieces(bitfield& bits) const;
+
 		// ========== start deprecation ==============
 
 		// fills the bitmask with 1's for pieces that are filtered
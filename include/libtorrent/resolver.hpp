@@ -0,0 +1,140 @@
+/*
+
+Copyright (c) 2008, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef TORRENT_RESOLVER_HPP_INCLUDED
+#define TORRENT_RESOLVER_HPP_INCLUDED
+
+#include <map>
+#include <vector>
+#include <string>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include "libtorrent/socket.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/config.hpp"
+
+namespace libtorrent
+{
+
+	// a session-wide, caching host name resolver. Lookups of the
+	// same host name share a single outstanding query, and the
+	// result (including failures) is remembered for a while, to
+	// avoid hitting the system resolver for every tracker announce,
+	// web seed connection attempt and DHT router lookup.
+	class TORRENT_EXPORT resolver : boost::noncopyable
+	{
+	public:
+
+		typedef boost::function<void(error_code const&
+			, std::vector<address> const&)> callback_t;
+
+		// success_ttl is the number of seconds a successful lookup
+		// is cached, failure_ttl the number of seconds a failed one is
+		resolver(io_service& ios, int success_ttl = 1200, int failure_ttl = 60);
+
+		// the handler is never called from within this function,
+		// it is always posted to the io_service. Unless there's
+		// an error, the address list is never empty. owner is an
+		// optional tag that can be passed to cancel() to abort
+		// only the lookups made on behalf of a specific object
+		void async_resolve(std::string const& host, callback_t const& h
+			, void const* owner = 0);
+
+		// fails all outstanding lookups with operation_aborted
+		// and forgets all cached entries
+		void cancel();
+
+		// fails the outstanding lookups that were made with the
+		// given owner tag with operation_aborted. The handlers
+		// are posted to the io_service immediately, without
+		// waiting for the lookup to complete
+		void cancel(void const* owner);
+
+		// the number of calls to async_resolve and how many of
+		// those were answered from the cache, or by joining an
+		// already outstanding lookup
+		int num_lookups() const;
+		int num_cache_hits() const;
+
+	private:
+
+		void on_lookup(error_code const& ec, tcp::resolver::iterator i
+			, std::string host, int lookup_id);
+
+		struct pending_handler
+		{
+			callback_t handler;
+			void const* owner;
+		};
+
+		struct dns_cache_entry
+		{
+			dns_cache_entry(): lookup_id(0), pending(true) {}
+			std::vector<address> addresses;
+			error_code error;
+			ptime expires;
+			// identifies the lookup that fills in this entry, in
+			// case the entry is cancelled and a new lookup of the
+			// same host name is started before the first returns
+			int lookup_id;
+			// true while the lookup is still outstanding. The
+			// handlers waiting for it are in handlers
+			bool pending;
+			std::vector<pending_handler> handlers;
+		};
+
+		typedef std::map<std::string, dns_cache_entry> cache_t;
+		cache_t m_cache;
+
+		io_service& m_ios;
+		tcp::resolver m_resolver;
+
+		time_duration m_success_ttl;
+		time_duration m_failure_ttl;
+
+		int m_num_lookups;
+		int m_num_cache_hits;
+
+		// the id given to the next lookup
+		int m_next_lookup_id;
+
+		typedef boost::mutex mutex_t;
+		mutable mutex_t m_mutex;
+	};
+
+}
+
+#endif // TORRENT_RESOLVER_HPP_INCLUDED
+
@@ -48,6 +48,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <boost/tuple/tuple.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/thread.hpp>
+#include <boost/function.hpp>
 
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -172,6 +173,17 @@ namespace libtorrent
 
 		// returns a list of all torrents in this session
 		std::vector<torrent_handle> get_torrents() const;
+
+		// fills in ret with the status of all torrents for which
+		// pred returns true (or all torrents if pred is empty). The
+		// session is locked once for the whole operation
+		void get_torrent_status(std::vector<torrent_status>* ret
+			, boost::function<bool(torrent_status const&)> const& pred
+			= boost::function<bool(torrent_status const&)>()) const;
+
+		// fills in ret with the status of the torrents whose status
+		// may have changed since the last call to this function
+		void get_updated_torrent_status(std::vector<torrent_status>* ret);
 		
 		// returns an invalid handle in case the torrent doesn't exist
 		torrent_handle find_torrent(sha1_hash const& info_hash) const;
@@ -319,6 +331,12 @@ namespace libtorrent
 		void set_max_half_open_connections(int limit);
 
 		std::auto_ptr<alert> pop_alert();
+
+		// pops all pending alerts and appends them to alerts. The
+		// caller owns the returned alerts and must delete them
+		void pop_alerts(std::vector<alert*>* alerts);
+
+		int set_alert_queue_size_limit(int queue_size_limit_);
 #ifndef TORRENT_NO_DEPRECATE
 		void set_severity_level(alert::severity_t s) TORRENT_DEPRECATED;
 #endif
@@ -91,12 +91,13 @@ namespace libtorrent
 			, request_timeout(50)
 			, request_queue_time(3.f)
 			, max_allowed_in_request_queue(250)
-			, max_out_request_queue(200)
+			, max_out_request_queue(500)
 			, whole_pieces_threshold(20)
 			, peer_timeout(120)
 			, urlseed_timeout(20)
 			, urlseed_pipeline_size(5)
 			, urlseed_wait_retry(30)
+			, urlseed_max_connections(4)
 			, file_pool_size(40)
 			, allow_multiple_connections_per_ip(false)
 			, max_failcount(3)
@@ -124,11 +125,13 @@ namespace libtorrent
 			, use_parole_mode(true)
 			, cache_size(512)
 			, cache_expiry(60)
+			, disable_os_cache(false)
 			, outgoing_ports(0,0)
 			, peer_tos(0)
 			, active_downloads(8)
 			, active_seeds(5)
 			, active_limit(15)
+			, active_checking(3)
 			, dont_count_slow_torrents(true)
 			, auto_manage_interval(30)
 			, share_ratio_limit(2.f)
@@ -192,7 +195,8 @@ namespace libtorrent
 		
 		// the maximum number of outstanding requests to
 		// send to a peer. This limit takes precedence over
-		// request_queue_time.
+		// request_queue_time and the bandwidth-delay
+		// product.
 		int max_out_request_queue;
 
 		// if a whole piece can be downloaded in this number
@@ -218,6 +222,11 @@ namespace libtorrent
 
 		// time to wait until a new retry takes place
 		int urlseed_wait_retry;
+
+		// the max number of connections to open to each
+		// url-seed. Additional connections are opened one
+		// at a time, once every second
+		int urlseed_max_connections;
 		
 		// sets the upper limit on the total number of files this
 		// session will keep open. The reason why files are
@@ -360,6 +369,12 @@ namespace libtorrent
 		// to disk. Default is 60 seconds.
 		int cache_expiry;
 
+		// if this is true, torrent files are read and written
+		// bypassing the operating system's page cache (O_DIRECT)
+		// where the buffers and offsets are aligned. The disk
+		// cache is then the only cache for torrent data
+		bool disable_os_cache;
+
 		// if != (0, 0), this is the range of ports that
 		// outgoing connections will be bound to. This
 		// is useful for users that have routers that
@@ -381,6 +396,11 @@ namespace libtorrent
 		int active_seeds;
 		int active_limit;
 
+		// the max number of torrents that are checked
+		// at the same time. Torrents whose files are on
+		// the same device are never checked concurrently
+		int active_checking;
+
 		// if this is true, torrents that don't have any significant
 		// transfers are not counted as active when determining which
 		// auto managed torrents to pause and resume
@@ -63,6 +63,14 @@ namespace libtorrent
 		int up_bandwidth_queue;
 		int down_bandwidth_queue;
 
+		int dns_lookups;
+		int dns_cache_hits;
+
+		float sent_message_rate;
+		float received_message_rate;
+		float send_call_rate;
+		float receive_call_rate;
+
 #ifndef TORRENT_DISABLE_DHT
 		int dht_nodes;
 		int dht_node_cache;
@@ -151,6 +151,13 @@ namespace libtorrent
 		// returns the sha1-hash for the data at the given slot
 		virtual sha1_hash hash_for_slot(int slot, partial_hash& h, int piece_size) = 0;
 
+		// reserves disk space for the range [offset, offset + size)
+		// of the torrent, in full allocation mode. Returns 0 if the
+		// storage can't reserve space without writing to the files,
+		// and leaves them sparse. Negative return value indicates
+		// an error
+		virtual int allocate(size_type offset, size_type size) { return 0; }
+
 		// this will close all open files that are opened for
 		// writing. This is called when a torrent has finished
 		// downloading.
@@ -250,13 +257,22 @@ namespace libtorrent
 		void async_save_resume_data(
 			boost::function<void(int, disk_io_job const&)> const& handler);
 
+		// reserves disk space for the next chunk of the files.
+		// The handler is called with allocation_pending until all
+		// of the storage has been allocated
+		void async_allocate(
+			boost::function<void(int, disk_io_job const&)> const& handler);
+
 		enum return_t
 		{
 			// return values from check_fastresume and check_files
 			no_error = 0,
 			need_full_check = -1,
 			fatal_disk_error = -2,
-			disk_check_aborted = -3
+			disk_check_aborted = -3,
+			// return value from async_allocate when there is
+			// more left to allocate
+			allocation_pending = -4
 		};
 
 	private:
@@ -298,7 +314,7 @@ namespace libtorrent
 		std::string name() const { return m_info->name(); }
 #endif
 
-		bool allocate_slots(int num_slots, bool abort_on_disk = false);
+		void allocate_slots(int num_slots);
 
 		int read_impl(
 			char* buf
@@ -314,6 +330,11 @@ namespace libtorrent
 
 		// -1=error 0=ok 1=skip
 		int check_one_piece(int& have_piece);
+
+		// allocates the next chunk of the storage. progress is
+		// set to the number of pieces allocated so far. Returns
+		// allocation_pending, no_error or fatal_disk_error
+		int allocate_impl(int& progress);
 		int identify_data(
 			const std::vector<char>& piece_data
 			, int current_slot);
@@ -329,6 +350,11 @@ namespace libtorrent
 		int move_storage_impl(fs::path const& save_path);
 
 		int allocate_slot_for_piece(int piece_index);
+
+		// moves one piece that was written out of place in
+		// compact mode into its own slot. Returns 1 if there
+		// may be more pieces to move and 0 when it's done
+		int defrag_impl();
 #ifndef NDEBUG
 		void check_invariant() const;
 #ifdef TORRENT_STORAGE_DEBUG
@@ -381,10 +407,18 @@ namespace libtorrent
 			state_expand_pieces
 		} m_state;
 		int m_current_slot;
+		// the number of bytes of the storage that has been
+		// allocated by allocate_impl()
+		size_type m_allocated;
 		// used during check. If any piece is found
 		// that is not in its final position, this
 		// is set to true
 		bool m_out_of_place;
+		// in compact mode, pieces are not moved into their
+		// final slots while downloading. This is set when
+		// there are pieces that can be moved, which is done
+		// by the disk thread when it's idle
+		bool m_need_defrag;
 		// used to move pieces while expanding
 		// the storage from compact allocation
 		// to full allocation
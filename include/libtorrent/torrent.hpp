@@ -71,6 +71,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/assert.hpp"
 #include "libtorrent/bitfield.hpp"
+#include "libtorrent/intrusive_list.hpp"
 
 namespace libtorrent
 {
@@ -82,6 +83,10 @@ namespace libtorrent
 	struct torrent_plugin;
 	struct bitfield;
 
+	// tag for the list_hook a peer_connection uses to
+	// link itself into its torrent's list of connections
+	struct torrent_peer_tag;
+
 	namespace aux
 	{
 		struct session_impl;
@@ -150,8 +155,7 @@ namespace libtorrent
 #endif
 
 #ifndef NDEBUG
-		bool has_peer(peer_connection* p) const
-		{ return m_connections.find(p) != m_connections.end(); }
+		bool has_peer(peer_connection* p) const;
 #endif
 
 		// this is called when the torrent has metadata.
@@ -164,6 +168,14 @@ namespace libtorrent
 		void files_checked();
 		void start_checking();
 
+		// in full allocation mode, this reserves the disk
+		// space for the files in the background, while
+		// downloading. Allocation stops while the torrent
+		// is paused and picks up where it left off when
+		// it's resumed
+		void start_allocating();
+		void on_allocated(int ret, disk_io_job const& j);
+
 		void start_announcing();
 		void stop_announcing();
 
@@ -221,6 +233,14 @@ namespace libtorrent
 		void force_recheck();
 		void save_resume_data();
 
+		// true if anything that goes into the resume data has
+		// changed since resume data was last saved successfully
+		bool need_save_resume_data() const { return m_need_save_resume_data; }
+
+		// called when a block has been written to disk, the
+		// unfinished pieces in the resume data have changed
+		void block_written() { m_need_save_resume_data = true; }
+
 		bool is_auto_managed() const { return m_auto_managed; }
 		void auto_managed(bool a);
 
@@ -253,6 +273,12 @@ namespace libtorrent
 
 		torrent_status status() const;
 
+		// adds this torrent to the session's list of torrents
+		// whose status has changed since the last call to
+		// session::get_updated_torrent_status()
+		void state_updated();
+		void clear_in_state_update() { m_in_state_updates = false; }
+
 		void file_progress(std::vector<size_type>& fp) const;
 
 		void use_interface(const char* net_interface);
@@ -337,11 +363,12 @@ namespace libtorrent
 		void give_connect_points(int points);
 
 		// the number of peers that belong to this torrent
-		int num_peers() const { return (int)m_connections.size(); }
+		int num_peers() const { return m_connections.size(); }
 		int num_seeds() const;
 
-		typedef std::set<peer_connection*>::iterator peer_iterator;
-		typedef std::set<peer_connection*>::const_iterator const_peer_iterator;
+		typedef intrusive_list<peer_connection, torrent_peer_tag> peer_list;
+		typedef peer_list::iterator peer_iterator;
+		typedef peer_list::const_iterator const_peer_iterator;
 
 		const_peer_iterator begin() const { return m_connections.begin(); }
 		const_peer_iterator end() const { return m_connections.end(); }
@@ -353,6 +380,12 @@ namespace libtorrent
 
 		void get_full_peer_list(std::vector<peer_list_entry>& v) const;
 		void get_peer_info(std::vector<peer_info>& v);
+
+		// these are used by the torrent_handle::async_*
+		// functions. They post the result as an alert
+		void post_peer_info();
+		void post_status();
+		void post_file_progress();
 		void get_download_queue(std::vector<partial_piece_info>& queue);
 
 // --------------------------------------------
@@ -364,7 +397,8 @@ namespace libtorrent
 		// or when a failure occured
 		virtual void tracker_response(
 			tracker_request const& r
-			, std::vector<peer_entry>& e, int interval
+			, std::vector<peer_entry>& e
+			, std::vector<tcp::endpoint> const& endpoints, int interval
 			, int complete, int incomplete, address const& external_ip);
 		virtual void tracker_request_timed_out(
 			tracker_request const& r);
@@ -493,18 +527,19 @@ namespace libtorrent
 
 		// this is the asio callback that is called when a name
 		// lookup for a PEER is completed.
-		void on_peer_name_lookup(error_code const& e, tcp::resolver::iterator i
-			, peer_id pid);
+		void on_peer_name_lookup(error_code const& e
+			, std::vector<address> const& addresses, peer_id pid, int port);
 
 		// this is the asio callback that is called when a name
 		// lookup for a WEB SEED is completed.
-		void on_name_lookup(error_code const& e, tcp::resolver::iterator i
-			, std::string url, tcp::endpoint proxy);
+		void on_name_lookup(error_code const& e
+			, std::vector<address> const& addresses, std::string url, int port
+			, tcp::endpoint proxy);
 
 		// this is the asio callback that is called when a name
 		// lookup for a proxy for a web seed is completed.
-		void on_proxy_name_lookup(error_code const& e, tcp::resolver::iterator i
-			, std::string url);
+		void on_proxy_name_lookup(error_code const& e
+			, std::vector<address> const& addresses, std::string url, int proxy_port);
 
 		// this is called when the torrent has finished. i.e.
 		// all the pieces we have not filtered have been downloaded.
@@ -559,6 +594,15 @@ namespace libtorrent
 				- m_picker->num_have() - m_picker->num_filtered() == 0;
 		}
 
+		// the number of pieces we don't have and that
+		// have a priority > 0
+		int num_wanted() const
+		{
+			if (is_seed() || !valid_metadata()) return 0;
+			return m_torrent_file->num_pieces()
+				- m_picker->num_have() - m_picker->num_filtered();
+		}
+
 		fs::path save_path() const;
 		alert_manager& alerts() const;
 		piece_picker& picker()
@@ -650,11 +694,13 @@ namespace libtorrent
 	
 		void try_next_tracker(tracker_request const& req);
 		int prioritize_tracker(int tracker_index);
-		void on_country_lookup(error_code const& error, tcp::resolver::iterator i
+		void on_country_lookup(error_code const& error
+			, std::vector<address> const& addresses
 			, boost::intrusive_ptr<peer_connection> p) const;
 		bool request_bandwidth_from_session(int channel) const;
 
 		void update_peer_interest(bool was_finished);
+		void update_wanted_pieces();
 
 		policy m_policy;
 
@@ -683,8 +729,6 @@ namespace libtorrent
 
 		boost::intrusive_ptr<torrent_info> m_torrent_file;
 
-		void parse_response(const entry& e, std::vector<peer_entry>& peer_list);
-
 		// if this pointer is 0, the torrent is in
 		// a state where the metadata hasn't been
 		// received yet.
@@ -716,7 +760,11 @@ namespace libtorrent
 #ifndef NDEBUG
 	public:
 #endif
-		std::set<peer_connection*> m_connections;
+		// the connections that belong to this torrent. The list
+		// is linked through the peer_connection objects themselves,
+		// so adding and removing peers never allocates and removal
+		// is O(1)
+		peer_list m_connections;
 #ifndef NDEBUG
 	private:
 #endif
@@ -738,9 +786,6 @@ namespace libtorrent
 		extension_list_t m_extensions;
 #endif
 
-		// used to resolve the names of web seeds
-		mutable tcp::resolver m_host_resolver;
-		
 		// this announce timer is used both
 		// by Local service discovery and
 		// by the DHT.
@@ -840,6 +885,11 @@ namespace libtorrent
 
 		float m_progress;
 
+		// the fraction of the storage that has been allocated,
+		// in full allocation mode. 1 when allocation is complete
+		// or the torrent isn't in full allocation mode
+		float m_allocation_progress;
+
 		// the upload/download ratio that each peer
 		// tries to maintain.
 		// 0 is infinite
@@ -977,6 +1027,18 @@ namespace libtorrent
 
 		// this is true if event completed has been sent to the tracker
 		bool m_complete_sent:1;
+
+		// this is true while this torrent is in the session's
+		// list of torrents with updated status. It's used to
+		// avoid adding it more than once
+		bool m_in_state_updates:1;
+
+		// set whenever something that's saved in the resume
+		// data changes, cleared by save_resume_data()
+		bool m_need_save_resume_data:1;
+
+		// true while there's an outstanding async_allocate job
+		bool m_allocating:1;
 	};
 
 	inline ptime torrent::next_announce() const
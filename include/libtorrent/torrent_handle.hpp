@@ -84,6 +84,7 @@ namespace libtorrent
 			: state(queued_for_checking)
 			, paused(false)
 			, progress(0.f)
+			, allocation_progress(1.f)
 			, total_download(0)
 			, total_upload(0)
 			, total_payload_download(0)
@@ -136,6 +137,9 @@ namespace libtorrent
 		state_t state;
 		bool paused;
 		float progress;
+		// the fraction of the storage that has been allocated in
+		// full allocation mode, [0, 1]. It's 1 for other modes
+		float allocation_progress;
 		std::string error;
 
 		boost::posix_time::time_duration next_announce;
@@ -269,6 +273,11 @@ namespace libtorrent
 		// true if there are incoming connections to this
 		// torrent
 		bool has_incoming;
+
+		// the info-hash of the torrent this status belongs
+		// to. Used to tell the entries returned by
+		// session::get_torrent_status() apart
+		sha1_hash info_hash;
 	};
 
 	struct TORRENT_EXPORT block_info
@@ -351,6 +360,7 @@ namespace libtorrent
 		void resume() const;
 		void force_recheck() const;
 		void save_resume_data() const;
+		bool need_save_resume_data() const;
 
 		bool is_auto_managed() const;
 		void auto_managed(bool m) const;
@@ -402,6 +412,21 @@ namespace libtorrent
 		void prioritize_files(std::vector<int> const& files) const;
 		std::vector<int> file_priorities() const;
 
+		// non-blocking versions of the functions above. They don't
+		// lock the session, the request is posted to the network
+		// thread and executed there. The async_get_* functions
+		// return their result in an alert (peer_info_alert,
+		// torrent_status_alert and file_progress_alert)
+		void async_get_peer_info() const;
+		void async_status() const;
+		void async_file_progress() const;
+		void async_pause() const;
+		void async_resume() const;
+		void async_piece_priority(int index, int priority) const;
+		void async_prioritize_pieces(std::vector<int> const& pieces) const;
+		void async_file_priority(int index, int priority) const;
+		void async_prioritize_files(std::vector<int> const& files) const;
+
 		// set the interface to bind outgoing connections
 		// to.
 		void use_interface(const char* net_interface) const;
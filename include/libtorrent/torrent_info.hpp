@@ -116,7 +116,7 @@ namespace libtorrent
 		reverse_file_iterator rbegin_files() const { return m_files.rbegin(); }
 		reverse_file_iterator rend_files() const { return m_files.rend(); }
 		int num_files() const { return m_files.num_files(); }
-		file_entry const& file_at(int index) const { return m_files.at(index); }
+		file_entry file_at(int index) const { return m_files.at(index); }
 
 		file_iterator file_at_offset(size_type offset) const
 		{ return m_files.file_at_offset(offset); }
@@ -185,6 +185,11 @@ namespace libtorrent
 
 		int metadata_size() const { return m_info_section_size; }
 
+		// an estimate of the number of bytes of memory used by
+		// this torrent_info, including the file list and the
+		// copy of the info section
+		size_type memory_usage() const;
+
 	private:
 
 		bool parse_torrent_file(lazy_entry const& libtorrent, std::string& error);
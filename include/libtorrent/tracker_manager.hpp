@@ -36,6 +36,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <string>
 #include <utility>
+#include <map>
 #include <ctime>
 
 #ifdef _MSC_VER
@@ -63,6 +64,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/time.hpp"
 #include "libtorrent/connection_queue.hpp"
 #include "libtorrent/intrusive_ptr_base.hpp"
+#include "libtorrent/http_connection.hpp"
+#include "libtorrent/resolver.hpp"
 
 namespace libtorrent
 {
@@ -119,9 +122,14 @@ namespace libtorrent
 			, std::string const& msg) = 0;
 		virtual void tracker_scrape_response(tracker_request const& req
 			, int complete, int incomplete, int downloads) {}
+		// peers holds the peers that were received in the
+		// non-compact form, which may have a hostname instead
+		// of an ip. endpoints holds the ones received in the
+		// compact form
 		virtual void tracker_response(
 			tracker_request const& req
 			, std::vector<peer_entry>& peers
+			, std::vector<tcp::endpoint> const& endpoints
 			, int interval
 			, int complete
 			, int incomplete
@@ -192,7 +200,7 @@ namespace libtorrent
 
 		tracker_request const& tracker_req() const { return m_req; }
 
-		void fail(int code, char const* msg);
+		virtual void fail(int code, char const* msg);
 		void fail_timeout();
 		virtual void close();
 		address const& bind_interface() const { return m_bind_interface; }
@@ -209,8 +217,10 @@ namespace libtorrent
 	{
 	public:
 
-		tracker_manager(session_settings const& s, proxy_settings const& ps)
-			: m_settings(s)
+		tracker_manager(session_settings const& s, proxy_settings const& ps
+			, resolver& r)
+			: m_host_resolver(r)
+			, m_settings(s)
 			, m_proxy(ps)
 	  		, m_abort(false) {}
 
@@ -227,6 +237,20 @@ namespace libtorrent
 		void remove_request(tracker_connection const*);
 		bool empty() const;
 		int num_requests() const;
+
+		// udp trackers hand out connection IDs that are valid
+		// for a minute. They are cached here, so that announces
+		// and scrapes to the same tracker from other torrents
+		// don't have to do the connect round-trip again
+		bool get_udp_connection_id(udp::endpoint const& ep, boost::int64_t& id);
+		void set_udp_connection_id(udp::endpoint const& ep, boost::int64_t id);
+		void forget_udp_connection_id(udp::endpoint const& ep);
+
+		// idle keep-alive connections to http trackers
+		http_connection_pool& http_pool() { return m_http_pool; }
+
+		// the session-wide caching name resolver
+		resolver& host_resolver() { return m_host_resolver; }
 		
 	private:
 
@@ -236,6 +260,18 @@ namespace libtorrent
 		typedef std::list<boost::intrusive_ptr<tracker_connection> >
 			tracker_connections_t;
 		tracker_connections_t m_connections;
+
+		struct udp_connection_id
+		{
+			boost::int64_t id;
+			ptime expires;
+		};
+		typedef std::map<udp::endpoint, udp_connection_id> udp_conn_ids_t;
+		udp_conn_ids_t m_udp_conn_ids;
+
+		http_connection_pool m_http_pool;
+
+		resolver& m_host_resolver;
 		session_settings const& m_settings;
 		proxy_settings const& m_proxy;
 		bool m_abort;
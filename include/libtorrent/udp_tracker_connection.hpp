@@ -44,6 +44,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <boost/shared_ptr.hpp>
 #include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
 
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -75,9 +76,23 @@ namespace libtorrent
 			, proxy_settings const& ps);
 
 		void close();
+		void fail(int code, char const* msg);
+
+		// adds another info-hash to this scrape request. This
+		// is only possible as long as the scrape hasn't been
+		// sent yet. Returns false if it couldn't be added
+		bool add_scrape(tracker_request const& req
+			, boost::weak_ptr<request_callback> c);
 
 	private:
 
+		enum
+		{
+			// the max number of info-hashes in a single
+			// scrape request
+			max_scrape_hashes = 74
+		};
+
 		enum action_t
 		{
 			action_connect,
@@ -89,7 +104,8 @@ namespace libtorrent
 		boost::intrusive_ptr<udp_tracker_connection> self()
 		{ return boost::intrusive_ptr<udp_tracker_connection>(this); }
 
-		void name_lookup(error_code const& error, udp::resolver::iterator i);
+		void name_lookup(error_code const& error
+			, std::vector<address> const& addresses, int port);
 		void timeout(error_code const& error);
 
 		void on_receive(error_code const& e, udp::endpoint const& ep
@@ -106,7 +122,6 @@ namespace libtorrent
 
 		tracker_manager& m_man;
 
-		udp::resolver m_name_lookup;
 		udp_socket m_socket;
 		udp::endpoint m_target;
 
@@ -116,6 +131,26 @@ namespace libtorrent
 		int m_attempts;
 
 		action_t m_state;
+
+		// true if m_connection_id was taken from the
+		// tracker_manager's cache, rather than from a
+		// connect response to this connection
+		bool m_cached_connection_id;
+
+		// set by close(). The name lookup is done by the
+		// session's shared resolver and can't be cancelled,
+		// so its handler checks this instead
+		bool m_abort;
+
+		// the info-hashes that were added to this scrape by
+		// other torrents, along with their callbacks.
+		// add_scrape() may be called from other threads, so
+		// m_extra_scrapes and the transition of m_state to
+		// action_scrape are protected by m_scrape_mutex
+		mutable boost::mutex m_scrape_mutex;
+		typedef std::vector<std::pair<tracker_request
+			, boost::weak_ptr<request_callback> > > extra_scrapes_t;
+		extra_scrapes_t m_extra_scrapes;
 	};
 
 }
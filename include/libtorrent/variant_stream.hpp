@@ -552,6 +552,14 @@ public:
         return m_variant.which() != boost::mpl::size<types>::value;
     }
 
+    // exchanges the underlying streams. Both streams
+    // must belong to the same io_service
+    void swap(variant_stream& s)
+    {
+        TORRENT_ASSERT(&m_io_service == &s.m_io_service);
+        m_variant.swap(s.m_variant);
+    }
+
     ~variant_stream()
     {
         boost::apply_visitor(aux::delete_visitor(), m_variant);
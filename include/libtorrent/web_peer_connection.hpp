@@ -71,6 +71,7 @@ POSSIBILITY OF SUCH DAMAGE.
 // parse_url
 #include "libtorrent/tracker_manager.hpp"
 #include "libtorrent/http_parser.hpp"
+#include "libtorrent/disk_buffer_holder.hpp"
 
 namespace libtorrent
 {
@@ -141,6 +142,15 @@ namespace libtorrent
 		// will be invalid.
 		boost::optional<piece_block_progress> downloading_piece_progress() const;
 
+		// adjusts the size of the HTTP requests to the
+		// download rate, called once every second
+		void on_tick();
+
+		// appends received bytes to m_piece, allocating the
+		// disk buffer if needed. Returns false if we're out
+		// of disk buffers
+		bool append_to_piece(char const* buf, int size);
+
 		// this has one entry per bittorrent request
 		std::deque<peer_request> m_requests;
 		// this has one entry per http-request
@@ -161,8 +171,12 @@ namespace libtorrent
 		bool m_first_request;
 		
 		// this is used for intermediate storage of pieces
-		// that is received in more than on HTTP responses
-		std::vector<char> m_piece;
+		// that is received in more than on HTTP responses.
+		// It's a disk buffer, so once the block is complete
+		// it's handed to the disk thread without copying it
+		disk_buffer_holder m_piece;
+		// the number of bytes in m_piece
+		int m_piece_size;
 		// the mapping of the data in the m_piece buffer
 		peer_request m_intermediate_piece;
 		
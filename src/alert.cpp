@@ -35,8 +35,6 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/alert.hpp"
 #include <boost/thread/xtime.hpp>
 
-enum { queue_size_limit = 1000 };
-
 namespace libtorrent {
 
 	alert::alert() : m_timestamp(time_now()) {}
@@ -45,15 +43,15 @@ namespace libtorrent {
 
 	alert_manager::alert_manager()
 		: m_alert_mask(alert::error_notification)
+		, m_queue_size_limit(default_queue_size_limit)
 	{}
 
 	alert_manager::~alert_manager()
 	{
-		while (!m_alerts.empty())
-		{
-			delete m_alerts.front();
-			m_alerts.pop();
-		}
+		for (std::deque<alert*>::iterator i = m_alerts.begin()
+			, end(m_alerts.end()); i != end; ++i)
+			delete *i;
+		m_alerts.clear();
 	}
 
 	alert const* alert_manager::wait_for_alert(time_duration max_wait)
@@ -84,8 +82,30 @@ namespace libtorrent {
 	{
 		boost::mutex::scoped_lock lock(m_mutex);
 
-		if (m_alerts.size() >= queue_size_limit) return;
-		m_alerts.push(alert_.clone().release());
+		// the queue is full, drop the alert before cloning it
+		if (int(m_alerts.size()) >= m_queue_size_limit) return;
+		m_alerts.push_back(alert_.clone().release());
+		m_condition.notify_all();
+	}
+
+	void alert_manager::post_alert_ptr(alert* alert_)
+	{
+		std::auto_ptr<alert> a(alert_);
+
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		if (int(m_alerts.size()) >= m_queue_size_limit) return;
+		m_alerts.push_back(a.release());
+		m_condition.notify_all();
+	}
+
+	void alert_manager::post_reply_ptr(alert* alert_)
+	{
+		std::auto_ptr<alert> a(alert_);
+
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		m_alerts.push_back(a.release());
 		m_condition.notify_all();
 	}
 
@@ -96,10 +116,29 @@ namespace libtorrent {
 		TORRENT_ASSERT(!m_alerts.empty());
 
 		alert* result = m_alerts.front();
-		m_alerts.pop();
+		m_alerts.pop_front();
 		return std::auto_ptr<alert>(result);
 	}
 
+	void alert_manager::get_all(std::vector<alert*>& alerts)
+	{
+		std::deque<alert*> tmp;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			if (m_alerts.empty()) return;
+			m_alerts.swap(tmp);
+		}
+		alerts.insert(alerts.end(), tmp.begin(), tmp.end());
+	}
+
+	int alert_manager::set_alert_queue_size_limit(int queue_size_limit_)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		std::swap(m_queue_size_limit, queue_size_limit_);
+		return queue_size_limit_;
+	}
+
 	bool alert_manager::pending() const
 	{
 		boost::mutex::scoped_lock lock(m_mutex);
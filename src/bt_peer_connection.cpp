@@ -269,6 +269,7 @@ namespace libtorrent
 		char* ptr = msg + 5;
 		detail::write_uint16(listen_port, ptr);
 		send_buffer(msg, sizeof(msg));
+		sent_message();
 	}
 
 	void bt_peer_connection::write_have_all()
@@ -284,6 +285,7 @@ namespace libtorrent
 #endif
 		char msg[] = {0,0,0,1, msg_have_all};
 		send_buffer(msg, sizeof(msg));
+		sent_message();
 	}
 
 	void bt_peer_connection::write_have_none()
@@ -299,6 +301,7 @@ namespace libtorrent
 #endif
 		char msg[] = {0,0,0,1, msg_have_none};
 		send_buffer(msg, sizeof(msg));
+		sent_message();
 	}
 
 	void bt_peer_connection::write_reject_request(peer_request const& r)
@@ -316,6 +319,7 @@ namespace libtorrent
 		detail::write_int32(r.start, ptr); // begin
 		detail::write_int32(r.length, ptr); // length
 		send_buffer(msg, sizeof(msg));
+		sent_message();
 	}
 
 	void bt_peer_connection::write_allow_fast(int piece)
@@ -330,6 +334,7 @@ namespace libtorrent
 		char* ptr = msg + 5;
 		detail::write_int32(piece, ptr);
 		send_buffer(msg, sizeof(msg));
+		sent_message();
 	}
 
 	void bt_peer_connection::get_specific_peer_info(peer_info& p) const
@@ -1373,6 +1378,7 @@ namespace libtorrent
 
 		char msg[] = {0,0,0,0};
 		send_buffer(msg, sizeof(msg));
+		sent_message();
 	}
 
 	void bt_peer_connection::write_cancel(peer_request const& r)
@@ -1388,6 +1394,7 @@ namespace libtorrent
 		detail::write_int32(r.start, ptr); // begin
 		detail::write_int32(r.length, ptr); // length
 		send_buffer(msg, sizeof(msg));
+		sent_message();
 
 		if (!m_supports_fast)
 			incoming_reject_request(r);
@@ -1407,6 +1414,7 @@ namespace libtorrent
 		detail::write_int32(r.start, ptr); // begin
 		detail::write_int32(r.length, ptr); // length
 		send_buffer(msg, sizeof(msg), message_type_request);
+		sent_message();
 	}
 
 	void bt_peer_connection::write_bitfield()
@@ -1470,6 +1478,7 @@ namespace libtorrent
 
 		detail::write_int32(packet_size - 4, i.begin);
 		detail::write_uint8(msg_bitfield, i.begin);
+		sent_message();
 
 		if (t->is_seed())
 		{
@@ -1588,6 +1597,7 @@ namespace libtorrent
 		detail::write_uint8(msg_extended, i.begin);
 		// signal handshake message
 		detail::write_uint8(0, i.begin);
+		sent_message();
 
 		std::copy(msg.begin(), msg.end(), i.begin);
 		i.begin += msg.size();
@@ -1612,6 +1622,7 @@ namespace libtorrent
 		if (is_choked()) return;
 		char msg[] = {0,0,0,1,msg_choke};
 		send_buffer(msg, sizeof(msg));
+		sent_message();
 	}
 
 	void bt_peer_connection::write_unchoke()
@@ -1622,6 +1633,7 @@ namespace libtorrent
 
 		char msg[] = {0,0,0,1,msg_unchoke};
 		send_buffer(msg, sizeof(msg));
+		sent_message();
 	}
 
 	void bt_peer_connection::write_interested()
@@ -1632,6 +1644,7 @@ namespace libtorrent
 
 		char msg[] = {0,0,0,1,msg_interested};
 		send_buffer(msg, sizeof(msg));
+		sent_message();
 	}
 
 	void bt_peer_connection::write_not_interested()
@@ -1642,6 +1655,7 @@ namespace libtorrent
 
 		char msg[] = {0,0,0,1,msg_not_interested};
 		send_buffer(msg, sizeof(msg));
+		sent_message();
 	}
 
 	void bt_peer_connection::write_have(int index)
@@ -1656,6 +1670,7 @@ namespace libtorrent
 		char* ptr = msg + 5;
 		detail::write_int32(index, ptr);
 		send_buffer(msg, sizeof(msg));
+		sent_message();
 	}
 
 	void bt_peer_connection::write_piece(peer_request const& r, disk_buffer_holder& buffer)
@@ -1675,6 +1690,7 @@ namespace libtorrent
 		detail::write_int32(r.piece, ptr);
 		detail::write_int32(r.start, ptr);
 		send_buffer(msg, sizeof(msg));
+		sent_message();
 
 		append_send_buffer(buffer.get(), r.length
 			, boost::bind(&session_impl::free_disk_buffer
@@ -2539,6 +2555,7 @@ namespace libtorrent
 					
 			if (packet_size == 0)
 			{
+				m_ses.m_received_messages.add(1);
 				incoming_keepalive();
 				if (is_disconnecting()) return;
 				// keepalive message
@@ -2564,6 +2581,7 @@ namespace libtorrent
 			if (!t) return;
 			if (dispatch_message(bytes_transferred))
 			{
+				m_ses.m_received_messages.add(1);
 				m_state = read_packet_size;
 				reset_recv_buffer(5);
 			}
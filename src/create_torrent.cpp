@@ -182,7 +182,7 @@ namespace libtorrent
 
 		if (!m_multifile)
 		{
-			info["length"] = m_files.at(0).size;
+			info["length"] = m_files.file_size(0);
 		}
 		else
 		{
@@ -197,16 +197,17 @@ namespace libtorrent
 					entry& file_e = files.list().back();
 					file_e["length"] = i->size;
 					entry& path_e = file_e["path"];
+					fs::path file_path = m_files.file_path(*i);
 
 #if BOOST_VERSION < 103600
-					TORRENT_ASSERT(i->path.has_branch_path());
+					TORRENT_ASSERT(file_path.has_branch_path());
 #else
-					TORRENT_ASSERT(i->path.has_parent_path());
+					TORRENT_ASSERT(file_path.has_parent_path());
 #endif
-					TORRENT_ASSERT(*i->path.begin() == m_files.name());
+					TORRENT_ASSERT(*file_path.begin() == m_files.name());
 
-					for (fs::path::iterator j = boost::next(i->path.begin());
-						j != i->path.end(); ++j)
+					for (fs::path::iterator j = boost::next(file_path.begin());
+						j != file_path.end(); ++j)
 					{
 						path_e.list().push_back(entry(*j));
 					}
@@ -34,7 +34,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <deque>
 #include "libtorrent/disk_io_thread.hpp"
 #include "libtorrent/disk_buffer_holder.hpp"
-#include <boost/scoped_array.hpp>
+#include "libtorrent/allocator.hpp"
+#include <boost/thread/xtime.hpp>
 
 #ifdef _WIN32
 #include <malloc.h>
@@ -305,8 +306,10 @@ namespace libtorrent
 		m_log << log_time() << " flushing " << piece_size << std::endl;
 #endif
 		TORRENT_ASSERT(piece_size > 0);
-		boost::scoped_array<char> buf;
-		if (m_coalesce_writes) buf.reset(new (std::nothrow) char[piece_size]);
+		// the buffer is page aligned, to let it be written with O_DIRECT
+		boost::shared_array<char> buf;
+		if (m_coalesce_writes) buf.reset(page_aligned_allocator::malloc(piece_size)
+			, &page_aligned_allocator::free);
 		
 		int blocks_in_piece = (piece_size + m_block_size - 1) / m_block_size;
 		int buffer_size = 0;
@@ -412,8 +415,9 @@ namespace libtorrent
 		int buffer_size = piece_size - (end_block - 1) * m_block_size + (end_block - start_block - 1) * m_block_size;
 		TORRENT_ASSERT(buffer_size <= piece_size);
 		TORRENT_ASSERT(buffer_size + start_block * m_block_size <= piece_size);
-		boost::scoped_array<char> buf;
-		if (m_coalesce_reads) buf.reset(new (std::nothrow) char[buffer_size]);
+		boost::shared_array<char> buf;
+		if (m_coalesce_reads) buf.reset(page_aligned_allocator::malloc(buffer_size)
+			, &page_aligned_allocator::free);
 		int ret = 0;
 		if (buf)
 		{
@@ -717,7 +721,7 @@ namespace libtorrent
 		++m_allocations;
 #endif
 #ifdef TORRENT_DISABLE_POOL_ALLOCATOR
-		return (char*)malloc(m_block_size);
+		return page_aligned_allocator::malloc(m_block_size);
 #else
 		return (char*)m_pool.ordered_malloc();
 #endif
@@ -730,7 +734,7 @@ namespace libtorrent
 		--m_allocations;
 #endif
 #ifdef TORRENT_DISABLE_POOL_ALLOCATOR
-		free(buf);
+		page_aligned_allocator::free(buf);
 #else
 		m_pool.ordered_free(buf);
 #endif
@@ -753,6 +757,26 @@ namespace libtorrent
 		return false;
 	}
 
+	void disk_io_thread::defrag_step()
+	{
+		TORRENT_ASSERT(!m_defrag_queue.empty());
+		boost::intrusive_ptr<piece_manager> s = m_defrag_queue.front();
+		m_defrag_queue.pop_front();
+#ifdef TORRENT_DISK_STATS
+		m_log << log_time() << " defrag" << std::endl;
+#endif
+#ifndef BOOST_NO_EXCEPTIONS
+		try {
+#endif
+			// take turns between the storages. Any disk error
+			// is left on the storage and is reported by its
+			// next job
+			if (s->defrag_impl() > 0) m_defrag_queue.push_back(s);
+#ifndef BOOST_NO_EXCEPTIONS
+		} catch (std::exception&) {}
+#endif
+	}
+
 	void disk_io_thread::operator()()
 	{
 		for (;;)
@@ -763,10 +787,34 @@ namespace libtorrent
 			mutex_t::scoped_lock jl(m_queue_mutex);
 
 			while (m_jobs.empty() && !m_abort)
-				m_signal.wait(jl);
+			{
+				if (m_defrag_queue.empty())
+				{
+					m_signal.wait(jl);
+					continue;
+				}
+
+				// move one piece every time the disk has been
+				// idle for 100 milliseconds
+				boost::xtime xt;
+				boost::xtime_get(&xt, boost::TIME_UTC);
+				boost::int64_t nsec = xt.nsec + 100000000;
+				if (nsec >= 1000000000)
+				{
+					nsec -= 1000000000;
+					xt.sec += 1;
+				}
+				xt.nsec = boost::xtime::xtime_nsec_t(nsec);
+				if (m_signal.timed_wait(jl, xt)) continue;
+				if (!m_jobs.empty() || m_abort) break;
+				jl.unlock();
+				defrag_step();
+				jl.lock();
+			}
 			if (m_abort && m_jobs.empty())
 			{
 				jl.unlock();
+				m_defrag_queue.clear();
 
 				mutex_t::scoped_lock l(m_piece_mutex);
 				// flush all disk caches
@@ -1000,6 +1048,7 @@ namespace libtorrent
 						m_pool.release_memory();
 					}
 #endif
+					m_defrag_queue.remove(j.storage);
 					ret = j.storage->release_files_impl();
 					if (ret != 0) test_error(j);
 					break;
@@ -1069,6 +1118,7 @@ namespace libtorrent
 						m_pool.release_memory();
 					}
 #endif
+					m_defrag_queue.remove(j.storage);
 					ret = j.storage->delete_files_impl();
 					if (ret != 0) test_error(j);
 					break;
@@ -1135,6 +1185,16 @@ namespace libtorrent
 					m_log << log_time() << " rename file" << std::endl;
 #endif
 					ret = j.storage->rename_file_impl(j.piece, j.str);
+					break;
+				}
+				case disk_io_job::allocate:
+				{
+#ifdef TORRENT_DISK_STATS
+					m_log << log_time() << " allocate" << std::endl;
+#endif
+					ret = j.storage->allocate_impl(j.piece);
+					if (ret == piece_manager::fatal_disk_error) test_error(j);
+					break;
 				}
 			}
 #ifndef BOOST_NO_EXCEPTIONS
@@ -1149,6 +1209,15 @@ namespace libtorrent
 			}
 #endif
 
+			// pieces this storage wrote out of place are
+			// moved into their slots once the disk is idle
+			if (j.storage && j.storage->m_need_defrag
+				&& j.action != disk_io_job::release_files
+				&& j.action != disk_io_job::delete_files
+				&& std::find(m_defrag_queue.begin(), m_defrag_queue.end()
+					, j.storage) == m_defrag_queue.end())
+				m_defrag_queue.push_back(j.storage);
+
 //			if (!handler) std::cerr << "DISK THREAD: no callback specified" << std::endl;
 //			else std::cerr << "DISK THREAD: invoking callback" << std::endl;
 #ifndef BOOST_NO_EXCEPTIONS
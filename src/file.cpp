@@ -63,6 +63,7 @@ BOOST_STATIC_ASSERT(sizeof(lseek(0, 0, 0)) >= 8);
 
 #include <boost/filesystem/operations.hpp>
 #include "libtorrent/file.hpp"
+#include "libtorrent/allocator.hpp"
 #include <sstream>
 #include <cstring>
 #include <vector>
@@ -106,7 +107,7 @@ namespace
 	}
 #else
 
-	enum { mode_in = 1, mode_out = 2 };
+	enum { mode_in = 1, mode_out = 2, mode_no_buffer = 4 };
 
 	mode_t map_open_mode(int m)
 	{
@@ -127,11 +128,15 @@ namespace libtorrent
 #ifdef TORRENT_WINDOWS
 	const file::open_mode file::in(GENERIC_READ);
 	const file::open_mode file::out(GENERIC_WRITE);
+	// FILE_FLAG_NO_BUFFERING can't be turned off for unaligned
+	// reads and writes, so this is ignored on windows
+	const file::open_mode file::no_buffer(1);
 	const file::seek_mode file::begin(FILE_BEGIN);
 	const file::seek_mode file::end(FILE_END);
 #else
 	const file::open_mode file::in(mode_in);
 	const file::open_mode file::out(mode_out);
+	const file::open_mode file::no_buffer(mode_no_buffer);
 	const file::seek_mode file::begin(SEEK_SET);
 	const file::seek_mode file::end(SEEK_END);
 #endif
@@ -141,6 +146,8 @@ namespace libtorrent
 		: m_file_handle(INVALID_HANDLE_VALUE)
 #else
 		: m_fd(-1)
+		, m_no_buffer(false)
+		, m_direct_io(false)
 #endif
 #ifndef NDEBUG
 		, m_open_mode(0)
@@ -152,6 +159,8 @@ namespace libtorrent
 		: m_file_handle(INVALID_HANDLE_VALUE)
 #else
 		: m_fd(-1)
+		, m_no_buffer(false)
+		, m_direct_io(false)
 #endif
 #ifndef NDEBUG
 		, m_open_mode(0)
@@ -178,7 +187,7 @@ namespace libtorrent
 
 		m_file_handle = CreateFile(
 			file_path.c_str()
-			, mode.m_mask
+			, mode.m_mask & (GENERIC_READ | GENERIC_WRITE)
 			, FILE_SHARE_READ
 			, 0
 			, (mode & out)?OPEN_ALWAYS:OPEN_EXISTING
@@ -206,13 +215,26 @@ namespace libtorrent
 			| S_IROTH | S_IWOTH;
 
 		m_fd = ::open(path.native_file_string().c_str()
-			, map_open_mode(mode.m_mask), permissions);
+			, map_open_mode(mode.m_mask & (mode_in | mode_out)), permissions);
 
 		if (m_fd == -1)
 		{
 			ec = error_code(errno, get_posix_category());
 			return false;
 		}
+
+		m_direct_io = false;
+		m_no_buffer = false;
+		if (mode & no_buffer)
+		{
+#if defined O_DIRECT
+			// O_DIRECT is set for each read and write that's aligned
+			m_no_buffer = true;
+#elif defined F_NOCACHE
+			// F_NOCACHE doesn't have any alignment requirements
+			fcntl(m_fd, F_NOCACHE, 1);
+#endif
+		}
 #endif
 #ifndef NDEBUG
 		m_open_mode = mode;
@@ -266,7 +288,16 @@ namespace libtorrent
 			}
 		}
 #else
+		if (m_no_buffer) update_direct_io(buf, num_bytes);
 		size_type ret = ::read(m_fd, buf, num_bytes);
+		if (ret == -1 && errno == EINVAL && m_direct_io)
+		{
+			// the device requires a larger alignment,
+			// don't try to bypass the page cache again
+			m_no_buffer = false;
+			update_direct_io(buf, num_bytes);
+			ret = ::read(m_fd, buf, num_bytes);
+		}
 		if (ret == -1) ec = error_code(errno, get_posix_category());
 #endif
 		return ret;
@@ -291,12 +322,57 @@ namespace libtorrent
 			}
 		}
 #else
+		if (m_no_buffer) update_direct_io(buf, num_bytes);
 		size_type ret = ::write(m_fd, buf, num_bytes);
+		if (ret == -1 && errno == EINVAL && m_direct_io)
+		{
+			// the device requires a larger alignment,
+			// don't try to bypass the page cache again
+			m_no_buffer = false;
+			update_direct_io(buf, num_bytes);
+			ret = ::write(m_fd, buf, num_bytes);
+		}
 		if (ret == -1) ec = error_code(errno, get_posix_category());
 #endif
 		return ret;
 	}
 
+	bool file::direct_io() const
+	{
+#ifdef TORRENT_WINDOWS
+		return false;
+#else
+		return m_direct_io;
+#endif
+	}
+
+	void file::update_direct_io(char const* buf, size_type num_bytes)
+	{
+#if !defined TORRENT_WINDOWS && defined O_DIRECT
+		bool direct = false;
+		if (m_no_buffer)
+		{
+			// O_DIRECT requires the buffer, the file offset and
+			// the size to be aligned. Anything else, like the end
+			// of a file, goes through the page cache
+			size_type mask = page_size() - 1;
+			size_type pos = lseek(m_fd, 0, SEEK_CUR);
+			direct = pos >= 0 && ((size_type(std::size_t(buf)) | pos | num_bytes) & mask) == 0;
+		}
+		if (direct == m_direct_io) return;
+
+		int flags = fcntl(m_fd, F_GETFL);
+		if (flags == -1 || fcntl(m_fd, F_SETFL
+			, direct ? (flags | O_DIRECT) : (flags & ~O_DIRECT)) == -1)
+		{
+			// the filesystem doesn't support O_DIRECT
+			if (direct) m_no_buffer = false;
+			return;
+		}
+		m_direct_io = direct;
+#endif
+	}
+
   	bool file::set_size(size_type s, error_code& ec)
   	{
   		TORRENT_ASSERT(is_open());
@@ -322,6 +398,30 @@ namespace libtorrent
 		return true;
 	}
 
+	bool file::allocate(size_type offset, size_type len, error_code& ec)
+	{
+		TORRENT_ASSERT(is_open());
+		TORRENT_ASSERT(offset >= 0);
+		TORRENT_ASSERT(len >= 0);
+
+#if defined TORRENT_LINUX && defined FALLOC_FL_KEEP_SIZE
+		// the size of the file is set by set_size(), this
+		// just makes sure there are blocks backing it
+		if (fallocate(m_fd, FALLOC_FL_KEEP_SIZE, offset, len) < 0)
+		{
+			// ENOSYS is returned by kernels without fallocate
+			if (errno != EOPNOTSUPP && errno != ENOSYS)
+				ec = error_code(errno, get_posix_category());
+			return false;
+		}
+		return true;
+#else
+		// posix_fallocate() would fall back to writing to the
+		// file, which is what we want to avoid
+		return false;
+#endif
+	}
+
 	size_type file::seek(size_type offset, seek_mode m, error_code& ec)
 	{
 		TORRENT_ASSERT(is_open());
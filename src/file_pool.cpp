@@ -68,6 +68,7 @@ namespace libtorrent
 			}
 
 			e.key = st;
+			if (m_no_buffer) m |= file::no_buffer;
 			if ((e.mode & m) != m)
 			{
 				// close the file before we open it with
@@ -105,6 +106,7 @@ namespace libtorrent
 			ec = error_code(ENOMEM, get_posix_category());
 			return e.file_ptr;
 		}
+		if (m_no_buffer) m |= file::no_buffer;
 		if (!e.file_ptr->open(p, m, ec))
 			return boost::shared_ptr<file>();
 		e.mode = m;
@@ -34,11 +34,15 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/file_storage.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 
 namespace libtorrent
 {
 	file_storage::file_storage()
 		: m_piece_length(0)
+		, m_name_pool_waste(0)
 		, m_total_size(0)
 		, m_num_pieces(0)
 	{}
@@ -58,21 +62,151 @@ namespace libtorrent
 			return piece_length();
 	}
 
+	namespace
+	{
+		fs::path branch_path(fs::path const& p)
+		{
+#if BOOST_VERSION < 103600
+			return p.branch_path();
+#else
+			return p.parent_path();
+#endif
+		}
+
+		std::string leaf(fs::path const& p)
+		{
+#if BOOST_VERSION < 103600
+			return p.leaf();
+#else
+			return p.filename();
+#endif
+		}
+	}
+
+	void file_storage::set_file_path(internal_file_entry& e, fs::path const& p)
+	{
+		std::string name = leaf(p);
+		e.name_offset = boost::uint32_t(m_name_pool.size());
+		m_name_pool.append(name.c_str(), name.size() + 1);
+
+		std::string dir = branch_path(p).string();
+		if (dir.empty())
+		{
+			e.path_index = -1;
+			return;
+		}
+		// files are usually listed directory by directory,
+		// so it's enough to compare against the last one
+		if (m_paths.empty() || m_paths.back() != dir)
+			m_paths.push_back(dir);
+		e.path_index = int(m_paths.size()) - 1;
+	}
+
+	fs::path file_storage::file_path(internal_file_entry const& fe) const
+	{
+		if (fe.path_index == -1) return fs::path(file_name(fe));
+		TORRENT_ASSERT(fe.path_index >= 0 && fe.path_index < int(m_paths.size()));
+		return fs::path(m_paths[fe.path_index]) / file_name(fe);
+	}
+
+	file_entry file_storage::at(int index) const
+	{
+		internal_file_entry const& fe = internal_at(index);
+		file_entry ret;
+		ret.path = file_path(fe);
+		ret.offset = fe.offset;
+		ret.size = fe.size;
+		ret.file_base = fe.file_base;
+		return ret;
+	}
+
+	size_type file_storage::memory_usage() const
+	{
+		size_type ret = m_files.capacity() * sizeof(internal_file_entry)
+			+ m_name_pool.capacity()
+			+ m_paths.capacity() * sizeof(std::string)
+			+ m_name.capacity();
+		for (std::vector<std::string>::const_iterator i = m_paths.begin()
+			, end(m_paths.end()); i != end; ++i)
+			ret += i->capacity();
+		return ret;
+	}
+
 	void file_storage::rename_file(int index, std::string const& new_filename)
 	{
 		TORRENT_ASSERT(index >= 0 && index < int(m_files.size()));
-		m_files[index].path = new_filename;
+		internal_file_entry& e = m_files[index];
+		fs::path p(new_filename);
+		std::string name = leaf(p);
+		int old_size = int(std::strlen(file_name(e)));
+
+		if (int(name.size()) <= old_size)
+		{
+			// the new name fits where the old one was
+			std::memcpy(&m_name_pool[e.name_offset], name.c_str(), name.size() + 1);
+			m_name_pool_waste += old_size - int(name.size());
+		}
+		else
+		{
+			m_name_pool_waste += old_size + 1;
+			e.name_offset = boost::uint32_t(m_name_pool.size());
+			m_name_pool.append(name.c_str(), name.size() + 1);
+		}
+
+		std::string dir = branch_path(p).string();
+		if (dir.empty())
+		{
+			e.path_index = -1;
+		}
+		else
+		{
+			// renamed files may end up in any directory, look
+			// for it among all of them to not add duplicates
+			std::vector<std::string>::iterator i
+				= std::find(m_paths.begin(), m_paths.end(), dir);
+			if (i == m_paths.end()) i = m_paths.insert(i, dir);
+			e.path_index = int(i - m_paths.begin());
+		}
+
+		if (m_name_pool_waste > int(m_name_pool.size()) / 2)
+			compact_name_pool();
 	}
 
-	file_storage::iterator file_storage::file_at_offset(size_type offset) const
+	void file_storage::compact_name_pool()
+	{
+		std::string pool;
+		pool.reserve(m_name_pool.size() - m_name_pool_waste);
+		for (std::vector<internal_file_entry>::iterator i = m_files.begin()
+			, end(m_files.end()); i != end; ++i)
+		{
+			char const* name = file_name(*i);
+			i->name_offset = boost::uint32_t(pool.size());
+			pool.append(name, std::strlen(name) + 1);
+		}
+		m_name_pool.swap(pool);
+		m_name_pool_waste = 0;
+	}
+
+	namespace
 	{
-		// TODO: do a binary search
-		std::vector<file_entry>::const_iterator i;
-		for (i = begin(); i != end(); ++i)
+		bool compare_file_offset(size_type offset, internal_file_entry const& fe)
 		{
-			if (i->offset <= offset && i->offset + i->size > offset)
-				return i;
+			return offset < fe.offset;
 		}
+	}
+
+	file_storage::iterator file_storage::file_at_offset(size_type offset) const
+	{
+		if (offset < 0 || offset >= m_total_size) return end();
+
+		// the files are sorted by offset. Find the first file
+		// starting after the offset, the one before it is the
+		// file containing it. Empty files share their offset with
+		// the next file, so this will never land on one of them
+		iterator i = std::upper_bound(begin(), end(), offset, &compare_file_offset);
+		TORRENT_ASSERT(i != begin());
+		--i;
+		TORRENT_ASSERT(i->offset <= offset && i->offset + i->size > offset);
 		return i;
 	}
 
@@ -87,12 +221,12 @@ namespace libtorrent
 		TORRENT_ASSERT(start + size <= m_total_size);
 
 		// find the file iterator and file offset
-		// TODO: do a binary search on the file offsets
-		size_type file_offset = start;
-		std::vector<file_entry>::const_iterator file_iter;
+		iterator file_iter = file_at_offset(start);
+		TORRENT_ASSERT(file_iter != end());
+		size_type file_offset = start - file_iter->offset;
 
-		int counter = 0;
-		for (file_iter = begin();; ++counter, ++file_iter)
+		int counter = file_iter - begin();
+		for (;; ++counter, ++file_iter)
 		{
 			TORRENT_ASSERT(file_iter != end());
 			if (file_offset < file_iter->size)
@@ -119,7 +253,7 @@ namespace libtorrent
 	{
 		TORRENT_ASSERT(file_index < num_files());
 		TORRENT_ASSERT(file_index >= 0);
-		size_type offset = file_offset + at(file_index).offset;
+		size_type offset = file_offset + internal_at(file_index).offset;
 
 		peer_request ret;
 		ret.piece = int(offset / piece_length());
@@ -150,11 +284,11 @@ namespace libtorrent
 				m_name = *file.begin();
 		}
 		TORRENT_ASSERT(m_name == *file.begin());
-		file_entry e;
-		m_files.push_back(e);
-		m_files.back().size = size;
-		m_files.back().path = file;
-		m_files.back().offset = m_total_size;
+		m_files.push_back(internal_file_entry());
+		internal_file_entry& e = m_files.back();
+		e.size = size;
+		e.offset = m_total_size;
+		set_file_path(e, file);
 		m_total_size += size;
 	}
 
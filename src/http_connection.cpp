@@ -42,13 +42,91 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <boost/lexical_cast.hpp>
 #include <string>
 #include <algorithm>
+#include <cctype>
+#include <cstdlib>
 
 using boost::bind;
 
+namespace
+{
+	char to_lower(char c) { return std::tolower(c); }
+}
+
 namespace libtorrent {
 
 enum { max_bottled_buffer = 1024 * 1024 };
 
+boost::shared_ptr<socket_type> http_connection_pool::take(std::string const& hostname
+	, std::string const& port)
+{
+	mutex_t::scoped_lock l(m_mutex);
+	expire(time_now());
+
+	std::string key = hostname + ":" + port;
+	// take the one that's been idle the shortest time, it's
+	// the least likely to have been closed by the server
+	for (std::list<idle_connection>::reverse_iterator i = m_idle.rbegin()
+		, end(m_idle.rend()); i != end; ++i)
+	{
+		if (i->key != key) continue;
+		boost::shared_ptr<socket_type> ret = i->sock;
+		m_idle.erase(--i.base());
+		if (!ret->is_open()) continue;
+		return ret;
+	}
+	return boost::shared_ptr<socket_type>();
+}
+
+void http_connection_pool::put(std::string const& hostname, std::string const& port
+	, boost::shared_ptr<socket_type> s)
+{
+	TORRENT_ASSERT(s);
+	mutex_t::scoped_lock l(m_mutex);
+	ptime now = time_now();
+	expire(now);
+
+	idle_connection c;
+	c.key = hostname + ":" + port;
+	c.sock = s;
+	c.idle_since = now;
+	m_idle.push_back(c);
+
+	while (int(m_idle.size()) > m_max_idle)
+	{
+		error_code ec;
+		m_idle.front().sock->close(ec);
+		m_idle.pop_front();
+	}
+}
+
+void http_connection_pool::expire(ptime now)
+{
+	while (!m_idle.empty() && m_idle.front().idle_since + m_idle_timeout < now)
+	{
+		error_code ec;
+		m_idle.front().sock->close(ec);
+		m_idle.pop_front();
+	}
+}
+
+void http_connection_pool::clear()
+{
+	mutex_t::scoped_lock l(m_mutex);
+	for (std::list<idle_connection>::iterator i = m_idle.begin()
+		, end(m_idle.end()); i != end; ++i)
+	{
+		error_code ec;
+		i->sock->close(ec);
+	}
+	m_idle.clear();
+}
+
+int http_connection_pool::num_idle() const
+{
+	mutex_t::scoped_lock l(m_mutex);
+	return m_idle.size();
+}
+
 
 void http_connection::get(std::string const& url, time_duration timeout, int prio
 	, proxy_settings const* ps, int handle_redirects, std::string const& user_agent
@@ -83,6 +161,7 @@ void http_connection::get(std::string const& url, time_duration timeout, int pri
 #endif
 	
 	std::stringstream headers;
+	bool keep_alive = false;
 	if (ps && (ps->type == proxy_settings::http
 		|| ps->type == proxy_settings::http_pw)
 		&& !ssl)
@@ -97,6 +176,15 @@ void http_connection::get(std::string const& url, time_duration timeout, int pri
 		port = ps->port;
 		ps = 0;
 	}
+	else if (m_pool && !ssl && (ps == 0 || ps->type == proxy_settings::none))
+	{
+		// ask the server to keep the connection open, so it
+		// can be put back in the pool once we're done with it
+		headers << "GET " << path << " HTTP/1.0\r\n"
+			"Host:" << hostname << "\r\n"
+			"Connection: keep-alive\r\n";
+		keep_alive = true;
+	}
 	else
 	{
 		headers << "GET " << path << " HTTP/1.0\r\n"
@@ -109,8 +197,9 @@ void http_connection::get(std::string const& url, time_duration timeout, int pri
 	if (!user_agent.empty())
 		headers << "User-Agent: " << user_agent << "\r\n";
 	
+	if (!keep_alive)
+		headers << "Connection: close\r\n";
 	headers <<
-		"Connection: close\r\n"
 		"Accept-Encoding: gzip\r\n"
 		"\r\n";
 
@@ -146,12 +235,39 @@ void http_connection::start(std::string const& hostname, std::string const& port
 		return;
 	}
 
+	boost::shared_ptr<socket_type> pooled;
+	if (m_pool && !ssl && m_proxy.type == proxy_settings::none
+		&& bind_addr == address_v4::any()
+		&& !(m_sock.is_open() && m_hostname == hostname && m_port == port))
+		pooled = m_pool->take(hostname, port);
+
 	if (m_sock.is_open() && m_hostname == hostname && m_port == port
 		&& m_ssl == ssl && m_bind_addr == bind_addr)
 	{
 		async_write(m_sock, asio::buffer(sendbuffer)
 			, bind(&http_connection::on_write, shared_from_this(), _1));
 	}
+	else if (pooled)
+	{
+		// we have an idle connection to this host already,
+		// send the request over it
+		m_ssl = ssl;
+		m_bind_addr = bind_addr;
+		error_code ec;
+		m_sock.close(ec);
+#ifdef TORRENT_USE_OPENSSL
+		m_sock.instantiate<socket_type>(m_resolver.get_io_service());
+		m_sock.get<socket_type>().swap(*pooled);
+#else
+		m_sock.swap(*pooled);
+#endif
+		m_hostname = hostname;
+		m_port = port;
+		m_reused = true;
+		m_last_receive = time_now();
+		async_write(m_sock, asio::buffer(sendbuffer)
+			, bind(&http_connection::on_write, shared_from_this(), _1));
+	}
 	else
 	{
 		m_ssl = ssl;
@@ -189,11 +305,19 @@ void http_connection::start(std::string const& hostname, std::string const& port
 			}
 		}
 
-		tcp::resolver::query query(hostname, port);
-		m_resolver.async_resolve(query, bind(&http_connection::on_resolve
-			, shared_from_this(), _1, _2));
 		m_hostname = hostname;
 		m_port = port;
+		if (m_host_resolver)
+		{
+			m_host_resolver->async_resolve(hostname, bind(&http_connection::on_name_lookup
+				, shared_from_this(), _1, _2));
+		}
+		else
+		{
+			tcp::resolver::query query(hostname, port);
+			m_resolver.async_resolve(query, bind(&http_connection::on_resolve
+				, shared_from_this(), _1, _2));
+		}
 	}
 }
 
@@ -271,6 +395,34 @@ void http_connection::on_resolve(error_code const& e
 	std::transform(i, tcp::resolver::iterator(), std::back_inserter(m_endpoints)
 		, boost::bind(&tcp::resolver::iterator::value_type::endpoint, _1));
 
+	sort_endpoints();
+	queue_connect();
+}
+
+void http_connection::on_name_lookup(error_code const& e
+	, std::vector<address> const& addresses)
+{
+	// the shared resolver can't be cancelled by close()
+	if (m_abort) return;
+	if (e)
+	{
+		callback(e);
+		close();
+		return;
+	}
+	TORRENT_ASSERT(!addresses.empty());
+
+	int port = atoi(m_port.c_str());
+	for (std::vector<address>::const_iterator i = addresses.begin()
+		, end(addresses.end()); i != end; ++i)
+		m_endpoints.push_back(tcp::endpoint(*i, port));
+
+	sort_endpoints();
+	queue_connect();
+}
+
+void http_connection::sort_endpoints()
+{
 	// The following statement causes msvc to crash (ICE). Since it's not
 	// necessary in the vast majority of cases, just ignore the endpoint
 	// order for windows
@@ -281,8 +433,6 @@ void http_connection::on_resolve(error_code const& e
 	std::partition(m_endpoints.begin(), m_endpoints.end()
 		, boost::bind(&address::is_v4, boost::bind(&tcp::endpoint::address, _1)) == m_bind_addr.is_v4());
 #endif
-
-	queue_connect();
 }
 
 void http_connection::queue_connect()
@@ -358,16 +508,70 @@ void http_connection::callback(error_code const& e, char const* data, int size)
 	}
 }
 
+bool http_connection::can_keep_alive() const
+{
+	if (m_pool == 0 || m_ssl || m_proxy.type != proxy_settings::none
+		|| m_bind_addr != address_v4::any())
+		return false;
+	// the response must have ended exactly where the
+	// received data ends, and the server must have agreed
+	// to keep the connection open
+	if (!m_parser.finished()
+		|| m_read_pos != m_parser.body_start() + m_parser.content_length())
+		return false;
+	std::string connection = m_parser.header("connection");
+	std::transform(connection.begin(), connection.end(), connection.begin(), &to_lower);
+	return connection == "keep-alive";
+}
+
+void http_connection::release_to_pool()
+{
+	TORRENT_ASSERT(m_pool);
+	boost::shared_ptr<socket_type> s(new socket_type(m_resolver.get_io_service()));
+#ifdef TORRENT_USE_OPENSSL
+	s->swap(m_sock.get<socket_type>());
+#else
+	s->swap(m_sock);
+#endif
+	m_pool->put(m_hostname, m_port, s);
+	m_hostname.clear();
+	m_port.clear();
+}
+
+void http_connection::reconnect()
+{
+	TORRENT_ASSERT(m_reused);
+	m_reused = false;
+	error_code ec;
+	m_sock.close(ec);
+	std::string hostname;
+	std::string port;
+	hostname.swap(m_hostname);
+	port.swap(m_port);
+	m_endpoints.clear();
+	proxy_settings ps = m_proxy;
+	start(hostname, port, m_timeout, m_priority, &ps, m_ssl
+		, m_redirects, m_bind_addr);
+}
+
 void http_connection::on_write(error_code const& e)
 {
 	if (e)
 	{
+		if (m_reused && !m_abort)
+		{
+			reconnect();
+			return;
+		}
 		callback(e);
 		close();
 		return;
 	}
 
-	std::string().swap(sendbuffer);
+	// if this connection came from the pool, hold on to the
+	// request until we know the server is still there, in case
+	// we need to send it again
+	if (!m_reused) std::string().swap(sendbuffer);
 	m_recvbuffer.resize(4096);
 
 	int amount_to_read = m_recvbuffer.size() - m_read_pos;
@@ -396,6 +600,20 @@ void http_connection::on_read(error_code const& e
 		TORRENT_ASSERT(m_download_quota >= 0);
 	}
 
+	if (e && m_reused && m_read_pos == 0 && !m_abort)
+	{
+		// the server closed the idle connection before
+		// it got our request
+		reconnect();
+		return;
+	}
+
+	if (m_reused && bytes_transferred > 0)
+	{
+		m_reused = false;
+		std::string().swap(sendbuffer);
+	}
+
 	if (e == asio::error::eof)
 	{
 		TORRENT_ASSERT(bytes_transferred == 0);
@@ -500,7 +718,13 @@ void http_connection::on_read(error_code const& e
 		{
 			error_code ec;
 			m_timer.cancel(ec);
+			// if the connection can be reused, hand it to the
+			// pool before calling the handler, since it may
+			// close this connection
+			bool keep_alive = can_keep_alive();
+			if (keep_alive) release_to_pool();
 			callback(e, m_parser.get_body().begin, m_parser.get_body().left());
+			if (keep_alive) return;
 		}
 	}
 	else
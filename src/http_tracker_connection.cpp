@@ -55,8 +55,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/tracker_manager.hpp"
 #include "libtorrent/http_tracker_connection.hpp"
 #include "libtorrent/http_connection.hpp"
-#include "libtorrent/entry.hpp"
-#include "libtorrent/bencode.hpp"
+#include "libtorrent/lazy_entry.hpp"
 #include "libtorrent/torrent.hpp"
 #include "libtorrent/io.hpp"
 #include "libtorrent/socket.hpp"
@@ -165,7 +164,8 @@ namespace libtorrent
 		}
 
 		m_tracker_connection.reset(new http_connection(ios, cc
-			, boost::bind(&http_tracker_connection::on_response, self(), _1, _2, _3, _4)));
+			, boost::bind(&http_tracker_connection::on_response, self(), _1, _2, _3, _4)
+			, true, http_connect_handler(), &man.http_pool(), &man.host_resolver()));
 
 		int timeout = req.event==tracker_request::stopped
 			?stn.stop_tracker_timeout
@@ -225,10 +225,10 @@ namespace libtorrent
 		}
 		
 		// handle tracker response
-		entry e;
-		e = bdecode(data, data + size);
+		lazy_entry e;
+		int ret = lazy_bdecode(data, data + size, e);
 
-		if (e.type() != entry::undefined_t)
+		if (ret == 0 && e.type() == lazy_entry::dict_t)
 		{
 			parse(parser.status_code(), e);
 		}
@@ -246,23 +246,23 @@ namespace libtorrent
 		close();
 	}
 
-	bool http_tracker_connection::extract_peer_info(const entry& info, peer_entry& ret)
+	bool http_tracker_connection::extract_peer_info(lazy_entry const& info, peer_entry& ret)
 	{
 		// extract peer id (if any)
-		if (info.type() != entry::dictionary_t)
+		if (info.type() != lazy_entry::dict_t)
 		{
 			fail(-1, "invalid response from tracker (invalid peer entry)");
 			return false;
 		}
-		entry const* i = info.find_key("peer id");
+		lazy_entry const* i = info.dict_find("peer id");
 		if (i != 0)
 		{
-			if (i->type() != entry::string_t || i->string().length() != 20)
+			if (i->type() != lazy_entry::string_t || i->string_length() != 20)
 			{
 				fail(-1, "invalid response from tracker (invalid peer id)");
 				return false;
 			}
-			std::copy(i->string().begin(), i->string().end(), ret.pid.begin());
+			std::copy(i->string_ptr(), i->string_ptr() + 20, ret.pid.begin());
 		}
 		else
 		{
@@ -271,116 +271,122 @@ namespace libtorrent
 		}
 
 		// extract ip
-		i = info.find_key("ip");
-		if (i == 0 || i->type() != entry::string_t)
+		i = info.dict_find_string("ip");
+		if (i == 0)
 		{
 			fail(-1, "invalid response from tracker");
 			return false;
 		}
-		ret.ip = i->string();
+		ret.ip = i->string_value();
 
 		// extract port
-		i = info.find_key("port");
-		if (i == 0 || i->type() != entry::int_t)
+		i = info.dict_find("port");
+		if (i == 0 || i->type() != lazy_entry::int_t)
 		{
 			fail(-1, "invalid response from tracker");
 			return false;
 		}
-		ret.port = (unsigned short)i->integer();
+		ret.port = (unsigned short)i->int_value();
 
 		return true;
 	}
 
-	void http_tracker_connection::parse(int status_code, entry const& e)
+	void http_tracker_connection::parse(int status_code, lazy_entry const& e)
 	{
 		boost::shared_ptr<request_callback> cb = requester();
 		if (!cb) return;
 
 		// parse the response
-		entry const* failure = e.find_key("failure reason");
-		if (failure && failure->type() == entry::string_t)
+		lazy_entry const* failure = e.dict_find_string("failure reason");
+		if (failure)
 		{
-			fail(status_code, failure->string().c_str());
+			fail(status_code, failure->string_value().c_str());
 			return;
 		}
 
-		entry const* warning = e.find_key("warning message");
-		if (warning && warning->type() == entry::string_t)
+		lazy_entry const* warning = e.dict_find_string("warning message");
+		if (warning)
 		{
-			cb->tracker_warning(tracker_req(), warning->string());
+			cb->tracker_warning(tracker_req(), warning->string_value());
 		}
 
-		std::vector<peer_entry> peer_list;
-
 		if (tracker_req().kind == tracker_request::scrape_request)
 		{
 			std::string ih = tracker_req().info_hash.to_string();
 
-			entry const* files = e.find_key("files");
-			if (files == 0 || files->type() != entry::dictionary_t)
+			lazy_entry const* files = e.dict_find_dict("files");
+			if (files == 0)
 			{
 				fail(-1, "invalid or missing 'files' entry in scrape response");
 				return;
 			}
 
-			entry const* scrape_data = files->find_key(ih);
-			if (scrape_data == 0 || scrape_data->type() != entry::dictionary_t)
+			// the info-hash may contain zeroes, so it can't be
+			// looked up with dict_find()
+			lazy_entry const* scrape_data = 0;
+			for (int i = 0; i < files->dict_size(); ++i)
+			{
+				std::pair<std::string, lazy_entry const*> f = files->dict_at(i);
+				if (f.first != ih) continue;
+				scrape_data = f.second;
+				break;
+			}
+			if (scrape_data == 0 || scrape_data->type() != lazy_entry::dict_t)
 			{
 				fail(-1, "missing or invalid info-hash entry in scrape response");
 				return;
 			}
-			entry const* complete = scrape_data->find_key("complete");
-			entry const* incomplete = scrape_data->find_key("incomplete");
-			entry const* downloaded = scrape_data->find_key("downloaded");
+			lazy_entry const* complete = scrape_data->dict_find("complete");
+			lazy_entry const* incomplete = scrape_data->dict_find("incomplete");
+			lazy_entry const* downloaded = scrape_data->dict_find("downloaded");
 			if (complete == 0 || incomplete == 0 || downloaded == 0
-				|| complete->type() != entry::int_t
-				|| incomplete->type() != entry::int_t
-				|| downloaded->type() != entry::int_t)
+				|| complete->type() != lazy_entry::int_t
+				|| incomplete->type() != lazy_entry::int_t
+				|| downloaded->type() != lazy_entry::int_t)
 			{
 				fail(-1, "missing 'complete' or 'incomplete' entries in scrape response");
 				return;
 			}
-			cb->tracker_scrape_response(tracker_req(), int(complete->integer())
-				, int(incomplete->integer()), int(downloaded->integer()));
+			cb->tracker_scrape_response(tracker_req(), int(complete->int_value())
+				, int(incomplete->int_value()), int(downloaded->int_value()));
 			return;
 		}
 
-		entry const* interval = e.find_key("interval");
-		if (interval == 0 || interval->type() != entry::int_t)
+		lazy_entry const* interval = e.dict_find("interval");
+		if (interval == 0 || interval->type() != lazy_entry::int_t)
 		{
 			fail(-1, "missing or invalid 'interval' entry in tracker response");
 			return;
 		}
 
-		entry const* peers_ent = e.find_key("peers");
+		lazy_entry const* peers_ent = e.dict_find("peers");
 		if (peers_ent == 0)
 		{
 			fail(-1, "missing 'peers' entry in tracker response");
 			return;
 		}
 
-		if (peers_ent->type() == entry::string_t)
-		{
-			std::string const& peers = peers_ent->string();
-			for (std::string::const_iterator i = peers.begin();
-				i != peers.end();)
-			{
-				if (std::distance(i, peers.end()) < 6) break;
+		// peers from the compact response formats are decoded
+		// straight into endpoints. Only the (rare) dictionary
+		// format may contain hostnames, and ends up in peer_list
+		std::vector<peer_entry> peer_list;
+		std::vector<tcp::endpoint> endpoints;
 
-				peer_entry p;
-				p.pid.clear();
-				p.ip = detail::read_v4_address(i).to_string();
-				p.port = detail::read_uint16(i);
-				peer_list.push_back(p);
-			}
+		if (peers_ent->type() == lazy_entry::string_t)
+		{
+			char const* peers = peers_ent->string_ptr();
+			int len = peers_ent->string_length();
+			endpoints.reserve(len / 6);
+			for (char const* end = peers + len - len % 6; peers != end;)
+				endpoints.push_back(detail::read_v4_endpoint<tcp::endpoint>(peers));
 		}
-		else if (peers_ent->type() == entry::list_t)
+		else if (peers_ent->type() == lazy_entry::list_t)
 		{
-			entry::list_type const& l = peers_ent->list();
-			for(entry::list_type::const_iterator i = l.begin(); i != l.end(); ++i)
+			peer_list.reserve(peers_ent->list_size());
+			for (int i = 0; i < peers_ent->list_size(); ++i)
 			{
 				peer_entry p;
-				if (!extract_peer_info(*i, p)) return;
+				if (!extract_peer_info(*peers_ent->list_at(i), p)) return;
 				peer_list.push_back(p);
 			}
 		}
@@ -390,21 +396,14 @@ namespace libtorrent
 			return;
 		}
 
-		entry const* ipv6_peers = e.find_key("peers6");
-		if (ipv6_peers && ipv6_peers->type() == entry::string_t)
+		lazy_entry const* ipv6_peers = e.dict_find_string("peers6");
+		if (ipv6_peers)
 		{
-			std::string const& peers = ipv6_peers->string();
-			for (std::string::const_iterator i = peers.begin();
-				i != peers.end();)
-			{
-				if (std::distance(i, peers.end()) < 18) break;
-
-				peer_entry p;
-				p.pid.clear();
-				p.ip = detail::read_v6_address(i).to_string();
-				p.port = detail::read_uint16(i);
-				peer_list.push_back(p);
-			}
+			char const* peers = ipv6_peers->string_ptr();
+			int len = ipv6_peers->string_length();
+			endpoints.reserve(endpoints.size() + len / 18);
+			for (char const* end = peers + len - len % 18; peers != end;)
+				endpoints.push_back(detail::read_v6_endpoint<tcp::endpoint>(peers));
 		}
 
 		// look for optional scrape info
@@ -412,27 +411,26 @@ namespace libtorrent
 		int incomplete = -1;
 		address external_ip;
 
-		entry const* ip_ent = e.find_key("external ip");
-		if (ip_ent && ip_ent->type() == entry::string_t)
+		lazy_entry const* ip_ent = e.dict_find_string("external ip");
+		if (ip_ent)
 		{
-			std::string const& ip = ip_ent->string();
-			char const* p = &ip[0];
-			if (ip.size() == address_v4::bytes_type::static_size)
+			char const* p = ip_ent->string_ptr();
+			if (ip_ent->string_length() == address_v4::bytes_type::static_size)
 				external_ip = detail::read_v4_address(p);
-			else if (ip.size() == address_v6::bytes_type::static_size)
+			else if (ip_ent->string_length() == address_v6::bytes_type::static_size)
 				external_ip = detail::read_v6_address(p);
 		}
 		
-		entry const* complete_ent = e.find_key("complete");
-		if (complete_ent && complete_ent->type() == entry::int_t)
-			complete = int(complete_ent->integer());
+		lazy_entry const* complete_ent = e.dict_find("complete");
+		if (complete_ent && complete_ent->type() == lazy_entry::int_t)
+			complete = int(complete_ent->int_value());
 
-		entry const* incomplete_ent = e.find_key("incomplete");
-		if (incomplete_ent && incomplete_ent->type() == entry::int_t)
-			incomplete = int(incomplete_ent->integer());
+		lazy_entry const* incomplete_ent = e.dict_find("incomplete");
+		if (incomplete_ent && incomplete_ent->type() == lazy_entry::int_t)
+			incomplete = int(incomplete_ent->int_value());
 
-		cb->tracker_response(tracker_req(), peer_list, interval->integer(), complete
-			, incomplete, external_ip);
+		cb->tracker_response(tracker_req(), peer_list, endpoints
+			, int(interval->int_value()), complete, incomplete, external_ip);
 	}
 
 }
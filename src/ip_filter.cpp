@@ -63,6 +63,12 @@ namespace libtorrent
 		return m_filter6.access(addr.to_v6().to_bytes());
 	}
 
+	void ip_filter::compile()
+	{
+		m_filter4.compile();
+		m_filter6.compile();
+	}
+
 	ip_filter::filter_tuple_t ip_filter::export_filter() const
 	{
 		return boost::make_tuple(m_filter4.export_filter<address_v4>()
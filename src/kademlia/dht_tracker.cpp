@@ -143,7 +143,7 @@ namespace libtorrent { namespace dht
 	// class that puts the networking and the kademlia node in a single
 	// unit and connecting them together.
 	dht_tracker::dht_tracker(udp_socket& sock, dht_settings const& settings
-		, entry const& bootstrap)
+		, resolver& host_resolver, entry const& bootstrap)
 		: m_dht(bind(&dht_tracker::send_packet, this, _1), settings
 			, read_id(bootstrap))
 		, m_sock(sock)
@@ -154,7 +154,7 @@ namespace libtorrent { namespace dht
 		, m_settings(settings)
 		, m_refresh_bucket(160)
 		, m_abort(false)
-		, m_host_resolver(sock.get_io_service())
+		, m_host_resolver(host_resolver)
 		, m_refs(0)
 	{
 		using boost::bind;
@@ -216,7 +216,7 @@ namespace libtorrent { namespace dht
 		m_timer.cancel();
 		m_connection_timer.cancel();
 		m_refresh_timer.cancel();
-		m_host_resolver.cancel();
+		m_host_resolver.cancel(this);
 	}
 
 	void dht_tracker::dht_status(session_status& s)
@@ -744,16 +744,15 @@ namespace libtorrent { namespace dht
 
 	void dht_tracker::add_node(std::pair<std::string, int> const& node)
 	{
-		udp::resolver::query q(node.first, lexical_cast<std::string>(node.second));
-		m_host_resolver.async_resolve(q,
-			bind(&dht_tracker::on_name_lookup, self(), _1, _2));
+		m_host_resolver.async_resolve(node.first,
+			bind(&dht_tracker::on_name_lookup, self(), _1, _2, node.second), this);
 	}
 
 	void dht_tracker::on_name_lookup(error_code const& e
-		, udp::resolver::iterator host) try
+		, std::vector<address> const& addresses, int port) try
 	{
-		if (e || host == udp::resolver::iterator()) return;
-		add_node(host->endpoint());
+		if (e || m_abort) return;
+		add_node(udp::endpoint(addresses.front(), port));
 	}
 	catch (std::exception&)
 	{
@@ -762,16 +761,15 @@ namespace libtorrent { namespace dht
 
 	void dht_tracker::add_router_node(std::pair<std::string, int> const& node)
 	{
-		udp::resolver::query q(node.first, lexical_cast<std::string>(node.second));
-		m_host_resolver.async_resolve(q,
-			bind(&dht_tracker::on_router_name_lookup, self(), _1, _2));
+		m_host_resolver.async_resolve(node.first,
+			bind(&dht_tracker::on_router_name_lookup, self(), _1, _2, node.second), this);
 	}
 
 	void dht_tracker::on_router_name_lookup(error_code const& e
-		, udp::resolver::iterator host) try
+		, std::vector<address> const& addresses, int port) try
 	{
-		if (e || host == udp::resolver::iterator()) return;
-		m_dht.add_router_node(host->endpoint());
+		if (e || m_abort) return;
+		m_dht.add_router_node(udp::endpoint(addresses.front(), port));
 	}
 	catch (std::exception&)
 	{
@@ -290,27 +290,19 @@ namespace libtorrent
 			TORRENT_ASSERT(start + size <= m_files.total_size());
 
 			// find the file iterator and file offset
-			size_type file_offset = start;
-			std::vector<file_entry>::const_iterator file_iter;
-
-			for (file_iter = files().begin();;)
-			{
-				if (file_offset < file_iter->size)
-					break;
-
-				file_offset -= file_iter->size;
-				++file_iter;
-			}
+			file_storage::iterator file_iter = files().file_at_offset(start);
+			TORRENT_ASSERT(file_iter != files().end());
+			size_type file_offset = start - file_iter->offset;
 
 			TORRENT_ASSERT(file_iter->size > 0);
 			mapped_file_pool::file_view view = m_pool.open_file(
-				m_save_path / file_iter->path, std::ios::in
+				m_save_path / files().file_path(*file_iter), std::ios::in
 				, file_offset + file_iter->file_base, size, this
 				, file_iter->size + file_iter->file_base);
 
 			if (!view.valid())
 			{
-				set_error((m_save_path / file_iter->path).string(), "failed to open file for reading");
+				set_error((m_save_path / files().file_path(*file_iter)).string(), "failed to open file for reading");
 				return -1;
 			}
 			TORRENT_ASSERT(view.const_addr() != 0);
@@ -333,8 +325,8 @@ namespace libtorrent
 					TORRENT_ASSERT(int(slices.size()) > counter);
 					size_type slice_size = slices[counter].size;
 					TORRENT_ASSERT(slice_size == read_bytes);
-					TORRENT_ASSERT(files().at(slices[counter].file_index).path
-						== file_iter->path);
+					TORRENT_ASSERT(slices[counter].file_index
+						== file_iter - files().begin());
 #endif
 
 					TORRENT_ASSERT(file_offset + file_iter->file_base >= view.offset());
@@ -361,7 +353,7 @@ namespace libtorrent
 					// this file was empty, don't increment the slice counter
 					if (read_bytes > 0) ++counter;
 #endif
-					fs::path path = m_save_path / file_iter->path;
+					fs::path path = m_save_path / files().file_path(*file_iter);
 
 					file_offset = 0;
 
@@ -371,7 +363,7 @@ namespace libtorrent
 
 					if (!view.valid())
 					{
-						set_error((m_save_path / file_iter->path).string(), "failed to open for reading");
+						set_error((m_save_path / files().file_path(*file_iter)).string(), "failed to open for reading");
 						return -1;
 					}
 					TORRENT_ASSERT(view.const_addr() != 0);
@@ -404,30 +396,22 @@ namespace libtorrent
 			TORRENT_ASSERT(start + size <= m_files.total_size());
 
 			// find the file iterator and file offset
-			size_type file_offset = start;
-			std::vector<file_entry>::const_iterator file_iter;
-
-			for (file_iter = files().begin();;)
-			{
-				if (file_offset < file_iter->size)
-					break;
-
-				file_offset -= file_iter->size;
-				++file_iter;
-			}
+			file_storage::iterator file_iter = files().file_at_offset(start);
+			TORRENT_ASSERT(file_iter != files().end());
+			size_type file_offset = start - file_iter->offset;
 
 			TORRENT_ASSERT(file_iter->size > 0);
 			try
 			{
 
 			mapped_file_pool::file_view view = m_pool.open_file(
-				m_save_path / file_iter->path, std::ios::in | std::ios::out
+				m_save_path / files().file_path(*file_iter), std::ios::in | std::ios::out
 				, file_offset + file_iter->file_base, size, this
 				, file_iter->size + file_iter->file_base);
 		
 			if (!view.valid())
 			{
-				set_error((m_save_path / file_iter->path).string(), "failed to open file for writing");
+				set_error((m_save_path / files().file_path(*file_iter)).string(), "failed to open file for writing");
 				return -1;
 			}
 			TORRENT_ASSERT(view.addr() != 0);
@@ -449,8 +433,8 @@ namespace libtorrent
 					TORRENT_ASSERT(int(slices.size()) > counter);
 					size_type slice_size = slices[counter].size;
 					TORRENT_ASSERT(slice_size == write_bytes);
-					TORRENT_ASSERT(files().at(slices[counter].file_index).path
-						== file_iter->path);
+					TORRENT_ASSERT(slices[counter].file_index
+						== file_iter - files().begin());
 #endif
 
 					TORRENT_ASSERT(file_offset + file_iter->file_base >= view.offset());
@@ -475,7 +459,7 @@ namespace libtorrent
 					// this file was empty, don't increment the slice counter
 					if (write_bytes > 0) ++counter;
 #endif
-					fs::path path = m_save_path / file_iter->path;
+					fs::path path = m_save_path / files().file_path(*file_iter);
 
 					file_offset = 0;
 					view = m_pool.open_file(path, std::ios::in | std::ios::out
@@ -484,7 +468,7 @@ namespace libtorrent
 
 					if (!view.valid())
 					{
-						set_error((m_save_path / file_iter->path).string(), "failed to open file for reading");
+						set_error((m_save_path / files().file_path(*file_iter)).string(), "failed to open file for reading");
 						return -1;
 					}
 					TORRENT_ASSERT(view.addr() != 0);
@@ -493,7 +477,7 @@ namespace libtorrent
 			}
 			catch (std::exception& e)
 			{
-				set_error((m_save_path / file_iter->path).string(), e.what());
+				set_error((m_save_path / files().file_path(*file_iter)).string(), e.what());
 				return -1;
 			}
 			return size;
@@ -638,7 +622,7 @@ namespace libtorrent
 				{
 					if (i->size != fs->first)
 					{
-						error = "file size for '" + i->path.native_file_string()
+						error = "file size for '" + files().file_path(*i).native_file_string()
 							+ "' was expected to be "
 							+ boost::lexical_cast<std::string>(i->size) + " bytes";
 						return false;
@@ -751,7 +735,7 @@ namespace libtorrent
 		bool rename_file(int index, std::string const& new_filename)
 		{
 			if (index < 0 || index >= m_files.num_files()) return true;
-			fs::path old_name = m_save_path / files().at(index).path;
+			fs::path old_name = m_save_path / files().file_path(index);
 			m_pool.release(this);
 
 #if defined(_WIN32) && defined(UNICODE) && BOOST_VERSION >= 103400
@@ -803,8 +787,9 @@ namespace libtorrent
 			for (file_storage::iterator i = m_files.begin()
 				, end(m_files.end()); i != end; ++i)
 			{
-				std::string p = (m_save_path / i->path).string();
-				fs::path bp = i->path.branch_path();
+				fs::path file_path = m_files.file_path(*i);
+				std::string p = (m_save_path / file_path).string();
+				fs::path bp = file_path.branch_path();
 				std::pair<iter_t, bool> ret;
 				ret.second = true;
 				while (ret.second && !bp.empty())
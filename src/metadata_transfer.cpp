@@ -175,7 +175,7 @@ namespace libtorrent { namespace
 
 				if (m_torrent.alerts().should_post<metadata_failed_alert>())
 				{
-					m_torrent.alerts().post_alert(metadata_failed_alert(
+					m_torrent.alerts().post_alert_ptr(new metadata_failed_alert(
 						m_torrent.get_handle()));
 				}
 
@@ -310,6 +310,7 @@ namespace libtorrent { namespace
 			detail::write_uint32(1 + 1 + 3, i.begin);
 			detail::write_uint8(bt_peer_connection::msg_extended, i.begin);
 			detail::write_uint8(m_message_index, i.begin);
+			m_pc.sent_message();
 			// means 'request data'
 			detail::write_uint8(0, i.begin);
 			detail::write_uint8(start, i.begin);
@@ -341,6 +342,7 @@ namespace libtorrent { namespace
 				detail::write_uint32(11 + offset.second, i.begin);
 				detail::write_uint8(bt_peer_connection::msg_extended, i.begin);
 				detail::write_uint8(m_message_index, i.begin);
+				m_pc.sent_message();
 				// means 'data packet'
 				detail::write_uint8(1, i.begin);
 				detail::write_uint32((int)m_tp.metadata().left(), i.begin);
@@ -359,6 +361,7 @@ namespace libtorrent { namespace
 				detail::write_uint32(1 + 2, i.begin);
 				detail::write_uint8(bt_peer_connection::msg_extended, i.begin);
 				detail::write_uint8(m_message_index, i.begin);
+				m_pc.sent_message();
 				// means 'have no data'
 				detail::write_uint8(2, i.begin);
 				TORRENT_ASSERT(i.begin == i.end);
@@ -61,6 +61,15 @@ using libtorrent::aux::session_impl;
 
 namespace libtorrent
 {
+	// once the handshake is done, up to this many bytes
+	// are read from the socket at a time, even if the
+	// current message is smaller
+	enum { read_ahead_size = 2048 };
+
+	// the number of ticks the shortest request round trip
+	// is remembered for, before it's replaced by a new sample
+	enum { rtt_window_length = 10 };
+
 	// outbound connection
 	peer_connection::peer_connection(
 		session_impl& ses
@@ -89,14 +98,18 @@ namespace libtorrent
 		, m_became_uninteresting(time_now())
 		, m_free_upload(0)
 		, m_downloaded_at_last_unchoke(0)
+		, m_downloaded_last_tick(0)
 		, m_disk_recv_buffer(ses, 0)
 		, m_socket(s)
 		, m_remote(endp)
 		, m_torrent(tor)
 		, m_num_pieces(0)
+		, m_num_wanted(0)
 		, m_timeout(m_ses.settings().peer_timeout)
 		, m_packet_size(0)
 		, m_recv_pos(0)
+		, m_recv_end(0)
+		, m_recv_start(0)
 		, m_disk_recv_buffer_size(0)
 		, m_reading_bytes(0)
 		, m_num_invalid_requests(0)
@@ -112,6 +125,10 @@ namespace libtorrent
 		, m_download_rate_peak(0)
 		, m_upload_rate_peak(0)
 		, m_rtt(0)
+		, m_request_rtt(0)
+		, m_request_rtt_window(0)
+		, m_rtt_window_ticks(rtt_window_length)
+		, m_slow_start_rate(0)
 		, m_prefer_whole_pieces(0)
 		, m_desired_queue_size(2)
 		, m_fast_reconnect(false)
@@ -123,6 +140,8 @@ namespace libtorrent
 		, m_failed(false)
 		, m_ignore_bandwidth_limits(false)
 		, m_have_all(false)
+		, m_send_deferred(false)
+		, m_slow_start(true)
 		, m_disconnecting(false)
 		, m_connecting(true)
 		, m_queued(true)
@@ -195,13 +214,17 @@ namespace libtorrent
 		, m_became_uninteresting(time_now())
 		, m_free_upload(0)
 		, m_downloaded_at_last_unchoke(0)
+		, m_downloaded_last_tick(0)
 		, m_disk_recv_buffer(ses, 0)
 		, m_socket(s)
 		, m_remote(endp)
 		, m_num_pieces(0)
+		, m_num_wanted(0)
 		, m_timeout(m_ses.settings().peer_timeout)
 		, m_packet_size(0)
 		, m_recv_pos(0)
+		, m_recv_end(0)
+		, m_recv_start(0)
 		, m_disk_recv_buffer_size(0)
 		, m_reading_bytes(0)
 		, m_num_invalid_requests(0)
@@ -217,6 +240,10 @@ namespace libtorrent
 		, m_download_rate_peak(0)
 		, m_upload_rate_peak(0)
 		, m_rtt(0)
+		, m_request_rtt(0)
+		, m_request_rtt_window(0)
+		, m_rtt_window_ticks(rtt_window_length)
+		, m_slow_start_rate(0)
 		, m_prefer_whole_pieces(0)
 		, m_desired_queue_size(2)
 		, m_fast_reconnect(false)
@@ -228,6 +255,8 @@ namespace libtorrent
 		, m_failed(false)
 		, m_ignore_bandwidth_limits(false)
 		, m_have_all(false)
+		, m_send_deferred(false)
+		, m_slow_start(true)
 		, m_disconnecting(false)
 		, m_connecting(false)
 		, m_queued(false)
@@ -335,22 +364,8 @@ namespace libtorrent
 		boost::shared_ptr<torrent> t = m_torrent.lock();
 		TORRENT_ASSERT(t);
 
-		bool interested = false;
-		if (!t->is_finished())
-		{
-			piece_picker const& p = t->picker();
-			int num_pieces = p.num_pieces();
-			for (int j = 0; j != num_pieces; ++j)
-			{
-				if (!p.have_piece(j)
-					&& t->piece_priority(j) > 0
-					&& m_have_piece[j])
-				{
-					interested = true;
-					break;
-				}
-			}
-		}
+		TORRENT_ASSERT(m_num_wanted >= 0);
+		bool interested = !t->is_finished() && m_num_wanted > 0;
 		try
 		{
 			if (!interested) send_not_interested();
@@ -362,6 +377,26 @@ namespace libtorrent
 		TORRENT_ASSERT(is_interesting() == interested);
 	}
 
+	void peer_connection::update_wanted(bitfield const& wanted)
+	{
+		// if we don't have the metadata yet, the wanted
+		// count will be set up by init()
+		if (wanted.size() != m_have_piece.size())
+		{
+			m_num_wanted = 0;
+			return;
+		}
+		m_num_wanted = m_have_piece.count_common(wanted);
+	}
+
+	void peer_connection::piece_wanted(int index, bool wanted)
+	{
+		if (index >= int(m_have_piece.size()) || !m_have_piece[index]) return;
+		if (wanted) ++m_num_wanted;
+		else --m_num_wanted;
+		TORRENT_ASSERT(m_num_wanted >= 0);
+	}
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 	void peer_connection::add_extension(boost::shared_ptr<peer_plugin> ext)
 	{
@@ -445,8 +480,7 @@ namespace libtorrent
 		// now that we have a piece_picker,
 		// update it with this peer's pieces
 
-		TORRENT_ASSERT(m_num_pieces == std::count(m_have_piece.begin()
-			, m_have_piece.end(), true));
+		TORRENT_ASSERT(m_num_pieces == m_have_piece.count());
 
 		if (m_num_pieces == int(m_have_piece.size()))
 		{
@@ -457,6 +491,7 @@ namespace libtorrent
 			if (m_peer_info) m_peer_info->seed = true;
 
 			t->peer_has_all();
+			m_num_wanted = t->num_wanted();
 			if (t->is_finished()) send_not_interested();
 			else t->get_policy().peer_is_interesting(*this);
 			return;
@@ -466,22 +501,16 @@ namespace libtorrent
 		if (!t->is_seed())
 		{
 			t->peer_has(m_have_piece);
-			bool interesting = false;
-			for (int i = 0; i < int(m_have_piece.size()); ++i)
-			{
-				if (m_have_piece[i])
-				{
-					// if the peer has a piece and we don't, the peer is interesting
-					if (!t->have_piece(i)
-						&& t->picker().piece_priority(i) != 0)
-						interesting = true;
-				}
-			}
-			if (interesting) t->get_policy().peer_is_interesting(*this);
+			bitfield wanted;
+			t->picker().wanted_pieces(wanted);
+			// if the peer has a piece we want, the peer is interesting
+			m_num_wanted = m_have_piece.count_common(wanted);
+			if (m_num_wanted > 0) t->get_policy().peer_is_interesting(*this);
 			else send_not_interested();
 		}
 		else
 		{
+			m_num_wanted = 0;
 			update_interest();
 		}
 	}
@@ -1115,11 +1144,14 @@ namespace libtorrent
 				++m_num_pieces;
 				t->peer_has(index);
 
-				if (!t->have_piece(index)
-					&& !t->is_seed()
-					&& !is_interesting()
+				if (!t->is_seed()
+					&& !t->have_piece(index)
 					&& t->picker().piece_priority(index) != 0)
-					t->get_policy().peer_is_interesting(*this);
+				{
+					++m_num_wanted;
+					if (!is_interesting())
+						t->get_policy().peer_is_interesting(*this);
+				}
 
 				// this will disregard all have messages we get within
 				// the first two seconds. Since some clients implements
@@ -1216,6 +1248,7 @@ namespace libtorrent
 			m_have_piece.set_all();
 			m_num_pieces = num_pieces;
 			t->peer_has_all();
+			m_num_wanted = t->num_wanted();
 			if (!t->is_finished())
 				t->get_policy().peer_is_interesting(*this);
 
@@ -1227,31 +1260,28 @@ namespace libtorrent
 		// let the torrent know which pieces the
 		// peer has
 		// if we're a seed, we don't keep track of piece availability
-		bool interesting = false;
+		m_num_wanted = 0;
 		if (!t->is_seed())
 		{
 			t->peer_has(bits);
 
-			for (int i = 0; i < (int)m_have_piece.size(); ++i)
-			{
-				bool have = bits[i];
-				if (have && !m_have_piece[i])
-				{
-					if (!t->have_piece(i) && t->picker().piece_priority(i) != 0)
-						interesting = true;
-				}
-				else if (!have && m_have_piece[i])
-				{
-					// this should probably not be allowed
-					t->peer_lost(i);
-				}
-			}
+			// the pieces the peer used to have but doesn't
+			// have anymore. This should probably not be allowed
+			bitfield lost(m_have_piece);
+			lost.clear_bits(bits);
+			for (int i = lost.find_next_set(0); i != -1;
+				i = lost.find_next_set(i + 1))
+				t->peer_lost(i);
+
+			bitfield wanted;
+			t->picker().wanted_pieces(wanted);
+			m_num_wanted = bits.count_common(wanted);
 		}
 
 		m_have_piece = bits;
 		m_num_pieces = num_pieces;
 
-		if (interesting) t->get_policy().peer_is_interesting(*this);
+		if (m_num_wanted > 0) t->get_policy().peer_is_interesting(*this);
 		else if (upload_only()) disconnect("upload to upload connections");
 	}
 
@@ -1410,7 +1440,7 @@ namespace libtorrent
 
 			if (t->alerts().should_post<invalid_request_alert>())
 			{
-				t->alerts().post_alert(invalid_request_alert(
+				t->alerts().post_alert_ptr(new invalid_request_alert(
 					t->get_handle(), m_remote, m_peer_id, r));
 			}
 		}
@@ -1521,7 +1551,7 @@ namespace libtorrent
 		{
 			if (t->alerts().should_post<peer_error_alert>())
 			{
-				t->alerts().post_alert(peer_error_alert(t->get_handle(), m_remote
+				t->alerts().post_alert_ptr(new peer_error_alert(t->get_handle(), m_remote
 						, m_peer_id, "peer sent 0 length piece"));
 			}
 			return;
@@ -1568,7 +1598,7 @@ namespace libtorrent
 		{
 			if (t->alerts().should_post<unwanted_block_alert>())
 			{
-				t->alerts().post_alert(unwanted_block_alert(t->get_handle(), m_remote
+				t->alerts().post_alert_ptr(new unwanted_block_alert(t->get_handle(), m_remote
 						, m_peer_id, block_finished.block_index, block_finished.piece_index));
 			}
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_ERROR_LOGGING
@@ -1581,6 +1611,7 @@ namespace libtorrent
 			return;
 		}
 
+		ptime request_time = b->send_time;
 		int block_index = b - m_download_queue.begin();
 		for (int i = 0; i < block_index; ++i)
 		{
@@ -1599,7 +1630,7 @@ namespace libtorrent
 			if (qe.skipped > m_desired_queue_size)
 			{
 				if (m_ses.m_alerts.should_post<request_dropped_alert>())
-					m_ses.m_alerts.post_alert(request_dropped_alert(t->get_handle()
+					m_ses.m_alerts.post_alert_ptr(new request_dropped_alert(t->get_handle()
 						, remote(), pid(), qe.block.block_index, qe.block.piece_index));
 				picker.abort_download(qe.block);
 				m_download_queue.erase(m_download_queue.begin() + i);
@@ -1631,11 +1662,26 @@ namespace libtorrent
 			m_snubbed = false;
 			if (m_ses.m_alerts.should_post<peer_unsnubbed_alert>())
 			{
-				m_ses.m_alerts.post_alert(peer_unsnubbed_alert(t->get_handle()
+				m_ses.m_alerts.post_alert_ptr(new peer_unsnubbed_alert(t->get_handle()
 					, m_remote, m_peer_id));
 			}
 		}
 
+		if (request_time != min_time())
+		{
+			int rtt = (std::min)(int(total_milliseconds(now - request_time)), 0xffff);
+			if (rtt == 0) rtt = 1;
+			if (m_request_rtt == 0 || rtt < m_request_rtt) m_request_rtt = rtt;
+			if (m_request_rtt_window == 0 || rtt < m_request_rtt_window)
+				m_request_rtt_window = rtt;
+		}
+
+		// in slow start, every received block adds one more
+		// outstanding request, which doubles the queue once
+		// per round trip
+		if (m_slow_start && m_desired_queue_size < m_max_out_request_queue)
+			++m_desired_queue_size;
+
 		fs.async_write(p, data, bind(&peer_connection::on_disk_write_complete
 			, self(), _1, _2, p, t));
 		m_outstanding_writing_bytes += p.length;
@@ -1645,7 +1691,7 @@ namespace libtorrent
 		if (m_outstanding_writing_bytes >= m_ses.settings().max_outstanding_disk_bytes_per_connection
 			&& t->alerts().should_post<performance_alert>())
 		{
-			t->alerts().post_alert(performance_alert(t->get_handle()
+			t->alerts().post_alert_ptr(new performance_alert(t->get_handle()
 				, performance_alert::outstanding_disk_buffer_limit_reached));
 		}
 
@@ -1707,7 +1753,7 @@ namespace libtorrent
 		
 			if (t->alerts().should_post<file_error_alert>())
 			{
-				t->alerts().post_alert(file_error_alert(j.error_file, t->get_handle(), j.str));
+				t->alerts().post_alert_ptr(new file_error_alert(j.error_file, t->get_handle(), j.str));
 			}
 			t->pause();
 			return;
@@ -1720,9 +1766,10 @@ namespace libtorrent
 		TORRENT_ASSERT(p.piece == j.piece);
 		TORRENT_ASSERT(p.start == j.offset);
 		picker.mark_as_finished(block_finished, peer_info_struct());
+		t->block_written();
 		if (t->alerts().should_post<block_finished_alert>())
 		{
-			t->alerts().post_alert(block_finished_alert(t->get_handle(), 
+			t->alerts().post_alert_ptr(new block_finished_alert(t->get_handle(), 
 				remote(), pid(), block_finished.block_index, block_finished.piece_index));
 		}
 
@@ -1864,6 +1911,7 @@ namespace libtorrent
 		m_num_pieces = m_have_piece.size();
 		
 		t->peer_has_all();
+		m_num_wanted = t->num_wanted();
 
 		// if we're finished, we're not interested
 		if (t->is_finished()) send_not_interested();
@@ -2013,7 +2061,7 @@ namespace libtorrent
 
 		if (t->alerts().should_post<block_downloading_alert>())
 		{
-			t->alerts().post_alert(block_downloading_alert(t->get_handle(), 
+			t->alerts().post_alert_ptr(new block_downloading_alert(t->get_handle(), 
 				remote(), pid(), speedmsg, block.block_index, block.piece_index));
 		}
 
@@ -2174,6 +2222,7 @@ namespace libtorrent
 		if ((int)m_download_queue.size() >= m_desired_queue_size) return;
 
 		bool empty_download_queue = m_download_queue.empty();
+		ptime now = time_now();
 
 		while (!m_request_queue.empty()
 			&& (int)m_download_queue.size() < m_desired_queue_size)
@@ -2199,6 +2248,7 @@ namespace libtorrent
 				continue;
 
 			m_download_queue.push_back(block);
+			m_download_queue.back().send_time = now;
 /*
 #ifdef TORRENT_VERBOSE_LOGGING
 			(*m_logger) << time_now_string()
@@ -2224,6 +2274,7 @@ namespace libtorrent
 					block = m_request_queue.front();
 					m_request_queue.pop_front();
 					m_download_queue.push_back(block);
+					m_download_queue.back().send_time = now;
 
 #ifdef TORRENT_VERBOSE_LOGGING
 					(*m_logger) << time_now_string()
@@ -2340,18 +2391,26 @@ namespace libtorrent
 		{
 			if (error > 1 && m_ses.m_alerts.should_post<peer_error_alert>())
 			{
-				m_ses.m_alerts.post_alert(
-					peer_error_alert(handle, remote(), pid(), message));
+				m_ses.m_alerts.post_alert_ptr(
+					new peer_error_alert(handle, remote(), pid(), message));
 			}
 			else if (error <= 1 && m_ses.m_alerts.should_post<peer_disconnected_alert>())
 			{
-				m_ses.m_alerts.post_alert(
-					peer_disconnected_alert(handle, remote(), pid(), message));
+				m_ses.m_alerts.post_alert_ptr(
+					new peer_disconnected_alert(handle, remote(), pid(), message));
 			}
 		}
 
 		if (t)
 		{
+#ifndef TORRENT_DISABLE_EXTENSIONS
+			for (extension_list_t::iterator i = m_extensions.begin()
+				, end(m_extensions.end()); i != end; ++i)
+			{
+				(*i)->on_disconnect();
+			}
+#endif
+
 			// make sure we keep all the stats!
 			calc_ip_overhead();
 			t->add_stats(statistics());
@@ -2446,6 +2505,7 @@ namespace libtorrent
 		p.download_rate_peak = m_download_rate_peak;
 		p.upload_rate_peak = m_upload_rate_peak;
 		p.rtt = m_rtt;
+		p.request_rtt = m_request_rtt;
 		p.down_speed = statistics().download_rate();
 		p.up_speed = statistics().upload_rate();
 		p.payload_down_speed = statistics().download_payload_rate();
@@ -2513,6 +2573,7 @@ namespace libtorrent
 		p.flags |= is_seed() ? peer_info::seed : 0;
 		p.flags |= m_snubbed ? peer_info::snubbed : 0;
 		p.flags |= m_upload_only ? peer_info::upload_only : 0;
+		p.flags |= m_slow_start ? peer_info::slow_start : 0;
 		if (peer_info_struct())
 		{
 			policy::peer* pi = peer_info_struct();
@@ -2573,6 +2634,17 @@ namespace libtorrent
 			return false;
 		}
 		m_disk_recv_buffer_size = disk_buffer_size;
+
+		// if we have read ahead, some of the payload is already
+		// in the regular receive buffer. It belongs in the disk buffer
+		int regular_buffer_size = m_packet_size - disk_buffer_size;
+		int end = (std::min)(m_recv_end, m_packet_size);
+		if (end > regular_buffer_size)
+		{
+			std::memcpy(m_disk_recv_buffer.get()
+				, &m_recv_buffer[m_recv_start + regular_buffer_size]
+				, end - regular_buffer_size);
+		}
 		return true;
 	}
 
@@ -2587,20 +2659,37 @@ namespace libtorrent
 		INVARIANT_CHECK;
 
 		TORRENT_ASSERT(packet_size > 0);
-		TORRENT_ASSERT(int(m_recv_buffer.size()) >= size);
-		TORRENT_ASSERT(int(m_recv_buffer.size()) >= m_recv_pos);
+		TORRENT_ASSERT(int(m_recv_buffer.size()) >= m_recv_start + size);
+		TORRENT_ASSERT(int(m_recv_buffer.size()) >= m_recv_start + m_recv_pos);
 		TORRENT_ASSERT(m_recv_pos >= size);
+		TORRENT_ASSERT(m_recv_end >= m_recv_pos);
 
-		if (size > 0)		
-			std::memmove(&m_recv_buffer[0], &m_recv_buffer[0] + size, m_recv_pos - size);
-
+		// the bytes are not moved here, since there may be several
+		// messages left in the bytes we've read ahead. The start
+		// of the buffer is moved past them instead
+		m_recv_start += size;
 		m_recv_pos -= size;
+		m_recv_end -= size;
+		if (m_recv_end == 0) m_recv_start = 0;
+
+		m_packet_size = packet_size;
+	}
+
+	void peer_connection::compact_recv_buffer()
+	{
+		if (m_recv_start == 0) return;
+
+		// the bytes of the current message, and any bytes read
+		// ahead past it, that are in the regular buffer
+		int size = (std::min)(m_recv_end, int(m_recv_buffer.size()) - m_recv_start);
+		if (size > 0)
+			std::memmove(&m_recv_buffer[0], &m_recv_buffer[0] + m_recv_start, size);
+		m_recv_start = 0;
 
 #ifndef NDEBUG
-		std::fill(m_recv_buffer.begin() + m_recv_pos, m_recv_buffer.end(), 0);
+		if (size < 0) size = 0;
+		std::fill(m_recv_buffer.begin() + size, m_recv_buffer.end(), 0);
 #endif
-
-		m_packet_size = packet_size;
 	}
 
 	void peer_connection::calc_ip_overhead()
@@ -2727,6 +2816,18 @@ namespace libtorrent
 
 		m_statistics.second_tick(tick_interval);
 
+		// the number of payload bytes received during this tick
+		size_type downloaded = m_statistics.total_payload_download()
+			- m_downloaded_last_tick;
+		m_downloaded_last_tick = m_statistics.total_payload_download();
+
+		if (--m_rtt_window_ticks == 0)
+		{
+			if (m_request_rtt_window > 0) m_request_rtt = m_request_rtt_window;
+			m_request_rtt_window = 0;
+			m_rtt_window_ticks = rtt_window_length;
+		}
+
 		if (m_statistics.upload_payload_rate() > m_upload_rate_peak)
 		{
 			m_upload_rate_peak = m_statistics.upload_payload_rate();
@@ -2748,34 +2849,67 @@ namespace libtorrent
 		if (!t->valid_metadata()) return;
 
 		// calculate the desired download queue size
-		const float queue_time = m_ses.settings().request_queue_time;
-		// (if the latency is more than this, the download will stall)
-		// so, the queue size is queue_time * down_rate / 16 kiB
-		// (16 kB is the size of each request)
-		// the minimum number of requests is 2 and the maximum is 48
+		// the queue should cover the bandwidth-delay product, i.e.
+		// the number of bytes received during one request round
+		// trip. It is set to twice that, to leave room for the
+		// download rate to double until the next tick. Until a
+		// round trip has been measured, the queue covers
+		// request_queue_time seconds of downloading instead.
 		// the block size doesn't have to be 16. So we first query the
-		// torrent for it
-		const int block_size = m_request_large_blocks
-			? t->torrent_file().piece_length() : t->block_size();
+		// torrent for it. Even when requesting large blocks, the
+		// download queue has one entry per block, so the queue size
+		// is always counted in blocks
+		const int block_size = t->block_size();
 		TORRENT_ASSERT(block_size > 0);
 		
 		if (m_snubbed)
 		{
 			m_desired_queue_size = 1;
+			m_slow_start = false;
 		}
 		else
 		{
-			m_desired_queue_size = static_cast<int>(queue_time
-				* statistics().download_rate() / block_size);
-			if (m_desired_queue_size > m_max_out_request_queue)
-				m_desired_queue_size = m_max_out_request_queue;
-			if (m_desired_queue_size < min_request_queue)
-				m_desired_queue_size = min_request_queue;
+			// the rate over the last tick reacts quicker than the
+			// average, use whichever is higher
+			int tick_rate = int(downloaded / tick_interval);
+			int rate = (std::max)(tick_rate, int(statistics().download_rate()));
+
+			int queue_size;
+			if (m_request_rtt == 0)
+			{
+				const float queue_time = m_ses.settings().request_queue_time;
+				queue_size = int(queue_time * rate / block_size);
+			}
+			else
+			{
+				queue_size = int(size_type(rate) * m_request_rtt * 2
+					/ 1000 / block_size) + 1;
+			}
+
+			if (m_slow_start)
+			{
+				// the queue only grows during slow start. Once the
+				// rate grows by less than 1/8 in a tick, the link is
+				// saturated and the queue follows the bandwidth-delay
+				// product from now on
+				if (queue_size < m_desired_queue_size)
+					queue_size = m_desired_queue_size;
+				if (tick_rate > 0 && m_slow_start_rate > 0
+					&& tick_rate < m_slow_start_rate + m_slow_start_rate / 8)
+					m_slow_start = false;
+				m_slow_start_rate = tick_rate;
+			}
+
+			if (queue_size > m_max_out_request_queue)
+				queue_size = m_max_out_request_queue;
+			if (queue_size < min_request_queue)
+				queue_size = min_request_queue;
+			m_desired_queue_size = queue_size;
 
 			if (m_desired_queue_size == m_max_out_request_queue 
 				&& t->alerts().should_post<performance_alert>())
 			{
-				t->alerts().post_alert(performance_alert(t->get_handle()
+				t->alerts().post_alert_ptr(new performance_alert(t->get_handle()
 					, performance_alert::outstanding_request_limit_reached));
 			}
 		}
@@ -2866,7 +3000,7 @@ namespace libtorrent
 			m_snubbed = true;
 			if (m_ses.m_alerts.should_post<peer_snubbed_alert>())
 			{
-				m_ses.m_alerts.post_alert(peer_snubbed_alert(t->get_handle()
+				m_ses.m_alerts.post_alert_ptr(new peer_snubbed_alert(t->get_handle()
 					, m_remote, m_peer_id));
 			}
 		}
@@ -2907,7 +3041,7 @@ namespace libtorrent
 
 			if (m_ses.m_alerts.should_post<block_timeout_alert>())
 			{
-				m_ses.m_alerts.post_alert(block_timeout_alert(t->get_handle()
+				m_ses.m_alerts.post_alert_ptr(new block_timeout_alert(t->get_handle()
 					, remote(), pid(), r.block_index, r.piece_index));
 			}
 			m_download_queue.pop_back();
@@ -2982,7 +3116,7 @@ namespace libtorrent
 			}
 		
 			if (t->alerts().should_post<file_error_alert>())
-				t->alerts().post_alert(file_error_alert(j.error_file, t->get_handle(), j.str));
+				t->alerts().post_alert_ptr(new file_error_alert(j.error_file, t->get_handle(), j.str));
 			t->set_error(j.str);
 			t->pause();
 			return;
@@ -3096,6 +3230,7 @@ namespace libtorrent
 #endif
 			std::list<asio::const_buffer> const& vec = m_send_buffer.build_iovec(amount_to_send);
 			m_socket->async_write_some(vec, bind(&peer_connection::on_send_data, self(), _1, _2));
+			m_ses.m_send_calls.add(1);
 
 			m_channel_state[upload_channel] = peer_info::bw_network;
 		}
@@ -3142,8 +3277,19 @@ namespace libtorrent
 			return;
 		}
 
+		// the bytes we've already read ahead have to be
+		// handled before we read more
+		if (m_recv_end > m_recv_pos) return;
+
+		compact_recv_buffer();
+
 		TORRENT_ASSERT(m_packet_size > 0);
 		int max_receive = m_packet_size - m_recv_pos;
+		// read as much as fits in the read ahead window, not just the
+		// rest of this message. Except for the payload of piece
+		// messages, which is received straight into the disk buffer
+		if (!m_disk_recv_buffer && max_receive < read_ahead_size && can_read_ahead())
+			max_receive = read_ahead_size;
 		int quota_left = m_bandwidth_limit[download_channel].quota_left();
 		if (!m_ignore_bandwidth_limits && max_receive > quota_left)
 			max_receive = quota_left;
@@ -3165,6 +3311,8 @@ namespace libtorrent
 		if (!m_disk_recv_buffer || regular_buffer_size >= m_recv_pos + max_receive)
 		{
 			// only receive into regular buffer
+			if (int(m_recv_buffer.size()) < m_recv_pos + max_receive)
+				m_recv_buffer.resize(m_recv_pos + max_receive);
 			TORRENT_ASSERT(m_recv_pos + max_receive <= int(m_recv_buffer.size()));
 			m_socket->async_read_some(asio::buffer(&m_recv_buffer[m_recv_pos]
 				, max_receive), bind(&peer_connection::on_receive_data, self(), _1, _2));
@@ -3194,6 +3342,7 @@ namespace libtorrent
 			m_socket->async_read_some(vec, bind(&peer_connection::on_receive_data
 				, self(), _1, _2));
 		}
+		m_ses.m_receive_calls.add(1);
 		m_channel_state[download_channel] = peer_info::bw_network;
 	}
 
@@ -3209,8 +3358,9 @@ namespace libtorrent
 		TORRENT_ASSERT(regular_buffer_size >= 0);
 		if (!m_disk_recv_buffer || regular_buffer_size >= m_recv_pos)
 		{
-			vec.first = buffer::interval(&m_recv_buffer[0]
-				+ m_recv_pos - bytes, &m_recv_buffer[0] + m_recv_pos);
+			char* start = &m_recv_buffer[0] + m_recv_start;
+			vec.first = buffer::interval(start + m_recv_pos - bytes
+				, start + m_recv_pos);
 			vec.second = buffer::interval(0,0);
 		}
 		else if (m_recv_pos - bytes >= regular_buffer_size)
@@ -3224,8 +3374,9 @@ namespace libtorrent
 		{
 			TORRENT_ASSERT(m_recv_pos - bytes < regular_buffer_size);
 			TORRENT_ASSERT(m_recv_pos > regular_buffer_size);
-			vec.first = buffer::interval(&m_recv_buffer[0] + m_recv_pos - bytes
-				, &m_recv_buffer[0] + regular_buffer_size);
+			char* start = &m_recv_buffer[0] + m_recv_start;
+			vec.first = buffer::interval(start + m_recv_pos - bytes
+				, start + regular_buffer_size);
 			vec.second = buffer::interval(m_disk_recv_buffer.get()
 				, m_disk_recv_buffer.get() + m_recv_pos - regular_buffer_size);
 		}
@@ -3242,7 +3393,15 @@ namespace libtorrent
 			cut_receive_buffer(m_packet_size, packet_size);
 			return;
 		}
+		// move the bytes we've read ahead to the front
+		if (m_recv_end > m_recv_pos)
+		{
+			cut_receive_buffer(m_recv_pos, packet_size);
+			return;
+		}
 		m_recv_pos = 0;
+		m_recv_end = 0;
+		m_recv_start = 0;
 		m_packet_size = packet_size;
 	}
 
@@ -3280,6 +3439,27 @@ namespace libtorrent
 		m_ses.m_buffer_usage_logger << log_time() << " send_buffer_alloc: " << size << std::endl;
 		m_ses.log_buffer_usage();
 #endif
+		defer_send();
+	}
+
+	void peer_connection::defer_send()
+	{
+		if (m_send_deferred) return;
+		m_send_deferred = true;
+		m_ses.m_io_service.post(bind(&peer_connection::on_deferred_send, self()));
+	}
+
+	void peer_connection::sent_message()
+	{
+		m_ses.m_sent_messages.add(1);
+	}
+
+	void peer_connection::on_deferred_send()
+	{
+		session_impl::mutex_t::scoped_lock l(m_ses.m_mutex);
+
+		m_send_deferred = false;
+		if (m_disconnecting) return;
 		setup_send();
 	}
 
@@ -3371,22 +3551,43 @@ namespace libtorrent
 			TORRENT_ASSERT(bytes_transferred > 0);
 
 			m_last_receive = time_now();
-			m_recv_pos += bytes_transferred;
-			TORRENT_ASSERT(m_recv_pos <= int(m_recv_buffer.size()
+			m_recv_end += bytes_transferred;
+			TORRENT_ASSERT(m_recv_start == 0);
+			TORRENT_ASSERT(m_recv_end <= int(m_recv_buffer.size()
 				+ m_disk_recv_buffer_size));
 
-			on_receive(error, bytes_transferred);
+			// pass the received bytes on one message at a time. If
+			// we read ahead, this handles all the complete messages
+			// we got from this read
+			while (m_recv_end > m_recv_pos)
+			{
+				int received = (std::min)(m_recv_end, m_packet_size) - m_recv_pos;
+				if (received <= 0) break;
+				m_recv_pos += received;
+				on_receive(error, received);
+				if (m_disconnecting) return;
+				TORRENT_ASSERT(m_packet_size > 0);
+			}
 
-			TORRENT_ASSERT(m_packet_size > 0);
+			// move what's left of the buffer to the front, once
+			// for all the messages handled from this read
+			compact_recv_buffer();
+
+			// the protocol didn't consume all the bytes we read ahead
+			if (m_recv_end > m_recv_pos) break;
 
+			int buffer_size = can_read_ahead()
+				? (std::max)(m_packet_size, int(read_ahead_size)) : m_packet_size;
 			if (m_peer_choked
 				&& m_recv_pos == 0
-				&& (m_recv_buffer.capacity() - m_packet_size) > 128)
+				&& (int(m_recv_buffer.capacity()) - buffer_size) > 128)
 			{
-				buffer(m_packet_size).swap(m_recv_buffer);
+				buffer(buffer_size).swap(m_recv_buffer);
 			}
 
 			max_receive = m_packet_size - m_recv_pos;
+			if (!m_disk_recv_buffer && max_receive < read_ahead_size && can_read_ahead())
+				max_receive = read_ahead_size;
 			int quota_left = m_bandwidth_limit[download_channel].quota_left();
 			if (!m_ignore_bandwidth_limits && max_receive > quota_left)
 				max_receive = quota_left;
@@ -3402,6 +3603,8 @@ namespace libtorrent
 			if (!m_disk_recv_buffer || regular_buffer_size >= m_recv_pos + max_receive)
 			{
 				// only receive into regular buffer
+				if (int(m_recv_buffer.size()) < m_recv_pos + max_receive)
+					m_recv_buffer.resize(m_recv_pos + max_receive);
 				TORRENT_ASSERT(m_recv_pos + max_receive <= int(m_recv_buffer.size()));
 				bytes_transferred = m_socket->read_some(asio::buffer(&m_recv_buffer[m_recv_pos]
 					, max_receive), ec);
@@ -3431,6 +3634,7 @@ namespace libtorrent
 					, max_receive - regular_buffer_size + m_recv_pos));
 				bytes_transferred = m_socket->read_some(vec, ec);
 			}
+			m_ses.m_receive_calls.add(1);
 			if (ec && ec != asio::error::would_block)
 			{
 				disconnect(ec.message().c_str());
@@ -3514,7 +3718,7 @@ namespace libtorrent
 
 		if (t->alerts().should_post<peer_connect_alert>())
 		{
-			t->alerts().post_alert(peer_connect_alert(
+			t->alerts().post_alert_ptr(new peer_connect_alert(
 				t->get_handle(), remote(), pid()));
 		}
 	}
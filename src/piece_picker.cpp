@@ -885,16 +885,12 @@ namespace libtorrent
 		TORRENT_PIECE_PICKER_INVARIANT_CHECK;
 		TORRENT_ASSERT(bitmask.size() == m_piece_map.size());
 
-		int index = 0;
 		bool updated = false;
-		for (bitfield::const_iterator i = bitmask.begin()
-			, end(bitmask.end()); i != end; ++i, ++index)
+		for (int index = bitmask.find_next_set(0); index != -1;
+			index = bitmask.find_next_set(index + 1))
 		{
-			if (*i)
-			{
-				++m_piece_map[index].peer_count;
-				updated = true;
-			}
+			++m_piece_map[index].peer_count;
+			updated = true;
 		}
 
 		if (updated && m_sequential_download == -1) m_dirty = true;
@@ -905,16 +901,12 @@ namespace libtorrent
 		TORRENT_PIECE_PICKER_INVARIANT_CHECK;
 		TORRENT_ASSERT(bitmask.size() == m_piece_map.size());
 
-		int index = 0;
 		bool updated = false;
-		for (bitfield::const_iterator i = bitmask.begin()
-			, end(bitmask.end()); i != end; ++i, ++index)
+		for (int index = bitmask.find_next_set(0); index != -1;
+			index = bitmask.find_next_set(index + 1))
 		{
-			if (*i)
-			{
-				--m_piece_map[index].peer_count;
-				updated = true;
-			}
+			--m_piece_map[index].peer_count;
+			updated = true;
 		}
 
 		if (updated && m_sequential_download == -1) m_dirty = true;
@@ -1144,6 +1136,18 @@ namespace libtorrent
 		}
 	}
 
+	void piece_picker::wanted_pieces(bitfield& bits) const
+	{
+		bits.resize(m_piece_map.size(), false);
+		int index = 0;
+		for (std::vector<piece_pos>::const_iterator i = m_piece_map.begin(),
+			end(m_piece_map.end()); i != end; ++i, ++index)
+		{
+			if (i->have() || i->filtered()) continue;
+			bits.set_bit(index);
+		}
+	}
+
 	// ============ start deprecation ==============
 
 	void piece_picker::filtered_pieces(std::vector<bool>& mask) const
@@ -1218,8 +1222,8 @@ namespace libtorrent
 
 		if (m_sequential_download >= 0)
 		{
-			for (int i = m_sequential_download;
-				i < int(m_piece_map.size()) && num_blocks > 0; ++i)
+			for (int i = pieces.find_next_set(m_sequential_download);
+				i != -1 && num_blocks > 0; i = pieces.find_next_set(i + 1))
 			{
 				if (!can_pick(i, pieces)) continue;
 				int num_blocks_in_piece = blocks_in_piece(i);
@@ -357,14 +357,14 @@ namespace libtorrent
 			{
 				i->second.connection->disconnect("peer banned by IP filter");
 				if (ses.m_alerts.should_post<peer_blocked_alert>())
-					ses.m_alerts.post_alert(peer_blocked_alert(i->second.addr));
+					ses.m_alerts.post_alert_ptr(new peer_blocked_alert(i->second.addr));
 				TORRENT_ASSERT(i->second.connection == 0
 					|| i->second.connection->peer_info_struct() == 0);
 			}
 			else
 			{
 				if (ses.m_alerts.should_post<peer_blocked_alert>())
-					ses.m_alerts.post_alert(peer_blocked_alert(i->second.addr));
+					ses.m_alerts.post_alert_ptr(new peer_blocked_alert(i->second.addr));
 			}
 			erase_peer(i++);
 		}
@@ -745,7 +745,7 @@ namespace libtorrent
 		if (pf.access(remote.port()) & port_filter::blocked)
 		{
 			if (ses.m_alerts.should_post<peer_blocked_alert>())
-				ses.m_alerts.post_alert(peer_blocked_alert(remote.address()));
+				ses.m_alerts.post_alert_ptr(new peer_blocked_alert(remote.address()));
 			return 0;
 		}
 
@@ -769,7 +769,7 @@ namespace libtorrent
 			{
 				if (ses.m_alerts.should_post<peer_blocked_alert>())
 				{
-					ses.m_alerts.post_alert(peer_blocked_alert(remote.address()));
+					ses.m_alerts.post_alert_ptr(new peer_blocked_alert(remote.address()));
 				}
 				return 0;
 			}
@@ -0,0 +1,224 @@
+/*
+
+Copyright (c) 2008, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include <boost/bind.hpp>
+#include "libtorrent/resolver.hpp"
+#include "libtorrent/assert.hpp"
+
+namespace
+{
+	enum
+	{
+		// when the cache grows beyond this many entries,
+		// expired ones are swept out
+		max_cache_entries = 1000
+	};
+}
+
+namespace libtorrent
+{
+
+	resolver::resolver(io_service& ios, int success_ttl, int failure_ttl)
+		: m_ios(ios)
+		, m_resolver(ios)
+		, m_success_ttl(seconds(success_ttl))
+		, m_failure_ttl(seconds(failure_ttl))
+		, m_num_lookups(0)
+		, m_num_cache_hits(0)
+		, m_next_lookup_id(0)
+	{}
+
+	void resolver::async_resolve(std::string const& host, callback_t const& h
+		, void const* owner)
+	{
+		mutex_t::scoped_lock l(m_mutex);
+
+		pending_handler ph = {h, owner};
+		++m_num_lookups;
+		ptime now = time_now();
+
+		cache_t::iterator i = m_cache.find(host);
+		if (i != m_cache.end())
+		{
+			dns_cache_entry& e = i->second;
+			if (e.pending)
+			{
+				// there's already a lookup in progress for this
+				// host name, just wait for it to complete
+				++m_num_cache_hits;
+				e.handlers.push_back(ph);
+				return;
+			}
+			if (e.expires > now)
+			{
+				++m_num_cache_hits;
+				m_ios.post(boost::bind(h, e.error, e.addresses));
+				return;
+			}
+			m_cache.erase(i);
+		}
+
+		if (int(m_cache.size()) >= max_cache_entries)
+		{
+			// first sweep out the expired entries. If that's not
+			// enough, drop everything that isn't being looked up
+			for (cache_t::iterator j = m_cache.begin(); j != m_cache.end();)
+			{
+				if (!j->second.pending && j->second.expires <= now)
+					m_cache.erase(j++);
+				else
+					++j;
+			}
+			if (int(m_cache.size()) >= max_cache_entries)
+			{
+				for (cache_t::iterator j = m_cache.begin(); j != m_cache.end();)
+				{
+					if (!j->second.pending) m_cache.erase(j++);
+					else ++j;
+				}
+			}
+		}
+
+		dns_cache_entry& e = m_cache[host];
+		e.handlers.push_back(ph);
+		e.lookup_id = m_next_lookup_id++;
+
+		tcp::resolver::query q(host, "0");
+		m_resolver.async_resolve(q, boost::bind(&resolver::on_lookup
+			, this, _1, _2, host, e.lookup_id));
+	}
+
+	void resolver::on_lookup(error_code const& e, tcp::resolver::iterator i
+		, std::string host, int lookup_id)
+	{
+		mutex_t::scoped_lock l(m_mutex);
+
+		cache_t::iterator c = m_cache.find(host);
+		if (c == m_cache.end() || !c->second.pending
+			|| c->second.lookup_id != lookup_id) return;
+
+		std::vector<pending_handler> handlers;
+		handlers.swap(c->second.handlers);
+
+		std::vector<address> addresses;
+		for (; i != tcp::resolver::iterator(); ++i)
+			addresses.push_back(i->endpoint().address());
+
+		// handlers can rely on getting at least one address
+		// whenever there's no error
+		error_code ec = e;
+		if (!ec && addresses.empty()) ec = asio::error::host_not_found;
+
+		if (ec == asio::error::operation_aborted)
+		{
+			// don't remember lookups that never completed
+			m_cache.erase(c);
+		}
+		else
+		{
+			dns_cache_entry& entry = c->second;
+			entry.pending = false;
+			entry.error = ec;
+			entry.addresses = addresses;
+			entry.expires = time_now() + (ec ? m_failure_ttl : m_success_ttl);
+		}
+		l.unlock();
+
+		for (std::vector<pending_handler>::iterator h = handlers.begin()
+			, end(handlers.end()); h != end; ++h)
+			h->handler(ec, addresses);
+	}
+
+	void resolver::cancel()
+	{
+		mutex_t::scoped_lock l(m_mutex);
+		m_resolver.cancel();
+
+		// the system resolver may not return until its lookup
+		// completes, even when it's cancelled. Fail the handlers
+		// right away, so that they don't keep the objects they're
+		// bound to alive until then. on_lookup() ignores lookups
+		// that are no longer in the cache
+		for (cache_t::iterator i = m_cache.begin(), end(m_cache.end()); i != end; ++i)
+		{
+			std::vector<pending_handler>& handlers = i->second.handlers;
+			for (std::vector<pending_handler>::iterator h = handlers.begin();
+				h != handlers.end(); ++h)
+			{
+				m_ios.post(boost::bind(h->handler
+					, error_code(asio::error::operation_aborted), std::vector<address>()));
+			}
+		}
+		m_cache.clear();
+	}
+
+	void resolver::cancel(void const* owner)
+	{
+		TORRENT_ASSERT(owner != 0);
+		mutex_t::scoped_lock l(m_mutex);
+
+		for (cache_t::iterator i = m_cache.begin(), end(m_cache.end()); i != end; ++i)
+		{
+			std::vector<pending_handler>& handlers = i->second.handlers;
+			for (std::vector<pending_handler>::iterator h = handlers.begin();
+				h != handlers.end();)
+			{
+				if (h->owner != owner)
+				{
+					++h;
+					continue;
+				}
+				m_ios.post(boost::bind(h->handler
+					, error_code(asio::error::operation_aborted), std::vector<address>()));
+				h = handlers.erase(h);
+			}
+		}
+		// the lookups themselves are left running, since other
+		// handlers may be waiting for them, and the result is
+		// still worth caching
+	}
+
+	int resolver::num_lookups() const
+	{
+		mutex_t::scoped_lock l(m_mutex);
+		return m_num_lookups;
+	}
+
+	int resolver::num_cache_hits() const
+	{
+		mutex_t::scoped_lock l(m_mutex);
+		return m_num_cache_hits;
+	}
+
+}
+
@@ -233,6 +233,17 @@ namespace libtorrent
 	{
 		return m_impl->get_torrents();
 	}
+
+	void session::get_torrent_status(std::vector<torrent_status>* ret
+		, boost::function<bool(torrent_status const&)> const& pred) const
+	{
+		m_impl->get_torrent_status(ret, pred);
+	}
+
+	void session::get_updated_torrent_status(std::vector<torrent_status>* ret)
+	{
+		m_impl->get_updated_torrent_status(ret);
+	}
 	
 	torrent_handle session::find_torrent(sha1_hash const& info_hash) const
 	{
@@ -510,6 +521,16 @@ namespace libtorrent
 		return m_impl->pop_alert();
 	}
 
+	void session::pop_alerts(std::vector<alert*>* alerts)
+	{
+		m_impl->pop_alerts(alerts);
+	}
+
+	int session::set_alert_queue_size_limit(int queue_size_limit_)
+	{
+		return m_impl->set_alert_queue_size_limit(queue_size_limit_);
+	}
+
 	alert const* session::wait_for_alert(time_duration max_wait)
 	{
 		return m_impl->wait_for_alert(max_wait);
@@ -78,6 +78,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #ifndef TORRENT_WINDOWS
 #include <sys/resource.h>
+#include <sys/stat.h>
 #endif
 
 #ifndef TORRENT_DISABLE_ENCRYPTION
@@ -106,6 +107,34 @@ using boost::bind;
 using boost::mutex;
 using libtorrent::aux::session_impl;
 
+namespace
+{
+	// returns an identifier of the storage device the path
+	// is on. Torrents on the same device are not checked
+	// concurrently, since they would just compete for seeks
+	std::string storage_device(boost::filesystem::path p)
+	{
+#ifdef TORRENT_WINDOWS
+		return p.root_name();
+#else
+		struct stat st;
+		// the save path may not exist yet, in which case
+		// the files will end up on its closest existing parent
+		while (stat(p.string().c_str(), &st) != 0)
+		{
+#if BOOST_VERSION < 103600
+			if (!p.has_branch_path()) return std::string();
+			p = p.branch_path();
+#else
+			if (!p.has_parent_path()) return std::string();
+			p = p.parent_path();
+#endif
+		}
+		return boost::lexical_cast<std::string>(st.st_dev);
+#endif
+	}
+}
+
 namespace libtorrent {
 
 namespace fs = boost::filesystem;
@@ -148,13 +177,14 @@ namespace aux {
 		, m_io_service()
 		, m_disk_thread(m_io_service)
 		, m_half_open(m_io_service)
+		, m_host_resolver(m_io_service)
 		, m_download_channel(m_io_service, peer_connection::download_channel)
 #ifdef TORRENT_VERBOSE_BANDWIDTH_LIMIT
 		, m_upload_channel(m_io_service, peer_connection::upload_channel, true)
 #else
 		, m_upload_channel(m_io_service, peer_connection::upload_channel)
 #endif
-		, m_tracker_manager(m_settings, m_tracker_proxy)
+		, m_tracker_manager(m_settings, m_tracker_proxy, m_host_resolver)
 		, m_listen_port_retries(listen_port_range.second - listen_port_range.first)
 		, m_listen_interface(address::from_string(listen_interface), listen_port_range.first)
 		, m_abort(false)
@@ -192,6 +222,10 @@ namespace aux {
 		m_tcp_mapping[1] = -1;
 		m_udp_mapping[0] = -1;
 		m_udp_mapping[1] = -1;
+#ifndef TORRENT_DISABLE_GEO_IP
+		std::memset(m_as_cache, 0, sizeof(m_as_cache));
+		std::memset(m_country_cache, 0, sizeof(m_country_cache));
+#endif
 #ifdef WIN32
 		// windows XP has a limit on the number of
 		// simultaneous half-open TCP connections
@@ -284,33 +318,78 @@ namespace aux {
 			free_ptr(void* p): ptr_(p) {}
 			~free_ptr() { free(ptr_); }
 		};
+
+		// the slot in the GeoIP caches for the given address
+		int geoip_cache_slot(unsigned long ip)
+		{
+			// multiplicative hashing, spreads neighbouring
+			// addresses over the table. The high bits of the
+			// product depend on every bit of the address, the
+			// low ones only on the low bits of the address, so
+			// the top 10 bits are used as the slot
+			return (ip * 2654435761UL & 0xffffffff) >> 22;
+		}
+
+		// the flags the GeoIP databases are opened with. The
+		// database is a binary trie over the address bits, this
+		// keeps it in memory instead of reading it from the file
+		// for every lookup. When mapped, it is shared by every
+		// process that has the same database open
+		int geoip_open_flags()
+		{
+#ifdef WIN32
+			return GEOIP_MEMORY_CACHE;
+#else
+			return GEOIP_MMAP_CACHE;
+#endif
+		}
 	}
 
 	char const* session_impl::country_for_ip(address const& a)
 	{
 		if (!a.is_v4() || m_country_db == 0) return 0;
-		return GeoIP_country_code_by_ipnum(m_country_db, a.to_v4().to_ulong());
+		unsigned long ip = a.to_v4().to_ulong();
+		country_cache_entry& e = m_country_cache[geoip_cache_slot(ip)];
+		if (e.ip == ip && ip != 0) return e.country;
+		e.ip = ip;
+		e.country = GeoIP_country_code_by_ipnum(m_country_db, ip);
+		return e.country;
 	}
 
 	int session_impl::as_for_ip(address const& a)
 	{
 		if (!a.is_v4() || m_asnum_db == 0) return 0;
-		char* name = GeoIP_name_by_ipnum(m_asnum_db, a.to_v4().to_ulong());
-		if (name == 0) return 0;
-		free_ptr p(name);
-		// GeoIP returns the name as AS??? where ? is the AS-number
-		return atoi(name + 2);
+		unsigned long ip = a.to_v4().to_ulong();
+		as_cache_entry& e = m_as_cache[geoip_cache_slot(ip)];
+		if (e.ip == ip && ip != 0) return e.as;
+
+		char* name = GeoIP_name_by_ipnum(m_asnum_db, ip);
+		int as = 0;
+		if (name != 0)
+		{
+			free_ptr p(name);
+			// GeoIP returns the name as AS??? where ? is the AS-number
+			as = atoi(name + 2);
+			std::map<int, std::string>::iterator i = m_as_names.lower_bound(as);
+			if (i == m_as_names.end() || i->first != as)
+			{
+				char* tmp = std::strchr(name, ' ');
+				m_as_names.insert(i, std::make_pair(as
+					, tmp == 0 ? std::string() : std::string(tmp + 1)));
+			}
+		}
+		e.ip = ip;
+		e.as = as;
+		return as;
 	}
 
 	std::string session_impl::as_name_for_ip(address const& a)
 	{
-		if (!a.is_v4() || m_asnum_db == 0) return std::string();
-		char* name = GeoIP_name_by_ipnum(m_asnum_db, a.to_v4().to_ulong());
-		if (name == 0) return std::string();
-		free_ptr p(name);
-		char* tmp = std::strchr(name, ' ');
-		if (tmp == 0) return std::string();
-		return tmp + 1;
+		int as = as_for_ip(a);
+		if (as == 0) return std::string();
+		std::map<int, std::string>::const_iterator i = m_as_names.find(as);
+		if (i == m_as_names.end()) return std::string();
+		return i->second;
 	}
 
 	std::pair<const int, int>* session_impl::lookup_as(int as)
@@ -329,7 +408,9 @@ namespace aux {
 	{
 		mutex_t::scoped_lock l(m_mutex);
 		if (m_asnum_db) GeoIP_delete(m_asnum_db);
-		m_asnum_db = GeoIP_open(file, GEOIP_STANDARD);
+		m_asnum_db = GeoIP_open(file, geoip_open_flags());
+		std::memset(m_as_cache, 0, sizeof(m_as_cache));
+		m_as_names.clear();
 		return m_asnum_db;
 	}
 
@@ -337,7 +418,8 @@ namespace aux {
 	{
 		mutex_t::scoped_lock l(m_mutex);
 		if (m_country_db) GeoIP_delete(m_country_db);
-		m_country_db = GeoIP_open(file, GEOIP_STANDARD);
+		m_country_db = GeoIP_open(file, geoip_open_flags());
+		std::memset(m_country_cache, 0, sizeof(m_country_cache));
 		return m_country_db;
 	}
 
@@ -465,6 +547,11 @@ namespace aux {
 #endif
 		m_tracker_manager.abort_all_requests();
 
+		// the shared resolver is not cancelled here. The torrents
+		// and the DHT have already cancelled the lookups they own,
+		// the ones left are for the event=stopped announces, which
+		// still need to reach their trackers
+
 #if defined(TORRENT_VERBOSE_LOGGING) || defined(TORRENT_LOGGING)
 		(*m_logger) << time_now_string() << " sending event=stopped to trackers\n";
 		int counter = 0;
@@ -515,6 +602,7 @@ namespace aux {
 		INVARIANT_CHECK;
 
 		m_ip_filter = f;
+		m_ip_filter.compile();
 
 		// Close connections whose endpoint is filtered
 		// by the new ip-filter
@@ -548,6 +636,7 @@ namespace aux {
  		if (m_settings.connection_speed <= 0) m_settings.connection_speed = 200;
  
 		m_files.resize(m_settings.file_pool_size);
+		m_files.set_no_buffer(m_settings.disable_os_cache);
 		if (!s.auto_upload_slots) m_allowed_upload_slots = m_max_uploads;
 		// replace all occurances of '\n' with ' '.
 		std::string::iterator i = m_settings.user_agent.begin();
@@ -591,7 +680,7 @@ namespace aux {
 		{
 			// not even that worked, give up
 			if (m_alerts.should_post<listen_failed_alert>())
-				m_alerts.post_alert(listen_failed_alert(ep, ec));
+				m_alerts.post_alert_ptr(new listen_failed_alert(ep, ec));
 #if defined(TORRENT_VERBOSE_LOGGING) || defined(TORRENT_LOGGING)
 			std::stringstream msg;
 			msg << "cannot bind to interface '";
@@ -605,7 +694,7 @@ namespace aux {
 		if (ec)
 		{
 			if (m_alerts.should_post<listen_failed_alert>())
-				m_alerts.post_alert(listen_failed_alert(ep, ec));
+				m_alerts.post_alert_ptr(new listen_failed_alert(ep, ec));
 #if defined(TORRENT_VERBOSE_LOGGING) || defined(TORRENT_LOGGING)
 			std::stringstream msg;
 			msg << "cannot listen on interface '";
@@ -616,7 +705,7 @@ namespace aux {
 		}
 
 		if (m_alerts.should_post<listen_succeeded_alert>())
-			m_alerts.post_alert(listen_succeeded_alert(ep));
+			m_alerts.post_alert_ptr(new listen_succeeded_alert(ep));
 
 #if defined(TORRENT_VERBOSE_LOGGING) || defined(TORRENT_LOGGING)
 		(*m_logger) << "listening on: " << ep
@@ -743,7 +832,7 @@ namespace aux {
 				m_dht->on_unreachable(ep);
 
 			if (m_alerts.should_post<udp_error_alert>())
-				m_alerts.post_alert(udp_error_alert(ep, e));
+				m_alerts.post_alert_ptr(new udp_error_alert(ep, e));
 			return;
 		}
 
@@ -804,7 +893,7 @@ namespace aux {
 			}
 #endif
 			if (m_alerts.should_post<listen_failed_alert>())
-				m_alerts.post_alert(listen_failed_alert(ep, e));
+				m_alerts.post_alert_ptr(new listen_failed_alert(ep, e));
 			return;
 		}
 		async_accept(listener);
@@ -838,7 +927,7 @@ namespace aux {
 			(*m_logger) << "filtered blocked ip\n";
 #endif
 			if (m_alerts.should_post<peer_blocked_alert>())
-				m_alerts.post_alert(peer_blocked_alert(endp.address()));
+				m_alerts.post_alert_ptr(new peer_blocked_alert(endp.address()));
 			return;
 		}
 
@@ -889,7 +978,7 @@ namespace aux {
 
 		if (!c->is_disconnecting())
 		{
-			m_connections.insert(c);
+			m_connections.push_back(c.get());
 			c->start();
 		}
 	}
@@ -915,12 +1004,7 @@ namespace aux {
 		TORRENT_ASSERT(p->is_disconnecting());
 
 		if (!p->is_choked()) --m_num_unchoked;
-//		connection_map::iterator i = std::lower_bound(m_connections.begin(), m_connections.end()
-//			, p, bind(&boost::intrusive_ptr<peer_connection>::get, _1) < p);
-//		if (i->get() != p) i == m_connections.end();
-		connection_map::iterator i = std::find_if(m_connections.begin(), m_connections.end()
-			, bind(&boost::intrusive_ptr<peer_connection>::get, _1) == p);
-		if (i != m_connections.end()) m_connections.erase(i);
+		if (m_connections.contains(p)) m_connections.erase(p);
 	}
 
 	void session_impl::set_peer_id(peer_id const& id)
@@ -1019,7 +1103,7 @@ namespace aux {
 		for (connection_map::iterator i = m_connections.begin();
 			i != m_connections.end();)
 		{
-			peer_connection* p = (*i).get();
+			peer_connection* p = *i;
 			++i;
 			// ignore connections that already have a torrent, since they
 			// are ticket through the torrents' second_ticket
@@ -1088,6 +1172,10 @@ namespace aux {
 		m_upload_channel.drain(m_stat.upload_ip_overhead());
 
 		m_stat.second_tick(tick_interval);
+		m_sent_messages.second_tick(tick_interval);
+		m_received_messages.second_tick(tick_interval);
+		m_send_calls.second_tick(tick_interval);
+		m_receive_calls.second_tick(tick_interval);
 
 		// --------------------------------------------------------------
 		// scrape paused torrents that are auto managed
@@ -1395,7 +1483,7 @@ namespace aux {
 		for (connection_map::iterator i = m_connections.begin()
 			, end(m_connections.end()); i != end; ++i)
 		{
-			peer_connection* p = i->get();
+			peer_connection* p = *i;
 			torrent* t = p->associated_torrent().lock().get();
 			if (!p->peer_info_struct()
 				|| t == 0
@@ -1418,7 +1506,7 @@ namespace aux {
 				}
 				continue;
 			}
-			peers.push_back(i->get());
+			peers.push_back(p);
 		}
 
 		// sorts the peers that are eligible for unchoke by download rate and secondary
@@ -1509,7 +1597,7 @@ namespace aux {
 			for (connection_map::iterator i = m_connections.begin()
 				, end(m_connections.end()); i != end; ++i)
 			{
-				peer_connection* p = i->get();
+				peer_connection* p = *i;
 				TORRENT_ASSERT(p);
 				policy::peer* pi = p->peer_info_struct();
 				if (!pi) continue;
@@ -1543,7 +1631,7 @@ namespace aux {
 					torrent* t = (*current_optimistic_unchoke)->associated_torrent().lock().get();
 					TORRENT_ASSERT(t);
 					(*current_optimistic_unchoke)->peer_info_struct()->optimistically_unchoked = false;
-					t->choke_peer(*current_optimistic_unchoke->get());
+					t->choke_peer(**current_optimistic_unchoke);
 				}
 				else
 				{
@@ -1552,7 +1640,7 @@ namespace aux {
 
 				torrent* t = (*optimistic_unchoke_candidate)->associated_torrent().lock().get();
 				TORRENT_ASSERT(t);
-				bool ret = t->unchoke_peer(*optimistic_unchoke_candidate->get());
+				bool ret = t->unchoke_peer(**optimistic_unchoke_candidate);
 				TORRENT_ASSERT(ret);
 				(*optimistic_unchoke_candidate)->peer_info_struct()->optimistically_unchoked = true;
 			}
@@ -1658,6 +1746,39 @@ namespace aux {
 		return ret;
 	}
 
+	void session_impl::get_torrent_status(std::vector<torrent_status>* ret
+		, boost::function<bool(torrent_status const&)> const& pred) const
+	{
+		mutex_t::scoped_lock l(m_mutex);
+
+		for (session_impl::torrent_map::const_iterator i
+			= m_torrents.begin(), end(m_torrents.end());
+			i != end; ++i)
+		{
+			if (i->second->is_aborted()) continue;
+			torrent_status st = i->second->status();
+			if (pred && !pred(st)) continue;
+			ret->push_back(st);
+		}
+	}
+
+	void session_impl::get_updated_torrent_status(std::vector<torrent_status>* ret)
+	{
+		mutex_t::scoped_lock l(m_mutex);
+
+		for (std::vector<boost::weak_ptr<torrent> >::iterator i
+			= m_state_updates.begin(), end(m_state_updates.end());
+			i != end; ++i)
+		{
+			boost::shared_ptr<torrent> t = i->lock();
+			if (!t) continue;
+			t->clear_in_state_update();
+			if (t->is_aborted()) continue;
+			ret->push_back(t->status());
+		}
+		m_state_updates.clear();
+	}
+
 	torrent_handle session_impl::find_torrent_handle(sha1_hash const& info_hash)
 	{
 		return torrent_handle(find_torrent(info_hash));
@@ -1769,24 +1890,82 @@ namespace aux {
 	void session_impl::check_torrent(boost::shared_ptr<torrent> const& t)
 	{
 		if (m_abort) return;
-		if (m_queued_for_checking.empty()) t->start_checking();
-		m_queued_for_checking.push_back(t);
+		check_queue_entry e;
+		e.t = t;
+		e.save_path = t->save_path();
+		e.device = storage_device(e.save_path);
+		m_queued_for_checking.push_back(e);
+		start_checking_torrents();
 	}
 
 	void session_impl::done_checking(boost::shared_ptr<torrent> const& t)
 	{
-		if (m_queued_for_checking.empty()) return;
-		check_queue_t::iterator next_check = m_queued_for_checking.begin();
-		check_queue_t::iterator done = m_queued_for_checking.end();
-		for (check_queue_t::iterator i = m_queued_for_checking.begin()
-			, end(m_queued_for_checking.end()); i != end; ++i)
+		check_queue_t::iterator done = m_queued_for_checking.begin();
+		for (; done != m_queued_for_checking.end(); ++done)
+			if (done->t == t) break;
+		if (done == m_queued_for_checking.end()) return;
+		m_queued_for_checking.erase(done);
+		start_checking_torrents();
+	}
+
+	std::string const& session_impl::check_device(check_queue_entry& e)
+	{
+		// the path only changes if the torrent's storage
+		// is moved while it's queued
+		if (e.save_path != e.t->save_path())
+		{
+			e.save_path = e.t->save_path();
+			e.device = storage_device(e.save_path);
+		}
+		return e.device;
+	}
+
+	void session_impl::start_checking_torrents()
+	{
+		if (m_abort) return;
+
+		// the devices that already have a torrent being checked
+		std::set<std::string> busy_devices;
+		int num_checking = 0;
+		for (check_queue_t::iterator i = m_queued_for_checking.begin();
+			i != m_queued_for_checking.end();)
 		{
-			if (*i == t) done = i;
-			if (next_check == done || (*next_check)->queue_position() > (*i)->queue_position())
+			// torrents that were removed while waiting
+			// will never be checked
+			if (i->t->is_aborted())
+			{
+				m_queued_for_checking.erase(i++);
+				continue;
+			}
+			if (i->t->state() == torrent_status::checking_files)
+			{
+				++num_checking;
+				busy_devices.insert(check_device(*i));
+			}
+			++i;
+		}
+
+		int limit = (std::max)(m_settings.active_checking, 1);
+		while (num_checking < limit)
+		{
+			// pick the torrent first in the queue order, that's
+			// on a device that isn't being checked already
+			check_queue_t::iterator next_check = m_queued_for_checking.end();
+			for (check_queue_t::iterator i = m_queued_for_checking.begin()
+				, end(m_queued_for_checking.end()); i != end; ++i)
+			{
+				if (i->t->state() == torrent_status::checking_files) continue;
+				if (next_check != m_queued_for_checking.end()
+					&& next_check->t->queue_position() <= i->t->queue_position())
+					continue;
+				if (busy_devices.count(check_device(*i))) continue;
 				next_check = i;
+			}
+			if (next_check == m_queued_for_checking.end()) break;
+			busy_devices.insert(next_check->device);
+			++num_checking;
+			next_check->t->start_checking();
 		}
-		if (next_check != done) (*next_check)->start_checking();
-		m_queued_for_checking.erase(done);
 	}
 
 	void session_impl::remove_torrent(const torrent_handle& h, int options)
@@ -1924,7 +2103,7 @@ namespace aux {
 			m_external_udp_port = port;
 			m_dht_settings.service_port = port;
 			if (m_alerts.should_post<portmap_alert>())
-				m_alerts.post_alert(portmap_alert(mapping, port
+				m_alerts.post_alert_ptr(new portmap_alert(mapping, port
 					, map_transport));
 			return;
 		}
@@ -1935,7 +2114,7 @@ namespace aux {
 			if (!m_listen_sockets.empty())
 				m_listen_sockets.front().external_port = port;
 			if (m_alerts.should_post<portmap_alert>())
-				m_alerts.post_alert(portmap_alert(mapping, port
+				m_alerts.post_alert_ptr(new portmap_alert(mapping, port
 					, map_transport));
 			return;
 		}
@@ -1943,13 +2122,13 @@ namespace aux {
 		if (!errmsg.empty())
 		{
 			if (m_alerts.should_post<portmap_error_alert>())
-				m_alerts.post_alert(portmap_error_alert(mapping
+				m_alerts.post_alert_ptr(new portmap_error_alert(mapping
 					, map_transport, errmsg));
 		}
 		else
 		{
 			if (m_alerts.should_post<portmap_alert>())
-				m_alerts.post_alert(portmap_alert(mapping, port
+				m_alerts.post_alert_ptr(new portmap_alert(mapping, port
 					, map_transport));
 		}
 	}
@@ -1972,6 +2151,14 @@ namespace aux {
 		s.up_bandwidth_queue = m_upload_channel.queue_size();
 		s.down_bandwidth_queue = m_download_channel.queue_size();
 
+		s.dns_lookups = m_host_resolver.num_lookups();
+		s.dns_cache_hits = m_host_resolver.num_cache_hits();
+
+		s.sent_message_rate = m_sent_messages.rate();
+		s.received_message_rate = m_received_messages.rate();
+		s.send_call_rate = m_send_calls.rate();
+		s.receive_call_rate = m_receive_calls.rate();
+
 		s.has_incoming_connections = m_incoming_connection;
 
 		s.download_rate = m_stat.download_rate();
@@ -2046,7 +2233,8 @@ namespace aux {
 				, m_dht_settings.service_port
 				, m_dht_settings.service_port);
 		}
-		m_dht = new dht::dht_tracker(m_dht_socket, m_dht_settings, startup_state);
+		m_dht = new dht::dht_tracker(m_dht_socket, m_dht_settings
+			, m_host_resolver, startup_state);
 		if (!m_dht_socket.is_open() || m_dht_socket.local_port() != m_dht_settings.service_port)
 		{
 			m_dht_socket.bind(m_dht_settings.service_port);
@@ -2245,6 +2433,19 @@ namespace aux {
 			return m_alerts.get();
 		return std::auto_ptr<alert>(0);
 	}
+
+	void session_impl::pop_alerts(std::vector<alert*>* alerts)
+	{
+		// the alert_manager has its own mutex, there's no need
+		// to hold the session lock (and stall the network thread)
+		// while draining the queue
+		m_alerts.get_all(*alerts);
+	}
+
+	int session_impl::set_alert_queue_size_limit(int queue_size_limit_)
+	{
+		return m_alerts.set_alert_queue_size_limit(queue_size_limit_);
+	}
 	
 	alert const* session_impl::wait_for_alert(time_duration max_wait)
 	{
@@ -2382,7 +2583,7 @@ namespace aux {
 
 		m_external_address = ip;
 		if (m_alerts.should_post<external_ip_alert>())
-			m_alerts.post_alert(external_ip_alert(ip));
+			m_alerts.post_alert_ptr(new external_ip_alert(ip));
 	}
 
 	void session_impl::free_disk_buffer(char* buf)
@@ -2468,7 +2669,7 @@ namespace aux {
 			TORRENT_ASSERT(*i);
 			boost::shared_ptr<torrent> t = (*i)->associated_torrent().lock();
 
-			peer_connection* p = i->get();
+			peer_connection* p = *i;
 			TORRENT_ASSERT(!p->is_disconnecting());
 			if (!p->is_choked()) ++unchokes;
 			if (p->peer_info_struct()
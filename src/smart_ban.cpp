@@ -46,6 +46,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <vector>
 #include <map>
+#include <list>
 #include <utility>
 #include <numeric>
 #include <cstdio>
@@ -66,8 +67,14 @@ namespace libtorrent { namespace
 
 	struct smart_ban_plugin : torrent_plugin, boost::enable_shared_from_this<smart_ban_plugin>
 	{
+		// the max number of block CRCs kept at any time. Once
+		// this is exceeded, the pieces that failed the longest
+		// time ago are forgotten first
+		enum { max_stored_blocks = 64 * 1024 };
+
 		smart_ban_plugin(torrent& t)
 			: m_torrent(t)
+			, m_num_blocks(0)
 			, m_salt(rand())
 		{
 		}
@@ -76,48 +83,41 @@ namespace libtorrent { namespace
 		{
 #ifdef TORRENT_LOGGING
 			(*m_torrent.session().m_logger) << time_now_string() << " PIECE PASS [ p: " << p
-				<< " | block_crc_size: " << m_block_crc.size() << " ]\n";
+				<< " | block_crc_size: " << m_num_blocks << " ]\n";
 #endif
 			// has this piece failed earlier? If it has, go through the
 			// CRCs from the time it failed and ban the peers that
 			// sent bad blocks
-			std::map<piece_block, block_entry>::iterator i = m_block_crc.lower_bound(piece_block(p, 0));
-			if (i == m_block_crc.end() || i->first.piece_index != p) return;
+			std::map<int, piece_entry>::iterator i = m_piece_crc.find(p);
+			if (i == m_piece_crc.end()) return;
 
+			std::vector<block_entry> const& blocks = i->second.blocks;
 			int size = m_torrent.torrent_file().piece_size(p);
 			peer_request r = {p, 0, (std::min)(16*1024, size)};
-			piece_block pb(p, 0);
-			while (size > 0)
+			for (int k = 0; k < int(blocks.size()); ++k)
 			{
-				if (i->first.block_index == pb.block_index)
+				block_entry const& e = blocks[k];
+				// there's no point in reading back the block if the
+				// peer that sent it is already banned or gone
+				if (e.peer != 0 && !e.peer->banned
+					&& m_torrent.get_policy().has_peer(e.peer))
 				{
 					m_torrent.filesystem().async_read(r, bind(&smart_ban_plugin::on_read_ok_block
-						, shared_from_this(), *i, _1, _2));
-					m_block_crc.erase(i++);
-				}
-				else
-				{
-					TORRENT_ASSERT(i->first.block_index > pb.block_index);
+						, shared_from_this(), piece_block(p, k), e, _1, _2));
 				}
 
-				if (i == m_block_crc.end() || i->first.piece_index != p)
-					break;
-
 				r.start += 16*1024;
 				size -= 16*1024;
 				r.length = (std::min)(16*1024, size);
-				++pb.block_index;
 			}
 
-#ifndef NDEBUG
-			// make sure we actually removed all the entries for piece 'p'
-			i = m_block_crc.lower_bound(piece_block(p, 0));
-			TORRENT_ASSERT(i == m_block_crc.end() || i->first.piece_index != p);
-#endif
+			erase_piece(i);
 
 			if (m_torrent.is_seed())
 			{
-				std::map<piece_block, block_entry>().swap(m_block_crc);
+				std::map<int, piece_entry>().swap(m_piece_crc);
+				m_fail_order.clear();
+				m_num_blocks = 0;
 				return;
 			}
 		}
@@ -140,10 +140,11 @@ namespace libtorrent { namespace
 			for (std::vector<void*>::iterator i = downloaders.begin()
 				, end(downloaders.end()); i != end; ++i)
 			{
-				if (*i != 0)
+				policy::peer* peer = (policy::peer*)*i;
+				if (peer != 0 && !peer->banned)
 				{
 					m_torrent.filesystem().async_read(r, bind(&smart_ban_plugin::on_read_failed_block
-						, shared_from_this(), pb, (policy::peer*)*i, _1, _2));
+						, shared_from_this(), pb, peer, _1, _2));
 				}
 
 				r.start += 16*1024;
@@ -157,13 +158,60 @@ namespace libtorrent { namespace
 	private:
 
 		// this entry ties a specific block CRC to
-		// a peer.
+		// a peer. A peer of 0 means there is no
+		// CRC recorded for the block
 		struct block_entry
 		{
 			policy::peer* peer;
-			unsigned long crc;
+			boost::uint32_t crc;
+		};
+
+		// the block CRCs of one failed piece, indexed
+		// by block index
+		struct piece_entry
+		{
+			std::vector<block_entry> blocks;
+			// this piece's position in m_fail_order
+			std::list<int>::iterator fail_order;
 		};
 
+		void erase_piece(std::map<int, piece_entry>::iterator i)
+		{
+			m_num_blocks -= int(i->second.blocks.size());
+			TORRENT_ASSERT(m_num_blocks >= 0);
+			m_fail_order.erase(i->second.fail_order);
+			m_piece_crc.erase(i);
+		}
+
+		// returns the entry for piece p, adding an
+		// empty one if it doesn't exist. Evicts the
+		// oldest pieces if this makes the table exceed
+		// max_stored_blocks
+		piece_entry& piece_crcs(int p)
+		{
+			std::map<int, piece_entry>::iterator i = m_piece_crc.lower_bound(p);
+			if (i != m_piece_crc.end() && i->first == p) return i->second;
+
+			int num_blocks = (m_torrent.torrent_file().piece_size(p) + 16*1024 - 1) / (16*1024);
+			block_entry empty = {0, 0};
+			i = m_piece_crc.insert(i, std::make_pair(p, piece_entry()));
+			i->second.blocks.resize(num_blocks, empty);
+			i->second.fail_order = m_fail_order.insert(m_fail_order.end(), p);
+			m_num_blocks += num_blocks;
+
+			// the piece we just added is last in m_fail_order,
+			// so it's never the one evicted
+			while (m_num_blocks > max_stored_blocks && m_piece_crc.size() > 1)
+			{
+				std::map<int, piece_entry>::iterator oldest
+					= m_piece_crc.find(m_fail_order.front());
+				TORRENT_ASSERT(oldest != m_piece_crc.end());
+				TORRENT_ASSERT(oldest != i);
+				erase_piece(oldest);
+			}
+			return i->second;
+		}
+
 		void on_read_failed_block(piece_block b, policy::peer* p, int ret, disk_io_job const& j)
 		{
 			TORRENT_ASSERT(p);
@@ -180,11 +228,13 @@ namespace libtorrent { namespace
 			// thread, the session mutex is not locked when we get here
 			aux::session_impl::mutex_t::scoped_lock l(m_torrent.session().m_mutex);
 			
-			std::map<piece_block, block_entry>::iterator i = m_block_crc.lower_bound(b);
-			if (i != m_block_crc.end() && i->first == b && i->second.peer == p)
+			std::vector<block_entry>& blocks = piece_crcs(b.piece_index).blocks;
+			TORRENT_ASSERT(b.block_index < int(blocks.size()));
+			block_entry& stored = blocks[b.block_index];
+			if (stored.peer == p)
 			{
 				// this peer has sent us this block before
-				if (i->second.crc != e.crc)
+				if (stored.crc != e.crc)
 				{
 					// this time the crc of the block is different
 					// from the first time it sent it
@@ -204,19 +254,22 @@ namespace libtorrent { namespace
 					(*m_torrent.session().m_logger) << time_now_string() << " BANNING PEER [ p: " << b.piece_index
 						<< " | b: " << b.block_index
 						<< " | c: " << client
-						<< " | crc1: " << i->second.crc
+						<< " | crc1: " << stored.crc
 						<< " | crc2: " << e.crc
 						<< " | ip: " << p->ip() << " ]\n";
 #endif
 					p->banned = true;
 					if (p->connection) p->connection->disconnect("banning peer for sending bad data");
 				}
-				// we already have this exact entry in the map
-				// we don't have to insert it
+				// we already have this exact entry in the table
+				// we don't have to store it
 				return;
 			}
-			
-			m_block_crc.insert(i, std::make_pair(b, e));
+
+			// keep the CRC from the first peer that sent
+			// us this block
+			if (stored.peer != 0) return;
+			stored = e;
 
 #ifdef TORRENT_LOGGING
 			char const* client = "-";
@@ -234,7 +287,7 @@ namespace libtorrent { namespace
 #endif
 		}
 		
-		void on_read_ok_block(std::pair<piece_block, block_entry> b, int ret, disk_io_job const& j)
+		void on_read_ok_block(piece_block b, block_entry e, int ret, disk_io_job const& j)
 		{
 			// since this callback is called directory from the disk io
 			// thread, the session mutex is not locked when we get here
@@ -246,11 +299,11 @@ namespace libtorrent { namespace
 			adler32_crc crc;
 			crc.update(j.buffer, j.buffer_size);
 			crc.update((char const*)&m_salt, sizeof(m_salt));
-			unsigned long ok_crc = crc.final();
+			boost::uint32_t ok_crc = crc.final();
 
-			if (b.second.crc == ok_crc) return;
+			if (e.crc == ok_crc) return;
 
-			policy::peer* p = b.second.peer;
+			policy::peer* p = e.peer;
 
 			if (p == 0) return;
 			if (!m_torrent.get_policy().has_peer(p)) return;
@@ -263,11 +316,11 @@ namespace libtorrent { namespace
 				p->connection->get_peer_info(info);
 				client = info.client.c_str();
 			}
-			(*m_torrent.session().m_logger) << time_now_string() << " BANNING PEER [ p: " << b.first.piece_index
-				<< " | b: " << b.first.block_index
+			(*m_torrent.session().m_logger) << time_now_string() << " BANNING PEER [ p: " << b.piece_index
+				<< " | b: " << b.block_index
 				<< " | c: " << client
 				<< " | ok_crc: " << ok_crc
-				<< " | bad_crc: " << b.second.crc
+				<< " | bad_crc: " << e.crc
 				<< " | ip: " << p->ip() << " ]\n";
 #endif
 			p->banned = true;
@@ -276,10 +329,18 @@ namespace libtorrent { namespace
 		
 		torrent& m_torrent;
 
-		// This table maps a piece_block (piece and block index
-		// pair) to a peer and the block CRC. The CRC is calculated
-		// from the data in the block + the salt
-		std::map<piece_block, block_entry> m_block_crc;
+		// This table maps the index of a piece that failed the
+		// hash check to the peer and CRC of each of its blocks.
+		// The CRC is calculated from the data in the block + the
+		// salt. A piece is removed once it passes the hash check
+		std::map<int, piece_entry> m_piece_crc;
+
+		// the total number of block entries in m_piece_crc
+		int m_num_blocks;
+
+		// the pieces in m_piece_crc, in the order they were
+		// added. The front is the first to be evicted
+		std::list<int> m_fail_order;
 
 		// This salt is a random value used to calculate the block CRCs
 		// Since the CRC function that is used is not a one way function
@@ -314,9 +314,9 @@ namespace libtorrent
 			size_type size = 0;
 			std::time_t time = 0;
 #if TORRENT_USE_WPATH
-			fs::wpath f = safe_convert((p / i->path).string());
+			fs::wpath f = safe_convert((p / s.file_path(*i)).string());
 #else
-			fs::path f = p / i->path;
+			fs::path f = p / s.file_path(*i);
 #endif
 #ifndef BOOST_NO_EXCEPTIONS
 			try
@@ -364,9 +364,9 @@ namespace libtorrent
 			std::time_t time = 0;
 
 #if TORRENT_USE_WPATH
-			fs::wpath f = safe_convert((p / i->path).string());
+			fs::wpath f = safe_convert((p / fs.file_path(*i)).string());
 #else
-			fs::path f = p / i->path;
+			fs::path f = p / fs.file_path(*i);
 #endif
 #ifndef BOOST_NO_EXCEPTIONS
 			try
@@ -384,7 +384,7 @@ namespace libtorrent
 				|| (!compact_mode && size < s->first))
 			{
 				if (error) *error = "filesize mismatch for file '"
-					+ i->path.native_file_string()
+					+ fs.file_path(*i).native_file_string()
 					+ "', size: " + boost::lexical_cast<std::string>(size)
 					+ ", expected to be " + boost::lexical_cast<std::string>(s->first)
 					+ " bytes";
@@ -394,7 +394,7 @@ namespace libtorrent
 				|| (!compact_mode && time < s->second))
 			{
 				if (error) *error = "timestamp mismatch for file '"
-					+ i->path.native_file_string()
+					+ fs.file_path(*i).native_file_string()
 					+ "', modification date: " + boost::lexical_cast<std::string>(time)
 					+ ", expected to have modification date "
 					+ boost::lexical_cast<std::string>(s->second);
@@ -429,6 +429,7 @@ namespace libtorrent
 		bool verify_resume_data(lazy_entry const& rd, std::string& error);
 		bool write_resume_data(entry& rd) const;
 		sha1_hash hash_for_slot(int slot, partial_hash& ph, int piece_size);
+		int allocate(size_type offset, size_type size);
 
 		int read_impl(char* buf, int slot, int offset, int size, bool fill_zero);
 
@@ -481,6 +482,46 @@ namespace libtorrent
 #endif
 	}
 
+	int storage::allocate(size_type offset, size_type size)
+	{
+		file_storage::iterator file_iter = files().file_at_offset(offset);
+		if (file_iter == files().end()) return 1;
+		size_type file_offset = offset - file_iter->offset;
+
+		for (; size > 0 && file_iter != files().end(); ++file_iter, file_offset = 0)
+		{
+			size_type len = (std::min)(file_iter->size - file_offset, size);
+			size -= len;
+
+			// don't allocate files with priority 0
+			int file_index = file_iter - files().begin();
+			if (len == 0 || (int(m_file_priority.size()) > file_index
+				&& m_file_priority[file_index] == 0))
+				continue;
+
+			fs::path path = m_save_path / files().file_path(*file_iter);
+			error_code ec;
+			boost::shared_ptr<file> f = m_pool.open_file(this
+				, path, file::in | file::out, ec);
+			if (ec)
+			{
+				set_error(path, ec);
+				return -1;
+			}
+			if (!f) continue;
+			if (f->allocate(file_offset, len, ec)) continue;
+			if (ec)
+			{
+				set_error(path, ec);
+				return -1;
+			}
+			// the filesystem doesn't support it, the
+			// files will be sparse
+			return 0;
+		}
+		return 1;
+	}
+
 	bool storage::initialize(bool allocate_files)
 	{
 		error_code ec;
@@ -489,7 +530,8 @@ namespace libtorrent
 		for (file_storage::iterator file_iter = files().begin(),
 			end_iter = files().end(); file_iter != end_iter; ++file_iter)
 		{
-			fs::path dir = (m_save_path / file_iter->path).branch_path();
+			fs::path file_path = m_save_path / files().file_path(*file_iter);
+			fs::path dir = file_path.branch_path();
 
 			if (dir != last_path)
 			{
@@ -514,10 +556,10 @@ namespace libtorrent
 			// the directory exists.
 			if (file_iter->size == 0)
 			{
-				file(m_save_path / file_iter->path, file::out, ec);
+				file(file_path, file::out, ec);
 				if (ec)
 				{
-					set_error(m_save_path / file_iter->path, ec);
+					set_error(file_path, ec);
 					return true;
 				}
 				continue;
@@ -533,19 +575,19 @@ namespace libtorrent
 			{
 				error_code ec;
 				boost::shared_ptr<file> f = m_pool.open_file(this
-					, m_save_path / file_iter->path, file::in | file::out, ec);
-				if (ec) set_error(m_save_path / file_iter->path, ec);
+					, file_path, file::in | file::out, ec);
+				if (ec) set_error(file_path, ec);
 				else if (f)
 				{
 					f->set_size(file_iter->size, ec);
-					if (ec) set_error(m_save_path / file_iter->path, ec);
+					if (ec) set_error(file_path, ec);
 				}
 			}
 #ifndef BOOST_NO_EXCEPTIONS
 			}
 			catch (std::exception& e)
 			{
-				set_error(m_save_path / file_iter->path
+				set_error(file_path
 					, error_code(errno, get_posix_category()));
 				return true;
 			}
@@ -560,7 +602,7 @@ namespace libtorrent
 	bool storage::rename_file(int index, std::string const& new_filename)
 	{
 		if (index < 0 || index >= m_files.num_files()) return true;
-		fs::path old_name = m_save_path / files().at(index).path;
+		fs::path old_name = m_save_path / files().file_path(index);
 		m_pool.release(old_name);
 
 #if TORRENT_USE_WPATH
@@ -621,8 +663,9 @@ namespace libtorrent
 		for (file_storage::iterator i = files().begin()
 			, end(files().end()); i != end; ++i)
 		{
-			std::string p = (m_save_path / i->path).string();
-			fs::path bp = i->path.branch_path();
+			fs::path file_path = files().file_path(*i);
+			std::string p = (m_save_path / file_path).string();
+			fs::path bp = file_path.branch_path();
 			std::pair<iter_t, bool> ret;
 			ret.second = true;
 			while (ret.second && !bp.empty())
@@ -702,7 +745,7 @@ namespace libtorrent
 			for (file_storage::iterator i = m_mapped_files->begin()
 				, end(m_mapped_files->end()); i != end; ++i)
 			{
-				fl.push_back(i->path.string());
+				fl.push_back(m_mapped_files->file_path(*i).string());
 			}
 		}
 
@@ -815,7 +858,7 @@ namespace libtorrent
 			{
 				if (i->size != fs->first)
 				{
-					error = "file size for '" + i->path.native_file_string()
+					error = "file size for '" + files().file_path(*i).native_file_string()
 						+ "' was expected to be "
 						+ boost::lexical_cast<std::string>(i->size) + " bytes";
 					return false;
@@ -1003,25 +1046,17 @@ namespace libtorrent
 		TORRENT_ASSERT(start + size <= m_files.total_size());
 
 		// find the file iterator and file offset
-		size_type file_offset = start;
-		std::vector<file_entry>::const_iterator file_iter;
-
-		for (file_iter = files().begin();;)
-		{
-			if (file_offset < file_iter->size)
-				break;
-
-			file_offset -= file_iter->size;
-			++file_iter;
-		}
+		file_storage::iterator file_iter = files().file_at_offset(start);
+		TORRENT_ASSERT(file_iter != files().end());
+		size_type file_offset = start - file_iter->offset;
 
 		int buf_pos = 0;
 		error_code ec;
 		boost::shared_ptr<file> in(m_pool.open_file(
-			this, m_save_path / file_iter->path, file::in, ec));
+			this, m_save_path / files().file_path(*file_iter), file::in, ec));
 		if (!in || ec)
 		{
-			set_error(m_save_path / file_iter->path, ec);
+			set_error(m_save_path / files().file_path(*file_iter), ec);
 			return -1;
 		}
 		TORRENT_ASSERT(file_offset < file_iter->size);
@@ -1033,7 +1068,7 @@ namespace libtorrent
 			// the file was not big enough
 			if (!fill_zero)
 			{
-				set_error(m_save_path / file_iter->path, ec);
+				set_error(m_save_path / files().file_path(*file_iter), ec);
 				return -1;
 			}
 			std::memset(buf + buf_pos, 0, size - buf_pos);
@@ -1071,8 +1106,8 @@ namespace libtorrent
 				TORRENT_ASSERT(int(slices.size()) > counter);
 				size_type slice_size = slices[counter].size;
 				TORRENT_ASSERT(slice_size == read_bytes);
-				TORRENT_ASSERT(files().at(slices[counter].file_index).path
-					== file_iter->path);
+				TORRENT_ASSERT(slices[counter].file_index
+					== file_iter - files().begin());
 #endif
 
 				int actual_read = int(in->read(buf + buf_pos, read_bytes, ec));
@@ -1083,7 +1118,7 @@ namespace libtorrent
 					if (actual_read > 0) buf_pos += actual_read;
 					if (!fill_zero)
 					{
-						set_error(m_save_path / file_iter->path, ec);
+						set_error(m_save_path / files().file_path(*file_iter), ec);
 						return -1;
 					}
 					std::memset(buf + buf_pos, 0, size - buf_pos);
@@ -1104,7 +1139,7 @@ namespace libtorrent
 				// this file was empty, don't increment the slice counter
 				if (read_bytes > 0) ++counter;
 #endif
-				fs::path path = m_save_path / file_iter->path;
+				fs::path path = m_save_path / files().file_path(*file_iter);
 
 				file_offset = 0;
 				error_code ec;
@@ -1119,7 +1154,7 @@ namespace libtorrent
 				{
 					if (!fill_zero)
 					{
-						set_error(m_save_path / file_iter->path, ec);
+						set_error(m_save_path / files().file_path(*file_iter), ec);
 						return -1;
 					}
 					std::memset(buf + buf_pos, 0, size - buf_pos);
@@ -1151,20 +1186,11 @@ namespace libtorrent
 		size_type start = slot * (size_type)m_files.piece_length() + offset;
 
 		// find the file iterator and file offset
-		size_type file_offset = start;
-		std::vector<file_entry>::const_iterator file_iter;
+		file_storage::iterator file_iter = files().file_at_offset(start);
+		TORRENT_ASSERT(file_iter != files().end());
+		size_type file_offset = start - file_iter->offset;
 
-		for (file_iter = files().begin();;)
-		{
-			if (file_offset < file_iter->size)
-				break;
-
-			file_offset -= file_iter->size;
-			++file_iter;
-			TORRENT_ASSERT(file_iter != files().end());
-		}
-
-		fs::path p(m_save_path / file_iter->path);
+		fs::path p(m_save_path / files().file_path(*file_iter));
 		error_code ec;
 		boost::shared_ptr<file> out = m_pool.open_file(
 			this, p, file::out | file::in, ec);
@@ -1210,8 +1236,8 @@ namespace libtorrent
 			{
 				TORRENT_ASSERT(int(slices.size()) > counter);
 				TORRENT_ASSERT(slices[counter].size == write_bytes);
-				TORRENT_ASSERT(files().at(slices[counter].file_index).path
-					== file_iter->path);
+				TORRENT_ASSERT(slices[counter].file_index
+					== file_iter - files().begin());
 
 				TORRENT_ASSERT(buf_pos >= 0);
 				TORRENT_ASSERT(write_bytes >= 0);
@@ -1220,7 +1246,7 @@ namespace libtorrent
 
 				if (written != write_bytes || ec)
 				{
-					set_error(m_save_path / file_iter->path, ec);
+					set_error(m_save_path / files().file_path(*file_iter), ec);
 					return -1;
 				}
 
@@ -1239,7 +1265,7 @@ namespace libtorrent
 				++file_iter;
 
 				TORRENT_ASSERT(file_iter != files().end());
-				fs::path p = m_save_path / file_iter->path;
+				fs::path p = m_save_path / files().file_path(*file_iter);
 				file_offset = 0;
 				error_code ec;
 				out = m_pool.open_file(
@@ -1286,7 +1312,9 @@ namespace libtorrent
 		, m_save_path(complete(save_path))
 		, m_state(state_none)
 		, m_current_slot(0)
+		, m_allocated(0)
 		, m_out_of_place(false)
+		, m_need_defrag(false)
 		, m_scratch_piece(-1)
 		, m_storage_constructor(sc)
 		, m_io_thread(io)
@@ -1307,6 +1335,15 @@ namespace libtorrent
 		m_io_thread.add_job(j, handler);
 	}
 
+	void piece_manager::async_allocate(
+		boost::function<void(int, disk_io_job const&)> const& handler)
+	{
+		disk_io_job j;
+		j.storage = this;
+		j.action = disk_io_job::allocate;
+		m_io_thread.add_job(j, handler);
+	}
+
 	void piece_manager::async_clear_read_cache(
 		boost::function<void(int, disk_io_job const&)> const& handler)
 	{
@@ -1743,7 +1780,7 @@ namespace libtorrent
 		for (; i != end; ++i)
 		{
 			bool file_exists = false;
-			fs::path f = m_save_path / i->path;
+			fs::path f = m_save_path / m_files.file_path(*i);
 #ifndef BOOST_NO_EXCEPTIONS
 			try
 			{
@@ -1913,6 +1950,9 @@ namespace libtorrent
 						m_slot_to_piece[i] = index;
 						m_piece_to_slot[index] = i;
 						if (i != index) out_of_place = true;
+						// the slot this piece belongs in may already have
+						// been allocated and is then moved in place later
+						if (i != index) m_need_defrag = true;
 					}
 					else if (index == unassigned)
 					{
@@ -1955,7 +1995,8 @@ namespace libtorrent
 
 			if (m_storage_mode == storage_mode_compact)
 			{
-				if (m_unallocated_slots.empty()) switch_to_full_mode();
+				if (m_unallocated_slots.empty() && !m_need_defrag)
+					switch_to_full_mode();
 			}
 			else
 			{
@@ -2156,14 +2197,10 @@ namespace libtorrent
 			// skip means that the piece we checked failed to be read from disk
 			// completely. We should skip all pieces belonging to that file.
 			// find the file that failed, and skip all the pieces in that file
-			size_type file_offset = 0;
 			size_type current_offset = size_type(m_current_slot) * m_files.piece_length();
-			for (file_storage::iterator i = m_files.begin()
-				, end(m_files.end()); i != end; ++i)
-			{
-				file_offset += i->size;
-				if (file_offset > current_offset) break;
-			}
+			file_storage::iterator failed = m_files.file_at_offset(current_offset);
+			TORRENT_ASSERT(failed != m_files.end());
+			size_type file_offset = failed->offset + failed->size;
 
 			TORRENT_ASSERT(file_offset > current_offset);
 			int skip_blocks = static_cast<int>(
@@ -2230,6 +2267,27 @@ namespace libtorrent
 		return need_full_check;
 	}
 
+	// returns allocation_pending if there's more left to allocate,
+	// no_error once all of the storage has been allocated (or the
+	// storage can't allocate) and fatal_disk_error on failure
+	int piece_manager::allocate_impl(int& progress)
+	{
+		// this is the amount of disk space reserved by each job,
+		// to let other jobs through in between
+		const size_type chunk_size = 64 * 1024 * 1024;
+
+		size_type total_size = m_files.total_size();
+		size_type size = (std::min)(chunk_size, total_size - m_allocated);
+		int ret = size > 0 ? m_storage->allocate(m_allocated, size) : 0;
+		if (ret < 0) return fatal_disk_error;
+
+		// if the storage doesn't support allocating,
+		// there's no point in trying the rest of it
+		m_allocated = ret == 0 ? total_size : m_allocated + size;
+		progress = int(m_allocated / m_files.piece_length());
+		return m_allocated < total_size ? allocation_pending : no_error;
+	}
+
 	// -1=error 0=ok 1=skip
 	int piece_manager::check_one_piece(int& have_piece)
 	{
@@ -2539,12 +2597,29 @@ namespace libtorrent
 			// when we shouldn't, since it's smaller than ordinary slots
 			if (*iter == m_files.num_pieces() - 1 && piece_index != *iter)
 			{
-				if (m_free_slots.size() == 1)
+				if (m_free_slots.size() == 1 && m_unallocated_slots.empty())
+				{
+					// the last slot is the only one left, which means
+					// the last piece is stored somewhere else. This is
+					// the one case where a piece has to be moved right
+					// away, to make room for this piece
+					int last_piece = *iter;
+					int last_slot = m_piece_to_slot[last_piece];
+					TORRENT_ASSERT(last_slot >= 0);
+					m_storage->move_slot(last_slot, last_piece);
+					m_slot_to_piece[last_piece] = last_piece;
+					m_piece_to_slot[last_piece] = last_piece;
+					m_slot_to_piece[last_slot] = unassigned;
+					*iter = last_slot;
+				}
+				else if (m_free_slots.size() == 1)
+				{
 					allocate_slots(1);
-				TORRENT_ASSERT(m_free_slots.size() > 1);
+				}
 				// assumes that all allocated slots
 				// are put at the end of the free_slots vector
 				iter = m_free_slots.end() - 1;
+				TORRENT_ASSERT(*iter != m_files.num_pieces() - 1);
 			}
 		}
 
@@ -2556,61 +2631,90 @@ namespace libtorrent
 		m_slot_to_piece[slot_index] = piece_index;
 		m_piece_to_slot[piece_index] = slot_index;
 
-		// there is another piece already assigned to
-		// the slot we are interested in, swap positions
+		// if there is another piece already assigned to the
+		// slot we are interested in, don't move it out of the
+		// way now. That would stall this write with reading and
+		// writing a whole piece. Both pieces are moved into
+		// place by the disk thread once it's idle
 		if (slot_index != piece_index
 			&& m_slot_to_piece[piece_index] >= 0)
 		{
+			TORRENT_ASSERT(m_piece_to_slot[m_slot_to_piece[piece_index]] == piece_index);
+			m_need_defrag = true;
+		}
+		TORRENT_ASSERT(slot_index >= 0);
+		TORRENT_ASSERT(slot_index < (int)m_slot_to_piece.size());
 
-#if !defined(NDEBUG) && defined(TORRENT_STORAGE_DEBUG)
-			std::stringstream s;
-
-			s << "there is another piece at our slot, swapping..";
-
-			s << "\n   piece_index: ";
-			s << piece_index;
-			s << "\n   slot_index: ";
-			s << slot_index;
-			s << "\n   piece at our slot: ";
-			s << m_slot_to_piece[piece_index];
-			s << "\n";
-
-			print_to_log(s.str());
-			debug_log();
-#endif
-
-			int piece_at_our_slot = m_slot_to_piece[piece_index];
-			TORRENT_ASSERT(m_piece_to_slot[piece_at_our_slot] == piece_index);
+		if (m_free_slots.empty() && m_unallocated_slots.empty() && !m_need_defrag)
+			switch_to_full_mode();
+		
+		return slot_index;
+	}
 
-			std::swap(
-				m_slot_to_piece[piece_index]
-				, m_slot_to_piece[slot_index]);
+	int piece_manager::defrag_impl()
+	{
+		boost::recursive_mutex::scoped_lock lock(m_mutex);
 
-			std::swap(
-				m_piece_to_slot[piece_index]
-				, m_piece_to_slot[piece_at_our_slot]);
+		if (m_storage_mode != storage_mode_compact)
+		{
+			m_need_defrag = false;
+			return 0;
+		}
 
-			m_storage->move_slot(piece_index, slot_index);
+		// don't move anything while the files are being checked.
+		// The disk thread will try again after the next job
+		if (m_state != state_finished) return 0;
 
-			TORRENT_ASSERT(m_slot_to_piece[piece_index] == piece_index);
-			TORRENT_ASSERT(m_piece_to_slot[piece_index] == piece_index);
+		INVARIANT_CHECK;
 
-			slot_index = piece_index;
+		// find a piece that is not in its own slot, where
+		// that slot has been allocated
+		int piece = -1;
+		for (int i = 0; i < m_files.num_pieces(); ++i)
+		{
+			int slot = m_piece_to_slot[i];
+			if (slot < 0 || slot == i) continue;
+			if (m_slot_to_piece[i] == unallocated) continue;
+			piece = i;
+			break;
+		}
 
-#if !defined(NDEBUG) && defined(TORRENT_STORAGE_DEBUG)
-			debug_log();
-#endif
+		if (piece < 0)
+		{
+			m_need_defrag = false;
+			if (m_free_slots.empty() && m_unallocated_slots.empty())
+				switch_to_full_mode();
+			return 0;
 		}
-		TORRENT_ASSERT(slot_index >= 0);
-		TORRENT_ASSERT(slot_index < (int)m_slot_to_piece.size());
 
-		if (m_free_slots.empty() && m_unallocated_slots.empty())
-			switch_to_full_mode();
-		
-		return slot_index;
+		int slot = m_piece_to_slot[piece];
+		int other_piece = m_slot_to_piece[piece];
+		if (other_piece >= 0)
+		{
+			// our slot is used by another piece, swap them
+			TORRENT_ASSERT(m_piece_to_slot[other_piece] == piece);
+			m_storage->swap_slots(slot, piece);
+			m_slot_to_piece[slot] = other_piece;
+			m_piece_to_slot[other_piece] = slot;
+		}
+		else
+		{
+			// our slot is free, move the piece there and
+			// free the slot it used to be in
+			TORRENT_ASSERT(other_piece == unassigned);
+			m_storage->move_slot(slot, piece);
+			std::vector<int>::iterator i = std::find(m_free_slots.begin()
+				, m_free_slots.end(), piece);
+			TORRENT_ASSERT(i != m_free_slots.end());
+			*i = slot;
+			m_slot_to_piece[slot] = unassigned;
+		}
+		m_slot_to_piece[piece] = piece;
+		m_piece_to_slot[piece] = piece;
+		return 1;
 	}
 
-	bool piece_manager::allocate_slots(int num_slots, bool abort_on_disk)
+	void piece_manager::allocate_slots(int num_slots)
 	{
 		boost::recursive_mutex::scoped_lock lock(m_mutex);
 		TORRENT_ASSERT(num_slots > 0);
@@ -2620,8 +2724,6 @@ namespace libtorrent
 		TORRENT_ASSERT(!m_unallocated_slots.empty());
 		TORRENT_ASSERT(m_storage_mode == storage_mode_compact);
 
-		bool written = false;
-
 		for (int i = 0; i < num_slots && !m_unallocated_slots.empty(); ++i)
 		{
 //			INVARIANT_CHECK;
@@ -2630,23 +2732,16 @@ namespace libtorrent
 			TORRENT_ASSERT(m_slot_to_piece[pos] == unallocated);
 			TORRENT_ASSERT(m_piece_to_slot[pos] != pos);
 
-			int new_free_slot = pos;
-			if (m_piece_to_slot[pos] != has_no_slot)
-			{
-				new_free_slot = m_piece_to_slot[pos];
-				m_storage->move_slot(new_free_slot, pos);
-				m_slot_to_piece[pos] = pos;
-				m_piece_to_slot[pos] = pos;
-				written = true;
-			}
+			// if the piece belonging in this slot is already stored
+			// somewhere else, it's left there for now, and moved
+			// into place when the disk is idle
+			if (m_piece_to_slot[pos] != has_no_slot) m_need_defrag = true;
 			m_unallocated_slots.erase(m_unallocated_slots.begin());
-			m_slot_to_piece[new_free_slot] = unassigned;
-			m_free_slots.push_back(new_free_slot);
-			if (abort_on_disk && written) break;
+			m_slot_to_piece[pos] = unassigned;
+			m_free_slots.push_back(pos);
 		}
 
 		TORRENT_ASSERT(m_free_slots.size() > 0);
-		return written;
 	}
 
 	int piece_manager::slot_for(int piece) const
@@ -2674,6 +2769,7 @@ namespace libtorrent
 		
 		if (m_unallocated_slots.empty()
 			&& m_free_slots.empty()
+			&& !m_need_defrag
 			&& m_state == state_finished)
 		{
 			TORRENT_ASSERT(m_storage_mode != storage_mode_compact
@@ -2741,7 +2837,10 @@ namespace libtorrent
 				if (m_piece_to_slot[i] >= 0)
 				{
 					TORRENT_ASSERT(m_slot_to_piece[m_piece_to_slot[i]] == i);
-					if (m_piece_to_slot[i] != i)
+					// pieces may only be out of place when their own
+					// slot hasn't been allocated, or when they are
+					// waiting to be moved by the disk thread
+					if (m_piece_to_slot[i] != i && !m_need_defrag)
 					{
 						TORRENT_ASSERT(m_slot_to_piece[i] == unallocated);
 					}
@@ -130,6 +130,26 @@ namespace
 
 		peer_id const& pid;
 	};
+
+	// adds the peers in a compact peer string from the resume
+	// data to the peer list. Each entry is 6 bytes for IPv4
+	// and 18 bytes for IPv6
+	void add_resume_peers(libtorrent::policy& p, lazy_entry const* e
+		, bool v6, bool banned)
+	{
+		if (e == 0) return;
+		using namespace libtorrent::detail;
+		peer_id id(0);
+		int const entry_size = v6 ? 18 : 6;
+		char const* ptr = e->string_ptr();
+		for (int i = 0; i < e->string_length() / entry_size; ++i)
+		{
+			tcp::endpoint a = v6 ? read_v6_endpoint<tcp::endpoint>(ptr)
+				: read_v4_endpoint<tcp::endpoint>(ptr);
+			policy::peer* pe = p.peer_from_tracker(a, id, peer_info::resume_data, 0);
+			if (pe && banned) pe->banned = true;
+		}
+	}
 }
 
 namespace libtorrent
@@ -157,7 +177,6 @@ namespace libtorrent
 		, m_torrent_file(tf)
 		, m_storage(0)
 		, m_next_tracker_announce(time_now())
-		, m_host_resolver(ses.m_io_service)
 		, m_lsd_announce_timer(ses.m_io_service)
 		, m_tracker_timer(ses.m_io_service)
 #ifndef TORRENT_DISABLE_DHT
@@ -175,6 +194,7 @@ namespace libtorrent
 		, m_settings(ses.settings())
 		, m_storage_constructor(sc)
 		, m_progress(0.f)
+		, m_allocation_progress(1.f)
 		, m_ratio(0.f)
 		, m_max_uploads((std::numeric_limits<int>::max)())
 		, m_num_uploads(0)
@@ -204,6 +224,9 @@ namespace libtorrent
 		, m_announcing(false)
 		, m_start_sent(false)
 		, m_complete_sent(false)
+		, m_in_state_updates(false)
+		, m_need_save_resume_data(true)
+		, m_allocating(false)
 	{
 		parse_resume_data(resume_data);
 
@@ -239,7 +262,6 @@ namespace libtorrent
 		, m_torrent_file(new torrent_info(info_hash))
 		, m_storage(0)
 		, m_next_tracker_announce(time_now())
-		, m_host_resolver(ses.m_io_service)
 		, m_lsd_announce_timer(ses.m_io_service)
 		, m_tracker_timer(ses.m_io_service)
 #ifndef TORRENT_DISABLE_DHT
@@ -256,6 +278,7 @@ namespace libtorrent
 		, m_settings(ses.settings())
 		, m_storage_constructor(sc)
 		, m_progress(0.f)
+		, m_allocation_progress(1.f)
 		, m_ratio(0.f)
 		, m_max_uploads((std::numeric_limits<int>::max)())
 		, m_num_uploads(0)
@@ -285,6 +308,9 @@ namespace libtorrent
 		, m_announcing(false)
 		, m_start_sent(false)
 		, m_complete_sent(false)
+		, m_in_state_updates(false)
+		, m_need_save_resume_data(true)
+		, m_allocating(false)
 	{
 		parse_resume_data(resume_data);
 
@@ -319,7 +345,7 @@ namespace libtorrent
 			std::vector<char>().swap(m_resume_data);
 			if (m_ses.m_alerts.should_post<fastresume_rejected_alert>())
 			{
-				m_ses.m_alerts.post_alert(fastresume_rejected_alert(get_handle(), "parse failed"));
+				m_ses.m_alerts.post_alert_ptr(new fastresume_rejected_alert(get_handle(), "parse failed"));
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
 				(*m_ses.m_logger) << "fastresume data for "
 					<< torrent_file().name() << " rejected: parse failed\n";
@@ -481,7 +507,7 @@ namespace libtorrent
 
 			if (error && m_ses.m_alerts.should_post<fastresume_rejected_alert>())
 			{
-				m_ses.m_alerts.post_alert(fastresume_rejected_alert(get_handle(), error));
+				m_ses.m_alerts.post_alert_ptr(new fastresume_rejected_alert(get_handle(), error));
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
 				(*m_ses.m_logger) << "fastresume data for "
 					<< torrent_file().name() << " rejected: "
@@ -513,7 +539,7 @@ namespace libtorrent
 		{
 			if (m_ses.m_alerts.should_post<file_error_alert>())
 			{
-				m_ses.m_alerts.post_alert(file_error_alert(j.error_file, get_handle(), j.str));
+				m_ses.m_alerts.post_alert_ptr(new file_error_alert(j.error_file, get_handle(), j.str));
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
 				(*m_ses.m_logger) << time_now_string() << ": fatal disk error ["
 					" error: " << j.str <<
@@ -532,7 +558,13 @@ namespace libtorrent
 
 		if (m_resume_entry.type() == lazy_entry::dict_t)
 		{
-			// parse out "peers" from the resume data and add them to the peer list
+			add_resume_peers(m_policy, m_resume_entry.dict_find_string("peers"), false, false);
+			add_resume_peers(m_policy, m_resume_entry.dict_find_string("peers6"), true, false);
+			add_resume_peers(m_policy, m_resume_entry.dict_find_string("banned_peers"), false, true);
+			add_resume_peers(m_policy, m_resume_entry.dict_find_string("banned_peers6"), true, true);
+
+			// resume data from older versions has the peers as lists
+			// of dictionaries. Parse out "peers" and add them to the peer list
 			if (lazy_entry const* peers_entry = m_resume_entry.dict_find_list("peers"))
 			{
 				peer_id id(0);
@@ -572,7 +604,7 @@ namespace libtorrent
 		
 		if (fastresume_rejected && m_ses.m_alerts.should_post<fastresume_rejected_alert>())
 		{
-			m_ses.m_alerts.post_alert(fastresume_rejected_alert(get_handle(), j.str));
+			m_ses.m_alerts.post_alert_ptr(new fastresume_rejected_alert(get_handle(), j.str));
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
 			(*m_ses.m_logger) << "fastresume data for "
 				<< torrent_file().name() << " rejected: "
@@ -691,7 +723,7 @@ namespace libtorrent
 		{
 			if (m_ses.m_alerts.should_post<file_error_alert>())
 			{
-				m_ses.m_alerts.post_alert(file_error_alert(j.error_file, get_handle(), j.str));
+				m_ses.m_alerts.post_alert_ptr(new file_error_alert(j.error_file, get_handle(), j.str));
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
 				(*m_ses.m_logger) << time_now_string() << ": fatal disk error ["
 					" error: " << j.str <<
@@ -729,7 +761,7 @@ namespace libtorrent
 		{
 			if (m_ses.m_alerts.should_post<file_error_alert>())
 			{
-				m_ses.m_alerts.post_alert(file_error_alert(j.error_file, get_handle(), j.str));
+				m_ses.m_alerts.post_alert_ptr(new file_error_alert(j.error_file, get_handle(), j.str));
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
 				(*m_ses.m_logger) << time_now_string() << ": fatal disk error ["
 					" error: " << j.str <<
@@ -758,6 +790,58 @@ namespace libtorrent
 		files_checked();
 	}
 
+	void torrent::start_allocating()
+	{
+		TORRENT_ASSERT(m_storage_mode == storage_mode_allocate);
+		if (m_allocating || !m_owning_storage.get()) return;
+		m_allocating = true;
+
+		m_storage->async_allocate(bind(
+			&torrent::on_allocated, shared_from_this(), _1, _2));
+	}
+
+	void torrent::on_allocated(int ret, disk_io_job const& j)
+	{
+		session_impl::mutex_t::scoped_lock l(m_ses.m_mutex);
+
+		m_allocating = false;
+
+		// if the torrent is being rechecked, files_checked()
+		// starts the allocation over. If it's paused,
+		// do_resume() picks it up again. Finishing the
+		// download doesn't stop the allocation
+		if (m_abort || m_state == torrent_status::queued_for_checking
+			|| m_state == torrent_status::checking_files) return;
+
+		if (ret == piece_manager::fatal_disk_error)
+		{
+			if (m_ses.m_alerts.should_post<file_error_alert>())
+			{
+				m_ses.m_alerts.post_alert_ptr(new file_error_alert(j.error_file, get_handle(), j.str));
+#if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
+				(*m_ses.m_logger) << time_now_string() << ": fatal disk error ["
+					" error: " << j.str <<
+					" torrent: " << torrent_file().name() <<
+					" ]\n";
+#endif
+			}
+			m_error = j.str;
+			pause();
+			return;
+		}
+
+		m_allocation_progress = j.piece / float(torrent_file().num_pieces());
+		if (ret != piece_manager::allocation_pending)
+		{
+			m_allocation_progress = 1.f;
+			return;
+		}
+
+		// allocate one chunk at a time, to let the
+		// reads and writes of the download in between
+		if (!is_paused()) start_allocating();
+	}
+
 	void torrent::use_interface(const char* net_interface)
 	{
 		INVARIANT_CHECK;
@@ -844,7 +928,7 @@ namespace libtorrent
 
 		if (m_ses.m_alerts.should_post<dht_reply_alert>())
 		{
-			m_ses.m_alerts.post_alert(dht_reply_alert(
+			m_ses.m_alerts.post_alert_ptr(new dht_reply_alert(
 				get_handle(), peers.size()));
 		}
 		std::for_each(peers.begin(), peers.end(), bind(
@@ -906,8 +990,8 @@ namespace libtorrent
 
 		if (m_ses.m_alerts.should_post<tracker_announce_alert>())
 		{
-			m_ses.m_alerts.post_alert(
-				tracker_announce_alert(get_handle(), req.url, req.event));
+			m_ses.m_alerts.post_alert_ptr(
+				new tracker_announce_alert(get_handle(), req.url, req.event));
 		}
 	}
 
@@ -935,7 +1019,7 @@ namespace libtorrent
 		INVARIANT_CHECK;
 
 		if (m_ses.m_alerts.should_post<tracker_warning_alert>())
-			m_ses.m_alerts.post_alert(tracker_warning_alert(get_handle(), req.url, msg));
+			m_ses.m_alerts.post_alert_ptr(new tracker_warning_alert(get_handle(), req.url, msg));
 	}
 	
  	void torrent::tracker_scrape_response(tracker_request const& req
@@ -951,7 +1035,7 @@ namespace libtorrent
  
  		if (m_ses.m_alerts.should_post<scrape_reply_alert>())
  		{
- 			m_ses.m_alerts.post_alert(scrape_reply_alert(
+ 			m_ses.m_alerts.post_alert_ptr(new scrape_reply_alert(
  				get_handle(), m_incomplete, m_complete, req.url));
  		}
  	}
@@ -959,6 +1043,7 @@ namespace libtorrent
 	void torrent::tracker_response(
 		tracker_request const& r
 		, std::vector<peer_entry>& peer_list
+		, std::vector<tcp::endpoint> const& endpoints
 		, int interval
 		, int complete
 		, int incomplete
@@ -968,6 +1053,7 @@ namespace libtorrent
 
 		INVARIANT_CHECK;
 		TORRENT_ASSERT(r.kind == tracker_request::announce_request);
+		state_updated();
 
 		if (external_ip != address())
 			m_ses.set_external_address(external_ip);
@@ -1007,6 +1093,12 @@ namespace libtorrent
 			if (!i->pid.is_all_zeros()) s << " " << i->pid << " " << identify_client(i->pid);
 			s << "\n";
 		}
+		for (std::vector<tcp::endpoint>::const_iterator i = endpoints.begin();
+			i != endpoints.end(); ++i)
+		{
+			s << "  " << std::setfill(' ') << std::setw(16) << i->address()
+				<< " " << std::setw(5) << std::dec << i->port() << "\n";
+		}
 		s << "external ip: " << external_ip << "\n";
 		debug_log(s.str());
 #endif
@@ -1026,9 +1118,9 @@ namespace libtorrent
 				// assume this is because we got a hostname instead of
 				// an ip address from the tracker
 
-				tcp::resolver::query q(i->ip, boost::lexical_cast<std::string>(i->port));
-				m_host_resolver.async_resolve(q,
-					bind(&torrent::on_peer_name_lookup, shared_from_this(), _1, _2, i->pid));
+				m_ses.m_host_resolver.async_resolve(i->ip,
+					bind(&torrent::on_peer_name_lookup, shared_from_this(), _1, _2
+						, i->pid, i->port), this);
 			}
 			else
 			{
@@ -1036,38 +1128,47 @@ namespace libtorrent
 			}
 		}
 
+		// the compact peers are already parsed, add them all
+		// to the peer list in one go
+		peer_id zero_id;
+		zero_id.clear();
+		for (std::vector<tcp::endpoint>::const_iterator i = endpoints.begin()
+			, end(endpoints.end()); i != end; ++i)
+			m_policy.peer_from_tracker(*i, zero_id, peer_info::tracker, 0);
+
 		if (m_ses.m_alerts.should_post<tracker_reply_alert>())
 		{
-			m_ses.m_alerts.post_alert(tracker_reply_alert(
-				get_handle(), peer_list.size(), r.url));
+			m_ses.m_alerts.post_alert_ptr(new tracker_reply_alert(
+				get_handle(), peer_list.size() + endpoints.size(), r.url));
 		}
 		m_got_tracker_response = true;
 	}
 
-	void torrent::on_peer_name_lookup(error_code const& e, tcp::resolver::iterator host
-		, peer_id pid)
+	void torrent::on_peer_name_lookup(error_code const& e
+		, std::vector<address> const& addresses, peer_id pid, int port)
 	{
 		session_impl::mutex_t::scoped_lock l(m_ses.m_mutex);
 
 		INVARIANT_CHECK;
 
-		if (e || host == tcp::resolver::iterator() ||
-			m_ses.is_aborted()) return;
+		if (e || m_abort || m_ses.is_aborted()) return;
+
+		tcp::endpoint host(addresses.front(), port);
 
-		if (m_ses.m_ip_filter.access(host->endpoint().address()) & ip_filter::blocked)
+		if (m_ses.m_ip_filter.access(host.address()) & ip_filter::blocked)
 		{
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
-			debug_log("blocked ip from tracker: " + host->endpoint().address().to_string());
+			debug_log("blocked ip from tracker: " + host.address().to_string());
 #endif
 			if (m_ses.m_alerts.should_post<peer_blocked_alert>())
 			{
-				m_ses.m_alerts.post_alert(peer_blocked_alert(host->endpoint().address()));
+				m_ses.m_alerts.post_alert_ptr(new peer_blocked_alert(host.address()));
 			}
 
 			return;
 		}
 			
-		m_policy.peer_from_tracker(*host, pid, peer_info::tracker, 0);
+		m_policy.peer_from_tracker(host, pid, peer_info::tracker, 0);
 	}
 
 	size_type torrent::bytes_left() const
@@ -1334,9 +1435,11 @@ namespace libtorrent
 		TORRENT_ASSERT(index >= 0);
 		TORRENT_ASSERT(index < m_torrent_file->num_pieces());
 
+		m_need_save_resume_data = true;
+
 		if (m_ses.m_alerts.should_post<piece_finished_alert>())
 		{
-			m_ses.m_alerts.post_alert(piece_finished_alert(get_handle()
+			m_ses.m_alerts.post_alert_ptr(new piece_finished_alert(get_handle()
 				, index));
 		}
 
@@ -1351,11 +1454,15 @@ namespace libtorrent
 		std::set<void*> peers;
 		std::copy(downloaders.begin(), downloaders.end(), std::inserter(peers, peers.begin()));
 
+		// if the piece was filtered, it was never counted
+		// as wanted by the peers
+		bool was_wanted = m_picker->piece_priority(index) > 0;
 		m_picker->we_have(index);
 		for (peer_iterator i = m_connections.begin(); i != m_connections.end();)
 		{
 			peer_connection* p = *i;
 			++i;
+			if (was_wanted) p->piece_wanted(index, false);
 			p->announce_piece(index);
 		}
 
@@ -1428,7 +1535,7 @@ namespace libtorrent
 	  	TORRENT_ASSERT(index < m_torrent_file->num_pieces());
 
 		if (m_ses.m_alerts.should_post<hash_failed_alert>())
-			m_ses.m_alerts.post_alert(hash_failed_alert(get_handle(), index));
+			m_ses.m_alerts.post_alert_ptr(new hash_failed_alert(get_handle(), index));
 
 		// increase the total amount of failed bytes
 		add_failed_bytes(m_torrent_file->piece_size(index));
@@ -1487,7 +1594,7 @@ namespace libtorrent
 				{
 					peer_id pid(0);
 					if (p->connection) pid = p->connection->pid();
-					m_ses.m_alerts.post_alert(peer_ban_alert(
+					m_ses.m_alerts.post_alert_ptr(new peer_ban_alert(
 						get_handle(), p->ip(), pid));
 				}
 
@@ -1591,7 +1698,10 @@ namespace libtorrent
 				bind(&torrent::on_files_released, shared_from_this(), _1, _2));
 			
 		m_owning_storage = 0;
-		m_host_resolver.cancel();
+
+		// don't keep this torrent alive waiting for host name
+		// lookups that it no longer cares about
+		m_ses.m_host_resolver.cancel(this);
 	}
 
 	void torrent::on_files_deleted(int ret, disk_io_job const& j)
@@ -1601,12 +1711,12 @@ namespace libtorrent
 		if (ret != 0)
 		{
 			if (alerts().should_post<torrent_delete_failed_alert>())
-				alerts().post_alert(torrent_delete_failed_alert(get_handle(), j.str));
+				alerts().post_alert_ptr(new torrent_delete_failed_alert(get_handle(), j.str));
 		}
 		else
 		{
 			if (alerts().should_post<torrent_deleted_alert>())
-				alerts().post_alert(torrent_deleted_alert(get_handle()));
+				alerts().post_alert_ptr(new torrent_deleted_alert(get_handle()));
 		}
 	}
 
@@ -1617,7 +1727,7 @@ namespace libtorrent
 
 		if (alerts().should_post<torrent_paused_alert>())
 		{
-			alerts().post_alert(torrent_paused_alert(get_handle()));
+			alerts().post_alert_ptr(new torrent_paused_alert(get_handle()));
 		}
 */
 	}
@@ -1628,14 +1738,17 @@ namespace libtorrent
 
 		if (!j.resume_data && alerts().should_post<save_resume_data_failed_alert>())
 		{
-			alerts().post_alert(save_resume_data_failed_alert(get_handle(), j.str));
+			alerts().post_alert_ptr(new save_resume_data_failed_alert(get_handle(), j.str));
 			return;
 		}
 
 		if (j.resume_data && alerts().should_post<save_resume_data_alert>())
 		{
+			// the flag is only cleared once the resume data has
+			// actually been handed to the client
+			m_need_save_resume_data = false;
 			write_resume_data(*j.resume_data);
-			alerts().post_alert(save_resume_data_alert(j.resume_data
+			alerts().post_alert_ptr(new save_resume_data_alert(j.resume_data
 				, get_handle()));
 		}
 	}
@@ -1648,12 +1761,13 @@ namespace libtorrent
 			if (ret == 0)
 			{
 				if (alerts().should_post<file_renamed_alert>())
-					alerts().post_alert(file_renamed_alert(get_handle(), j.str, j.piece));
+					alerts().post_alert_ptr(new file_renamed_alert(get_handle(), j.str, j.piece));
+				m_need_save_resume_data = true;
 			}
 			else
 			{
 				if (alerts().should_post<file_rename_failed_alert>())
-					alerts().post_alert(file_rename_failed_alert(get_handle(), j.str, j.piece));
+					alerts().post_alert_ptr(new file_rename_failed_alert(get_handle(), j.str, j.piece));
 			}
 		}
 	}
@@ -1663,7 +1777,7 @@ namespace libtorrent
 		session_impl::mutex_t::scoped_lock l(m_ses.m_mutex);
 
 		if (alerts().should_post<torrent_paused_alert>())
-			alerts().post_alert(torrent_paused_alert(get_handle()));
+			alerts().post_alert_ptr(new torrent_paused_alert(get_handle()));
 	}
 
 	std::string torrent::tracker_login() const
@@ -1701,7 +1815,19 @@ namespace libtorrent
 		bool was_finished = is_finished();
 		bool filter_updated = m_picker->set_piece_priority(index, priority);
 		TORRENT_ASSERT(num_have() >= m_picker->num_have_filtered());
-		if (filter_updated) update_peer_interest(was_finished);
+		m_need_save_resume_data = true;
+		if (!filter_updated) return;
+
+		// the piece went from being filtered to not being
+		// filtered or vice versa. Only the peers that have
+		// it are affected
+		if (!m_picker->have_piece(index))
+		{
+			bool wanted = m_picker->piece_priority(index) > 0;
+			for (peer_iterator i = begin(); i != end(); ++i)
+				(*i)->piece_wanted(index, wanted);
+		}
+		update_peer_interest(was_finished);
 	}
 
 	int torrent::piece_priority(int index) const
@@ -1740,7 +1866,10 @@ namespace libtorrent
 			filter_updated |= m_picker->set_piece_priority(index, *i);
 			TORRENT_ASSERT(num_have() >= m_picker->num_have_filtered());
 		}
-		if (filter_updated) update_peer_interest(was_finished);
+		m_need_save_resume_data = true;
+		if (!filter_updated) return;
+		update_wanted_pieces();
+		update_peer_interest(was_finished);
 	}
 
 	void torrent::piece_priorities(std::vector<int>& pieces) const
@@ -1815,6 +1944,8 @@ namespace libtorrent
 
 		if (m_torrent_file->num_pieces() == 0) return;
 
+		m_need_save_resume_data = true;
+
 		size_type position = 0;
 		int piece_length = m_torrent_file->piece_length();
 		// initialize the piece priorities to 0, then only allow
@@ -1823,7 +1954,7 @@ namespace libtorrent
 		for (int i = 0; i < int(m_file_priority.size()); ++i)
 		{
 			size_type start = position;
-			size_type size = m_torrent_file->files().at(i).size;
+			size_type size = m_torrent_file->files().file_size(i);
 			if (size == 0) continue;
 			position += size;
 			// mark all pieces of the file with this file's priority
@@ -1841,8 +1972,19 @@ namespace libtorrent
 		prioritize_pieces(pieces);
 	}
 
+	// recounts the wanted pieces of every peer. This is
+	// called when many piece priorities change at once
+	void torrent::update_wanted_pieces()
+	{
+		bitfield wanted;
+		if (has_picker() && !is_seed()) m_picker->wanted_pieces(wanted);
+		for (peer_iterator i = begin(); i != end(); ++i)
+			(*i)->update_wanted(wanted);
+	}
+
 	// this is called when piece priorities have been updated
-	// updates the interested flag in peers
+	// updates the interested flag in peers. The peers'
+	// wanted piece counts must already be up to date
 	void torrent::update_peer_interest(bool was_finished)
 	{
 		for (peer_iterator i = begin(); i != end(); ++i)
@@ -1875,7 +2017,14 @@ namespace libtorrent
 		TORRENT_ASSERT(index < m_torrent_file->num_pieces());
 
 		bool was_finished = is_finished();
-		m_picker->set_piece_priority(index, filter ? 1 : 0);
+		bool filter_updated = m_picker->set_piece_priority(index, filter ? 1 : 0);
+		m_need_save_resume_data = true;
+		if (filter_updated && !m_picker->have_piece(index))
+		{
+			bool wanted = m_picker->piece_priority(index) > 0;
+			for (peer_iterator i = begin(); i != end(); ++i)
+				(*i)->piece_wanted(index, wanted);
+		}
 		update_peer_interest(was_finished);
 	}
 
@@ -1900,6 +2049,8 @@ namespace libtorrent
 			else
 				m_picker->set_piece_priority(index, 1);
 		}
+		m_need_save_resume_data = true;
+		update_wanted_pieces();
 		update_peer_interest(was_finished);
 	}
 
@@ -1955,7 +2106,7 @@ namespace libtorrent
 			for (int i = 0; i < (int)bitmask.size(); ++i)
 			{
 				size_type start = position;
-				position += m_torrent_file->files().at(i).size;
+				position += m_torrent_file->files().file_size(i);
 				// is the file selected for download?
 				if (!bitmask[i])
 				{           
@@ -2012,14 +2163,20 @@ namespace libtorrent
 		}
 	}
 
+#ifndef NDEBUG
+	bool torrent::has_peer(peer_connection* p) const
+	{
+		return m_connections.contains(p);
+	}
+#endif
+
 	void torrent::remove_peer(peer_connection* p)
 	{
 //		INVARIANT_CHECK;
 
 		TORRENT_ASSERT(p != 0);
 
-		peer_iterator i = m_connections.find(p);
-		if (i == m_connections.end())
+		if (!m_connections.contains(p))
 		{
 			TORRENT_ASSERT(false);
 			return;
@@ -2052,8 +2209,7 @@ namespace libtorrent
 
 		m_policy.connection_closed(*p);
 		p->set_peer_info(0);
-		TORRENT_ASSERT(i != m_connections.end());
-		m_connections.erase(i);
+		m_connections.erase(p);
 
 		// remove from bandwidth request-queue
 		for (int c = 0; c < 2; ++c)
@@ -2103,8 +2259,8 @@ namespace libtorrent
 		{
 			if (m_ses.m_alerts.should_post<url_seed_alert>())
 			{
-				m_ses.m_alerts.post_alert(
-					url_seed_alert(get_handle(), url, "unknown protocol"));
+				m_ses.m_alerts.post_alert_ptr(
+					new url_seed_alert(get_handle(), url, "unknown protocol"));
 			}
 			// never try it again
 			remove_url_seed(url);
@@ -2115,8 +2271,8 @@ namespace libtorrent
 		{
 			if (m_ses.m_alerts.should_post<url_seed_alert>())
 			{
-				m_ses.m_alerts.post_alert(
-					url_seed_alert(get_handle(), url, "invalid hostname"));
+				m_ses.m_alerts.post_alert_ptr(
+					new url_seed_alert(get_handle(), url, "invalid hostname"));
 			}
 			// never try it again
 			remove_url_seed(url);
@@ -2127,8 +2283,8 @@ namespace libtorrent
 		{
 			if (m_ses.m_alerts.should_post<url_seed_alert>())
 			{
-				m_ses.m_alerts.post_alert(
-					url_seed_alert(get_handle(), url, "invalid port"));
+				m_ses.m_alerts.post_alert_ptr(
+					new url_seed_alert(get_handle(), url, "invalid port"));
 			}
 			// never try it again
 			remove_url_seed(url);
@@ -2141,10 +2297,9 @@ namespace libtorrent
 			|| ps.type == proxy_settings::http_pw)
 		{
 			// use proxy
-			tcp::resolver::query q(ps.hostname
-				, boost::lexical_cast<std::string>(ps.port));
-			m_host_resolver.async_resolve(q,
-				bind(&torrent::on_proxy_name_lookup, shared_from_this(), _1, _2, url));
+			m_ses.m_host_resolver.async_resolve(ps.hostname,
+				bind(&torrent::on_proxy_name_lookup, shared_from_this(), _1, _2
+					, url, int(ps.port)), this);
 		}
 		else
 		{
@@ -2152,24 +2307,23 @@ namespace libtorrent
 			{
 				if (m_ses.m_alerts.should_post<url_seed_alert>())
 				{
-					m_ses.m_alerts.post_alert(
-						url_seed_alert(get_handle(), url, "port blocked by port-filter"));
+					m_ses.m_alerts.post_alert_ptr(
+						new url_seed_alert(get_handle(), url, "port blocked by port-filter"));
 				}
 				// never try it again
 				remove_url_seed(url);
 				return;
 			}
 
-			tcp::resolver::query q(hostname, boost::lexical_cast<std::string>(port));
-			m_host_resolver.async_resolve(q,
+			m_ses.m_host_resolver.async_resolve(hostname,
 				bind(&torrent::on_name_lookup, shared_from_this(), _1, _2, url
-					, tcp::endpoint()));
+					, port, tcp::endpoint()), this);
 		}
 
 	}
 
-	void torrent::on_proxy_name_lookup(error_code const& e, tcp::resolver::iterator host
-		, std::string url)
+	void torrent::on_proxy_name_lookup(error_code const& e
+		, std::vector<address> const& addresses, std::string url, int proxy_port)
 	{
 		session_impl::mutex_t::scoped_lock l(m_ses.m_mutex);
 
@@ -2179,12 +2333,14 @@ namespace libtorrent
 		(*m_ses.m_logger) << time_now_string() << " completed resolve proxy hostname for: " << url << "\n";
 #endif
 
-		if (e || host == tcp::resolver::iterator())
+		if (m_abort) return;
+
+		if (e)
 		{
 			if (m_ses.m_alerts.should_post<url_seed_alert>())
 			{
-				m_ses.m_alerts.post_alert(
-					url_seed_alert(get_handle(), url, e.message()));
+				m_ses.m_alerts.post_alert_ptr(
+					new url_seed_alert(get_handle(), url, e.message()));
 			}
 
 			// the name lookup failed for the http host. Don't try
@@ -2195,7 +2351,7 @@ namespace libtorrent
 
 		if (m_ses.is_aborted()) return;
 
-		tcp::endpoint a(host->endpoint());
+		tcp::endpoint a(addresses.front(), proxy_port);
 
 		using boost::tuples::ignore;
 		std::string hostname;
@@ -2208,8 +2364,8 @@ namespace libtorrent
 		{
 			if (m_ses.m_alerts.should_post<url_seed_alert>())
 			{
-				m_ses.m_alerts.post_alert(
-					url_seed_alert(get_handle(), url, error));
+				m_ses.m_alerts.post_alert_ptr(
+					new url_seed_alert(get_handle(), url, error));
 			}
 			remove_url_seed(url);
 			return;
@@ -2218,17 +2374,17 @@ namespace libtorrent
 		if (m_ses.m_ip_filter.access(a.address()) & ip_filter::blocked)
 		{
 			if (m_ses.m_alerts.should_post<peer_blocked_alert>())
-				m_ses.m_alerts.post_alert(peer_blocked_alert(a.address()));
+				m_ses.m_alerts.post_alert_ptr(new peer_blocked_alert(a.address()));
 			return;
 		}
 
-		tcp::resolver::query q(hostname, boost::lexical_cast<std::string>(port));
-		m_host_resolver.async_resolve(q,
-			bind(&torrent::on_name_lookup, shared_from_this(), _1, _2, url, a));
+		m_ses.m_host_resolver.async_resolve(hostname,
+			bind(&torrent::on_name_lookup, shared_from_this(), _1, _2, url, port, a), this);
 	}
 
-	void torrent::on_name_lookup(error_code const& e, tcp::resolver::iterator host
-		, std::string url, tcp::endpoint proxy)
+	void torrent::on_name_lookup(error_code const& e
+		, std::vector<address> const& addresses, std::string url, int port
+		, tcp::endpoint proxy)
 	{
 		session_impl::mutex_t::scoped_lock l(m_ses.m_mutex);
 
@@ -2241,14 +2397,16 @@ namespace libtorrent
 		std::set<std::string>::iterator i = m_resolving_web_seeds.find(url);
 		if (i != m_resolving_web_seeds.end()) m_resolving_web_seeds.erase(i);
 
-		if (e || host == tcp::resolver::iterator())
+		if (m_abort) return;
+
+		if (e)
 		{
 			if (m_ses.m_alerts.should_post<url_seed_alert>())
 			{
 				std::stringstream msg;
 				msg << "HTTP seed hostname lookup failed: " << e.message();
-				m_ses.m_alerts.post_alert(
-					url_seed_alert(get_handle(), url, msg.str()));
+				m_ses.m_alerts.post_alert_ptr(
+					new url_seed_alert(get_handle(), url, msg.str()));
 			}
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_LOGGING || defined TORRENT_ERROR_LOGGING
 			(*m_ses.m_logger) << " ** HOSTNAME LOOKUP FAILED!**: " << url << "\n";
@@ -2262,12 +2420,12 @@ namespace libtorrent
 
 		if (m_ses.is_aborted()) return;
 
-		tcp::endpoint a(host->endpoint());
+		tcp::endpoint a(addresses.front(), port);
 
 		if (m_ses.m_ip_filter.access(a.address()) & ip_filter::blocked)
 		{
 			if (m_ses.m_alerts.should_post<peer_blocked_alert>())
-				m_ses.m_alerts.post_alert(peer_blocked_alert(a.address()));
+				m_ses.m_alerts.post_alert_ptr(new peer_blocked_alert(a.address()));
 			return;
 		}
 		
@@ -2308,17 +2466,13 @@ namespace libtorrent
 		}
 #endif
 
-		// add the newly connected peer to this torrent's peer list
-		m_connections.insert(boost::get_pointer(c));
-		m_ses.m_connections.insert(c);
-
 #ifndef BOOST_NO_EXCEPTIONS
 		try
 		{
 #endif
 			// add the newly connected peer to this torrent's peer list
-			m_connections.insert(boost::get_pointer(c));
-			m_ses.m_connections.insert(c);
+			m_connections.push_back(c.get());
+			m_ses.m_connections.push_back(c.get());
 			c->start();
 
 			m_ses.m_half_open.enqueue(
@@ -2357,9 +2511,8 @@ namespace libtorrent
 
 		m_resolving_country = true;
 		asio::ip::address_v4 reversed(swap_bytes(p->remote().address().to_v4().to_ulong()));
-		tcp::resolver::query q(reversed.to_string() + ".zz.countries.nerd.dk", "0");
-		m_host_resolver.async_resolve(q,
-			bind(&torrent::on_country_lookup, shared_from_this(), _1, _2, p));
+		m_ses.m_host_resolver.async_resolve(reversed.to_string() + ".zz.countries.nerd.dk"
+			, bind(&torrent::on_country_lookup, shared_from_this(), _1, _2, p), this);
 	}
 
 	namespace
@@ -2371,7 +2524,8 @@ namespace libtorrent
 		};
 	}
 
-	void torrent::on_country_lookup(error_code const& error, tcp::resolver::iterator i
+	void torrent::on_country_lookup(error_code const& error
+		, std::vector<address> const& addresses
 		, intrusive_ptr<peer_connection> p) const
 	{
 		session_impl::mutex_t::scoped_lock l(m_ses.m_mutex);
@@ -2433,7 +2587,7 @@ namespace libtorrent
 			, {876,  "WF"}, {882,  "WS"}, {887,  "YE"}, {891,  "CS"}, {894,  "ZM"}
 		};
 
-		if (error || i == tcp::resolver::iterator())
+		if (error)
 		{
 			// this is used to indicate that we shouldn't
 			// try to resolve it again
@@ -2441,12 +2595,12 @@ namespace libtorrent
 			return;
 		}
 
-		while (i != tcp::resolver::iterator()
-			&& !i->endpoint().address().is_v4()) ++i;
-		if (i != tcp::resolver::iterator())
+		std::vector<address>::const_iterator a = addresses.begin();
+		while (a != addresses.end() && !a->is_v4()) ++a;
+		if (a != addresses.end())
 		{
 			// country is an ISO 3166 country code
-			int country = i->endpoint().address().to_v4().to_ulong() & 0xffff;
+			int country = a->to_v4().to_ulong() & 0xffff;
 			
 			// look up the country code in the map
 			const int size = sizeof(country_map)/sizeof(country_map[0]);
@@ -2588,24 +2742,25 @@ namespace libtorrent
 				pieces[i] = m_picker->have_piece(i) ? 1 : 0;
 		}
 
-		// write local peers
+		// write local peers, as compact strings
 
-		entry::list_type& peer_list = ret["peers"].list();
-		entry::list_type& banned_peer_list = ret["banned_peers"].list();
+		std::back_insert_iterator<entry::string_type> peers(ret["peers"].string());
+		std::back_insert_iterator<entry::string_type> peers6(ret["peers6"].string());
+		std::back_insert_iterator<entry::string_type> banned_peers(ret["banned_peers"].string());
+		std::back_insert_iterator<entry::string_type> banned_peers6(ret["banned_peers6"].string());
 		
 		int max_failcount = m_ses.m_settings.max_failcount;
 
 		for (policy::const_iterator i = m_policy.begin_peer()
 			, end(m_policy.end_peer()); i != end; ++i)
 		{
-			error_code ec;
+			tcp::endpoint ep(i->second.addr, i->second.port);
 			if (i->second.banned)
 			{
-				entry peer(entry::dictionary_t);
-				peer["ip"] = i->second.addr.to_string(ec);
-				if (ec) continue;
-				peer["port"] = i->second.port;
-				banned_peer_list.push_back(peer);
+				if (ep.address().is_v4())
+					detail::write_endpoint(ep, banned_peers);
+				else
+					detail::write_endpoint(ep, banned_peers6);
 				continue;
 			}
 			// we cannot save remote connection
@@ -2620,11 +2775,10 @@ namespace libtorrent
 			// don't save peers that doesn't work
 			if (i->second.failcount >= max_failcount) continue;
 
-			entry peer(entry::dictionary_t);
-			peer["ip"] = i->second.addr.to_string(ec);
-			if (ec) continue;
-			peer["port"] = i->second.port;
-			peer_list.push_back(peer);
+			if (ep.address().is_v4())
+				detail::write_endpoint(ep, peers);
+			else
+				detail::write_endpoint(ep, peers6);
 		}
 
 		ret["upload_rate_limit"] = upload_limit();
@@ -2671,6 +2825,25 @@ namespace libtorrent
 		}
 	}
 
+	void torrent::post_peer_info()
+	{
+		std::vector<peer_info> v;
+		get_peer_info(v);
+		alerts().post_reply_ptr(new peer_info_alert(get_handle(), v));
+	}
+
+	void torrent::post_status()
+	{
+		alerts().post_reply_ptr(new torrent_status_alert(get_handle(), status()));
+	}
+
+	void torrent::post_file_progress()
+	{
+		std::vector<size_type> fp;
+		if (valid_metadata()) file_progress(fp);
+		alerts().post_reply_ptr(new file_progress_alert(get_handle(), fp));
+	}
+
 	void torrent::get_peer_info(std::vector<peer_info>& v)
 	{
 		v.clear();
@@ -2824,8 +2997,8 @@ namespace libtorrent
 #endif
 
 		// add the newly connected peer to this torrent's peer list
-		m_connections.insert(boost::get_pointer(c));
-		m_ses.m_connections.insert(c);
+		m_connections.push_back(c.get());
+		m_ses.m_connections.push_back(c.get());
 		peerinfo->connection = c.get();
 		c->start();
 
@@ -2844,9 +3017,7 @@ namespace libtorrent
 		}
 		catch (std::exception& e)
 		{
-			std::set<peer_connection*>::iterator i
-				= m_connections.find(boost::get_pointer(c));
-			if (i != m_connections.end()) m_connections.erase(i);
+			if (m_connections.contains(c.get())) m_connections.erase(c.get());
 			c->disconnect(e.what());
 			return false;
 		}
@@ -2867,7 +3038,7 @@ namespace libtorrent
 
 		if (m_ses.m_alerts.should_post<metadata_received_alert>())
 		{
-			m_ses.m_alerts.post_alert(metadata_received_alert(
+			m_ses.m_alerts.post_alert_ptr(new metadata_received_alert(
 				get_handle()));
 		}
 
@@ -2893,7 +3064,7 @@ namespace libtorrent
 			return false;
 		}
 		
-		if (m_ses.m_connections.find(p) == m_ses.m_connections.end())
+		if (!m_ses.m_connections.contains(p))
 		{
 			p->disconnect("peer is not properly constructed");
 			return false;
@@ -2937,8 +3108,8 @@ namespace libtorrent
 			return false;
 		}
 #endif
-		TORRENT_ASSERT(m_connections.find(p) == m_connections.end());
-		peer_iterator ci = m_connections.insert(p).first;
+		TORRENT_ASSERT(!m_connections.contains(p));
+		m_connections.push_back(p);
 #ifndef NDEBUG
 		error_code ec;
 		TORRENT_ASSERT(p->remote() == p->get_socket()->remote_endpoint(ec) || ec);
@@ -2968,7 +3139,7 @@ namespace libtorrent
 
 		while (!m_connections.empty())
 		{
-			peer_connection* p = *m_connections.begin();
+			peer_connection* p = m_connections.front();
 			TORRENT_ASSERT(p->associated_torrent().lock().get() == this);
 
 #if defined TORRENT_VERBOSE_LOGGING || defined TORRENT_ERROR_LOGGING
@@ -2978,10 +3149,10 @@ namespace libtorrent
 				(*p->m_logger) << "*** CLOSING CONNECTION 'pausing'\n";
 #endif
 #ifndef NDEBUG
-			std::size_t size = m_connections.size();
+			int size = m_connections.size();
 #endif
 			if (p->is_disconnecting())
-				m_connections.erase(m_connections.begin());
+				m_connections.erase(p);
 			else
 				p->disconnect(m_abort?"stopping torrent":"pausing torrent");
 			TORRENT_ASSERT(m_connections.size() <= size);
@@ -3151,7 +3322,7 @@ namespace libtorrent
 
 		if (alerts().should_post<torrent_finished_alert>())
 		{
-			alerts().post_alert(torrent_finished_alert(
+			alerts().post_alert_ptr(new torrent_finished_alert(
 				get_handle()));
 		}
 
@@ -3281,9 +3452,13 @@ namespace libtorrent
 
 		set_state(torrent_status::downloading);
 
+		// an allocation interrupted by a recheck is only
+		// started over below, if there's anything left to get
+		m_allocation_progress = 1.f;
+
 		if (m_ses.m_alerts.should_post<torrent_checked_alert>())
 		{
-			m_ses.m_alerts.post_alert(torrent_checked_alert(
+			m_ses.m_alerts.post_alert_ptr(new torrent_checked_alert(
 				get_handle()));
 		}
 		
@@ -3298,6 +3473,11 @@ namespace libtorrent
 				m_ses.m_auto_manage_time_scaler = 1;
 
 			if (is_finished()) finished();
+			else if (m_storage_mode == storage_mode_allocate)
+			{
+				m_allocation_progress = 0.f;
+				if (!is_paused()) start_allocating();
+			}
 		}
 		else
 		{
@@ -3333,6 +3513,12 @@ namespace libtorrent
 				pc->init();
 			}
 		}
+		else
+		{
+			// the set of pieces we have may have changed
+			// while checking
+			update_wanted_pieces();
+		}
 
 		m_files_checked = true;
 
@@ -3384,9 +3570,10 @@ namespace libtorrent
 
 		if (alerts().should_post<storage_moved_alert>())
 		{
-			alerts().post_alert(storage_moved_alert(get_handle(), j.str));
+			alerts().post_alert_ptr(new storage_moved_alert(get_handle(), j.str));
 		}
 		m_save_path = j.str;
+		m_need_save_resume_data = true;
 	}
 
 	piece_manager& torrent::filesystem()
@@ -3622,6 +3809,7 @@ namespace libtorrent
 		TORRENT_ASSERT(limit >= -1);
 		if (limit <= 0) limit = (std::numeric_limits<int>::max)();
 		m_max_uploads = limit;
+		m_need_save_resume_data = true;
 	}
 
 	void torrent::set_max_connections(int limit)
@@ -3629,6 +3817,7 @@ namespace libtorrent
 		TORRENT_ASSERT(limit >= -1);
 		if (limit <= 0) limit = (std::numeric_limits<int>::max)();
 		m_max_connections = limit;
+		m_need_save_resume_data = true;
 	}
 
 	void torrent::set_peer_upload_limit(tcp::endpoint ip, int limit)
@@ -3655,6 +3844,7 @@ namespace libtorrent
 		if (limit <= 0) limit = (std::numeric_limits<int>::max)();
 		if (limit < num_peers() * 10) limit = num_peers() * 10;
 		m_bandwidth_limit[peer_connection::upload_channel].throttle(limit);
+		m_need_save_resume_data = true;
 	}
 
 	int torrent::upload_limit() const
@@ -3670,6 +3860,7 @@ namespace libtorrent
 		if (limit <= 0) limit = (std::numeric_limits<int>::max)();
 		if (limit < num_peers() * 10) limit = num_peers() * 10;
 		m_bandwidth_limit[peer_connection::download_channel].throttle(limit);
+		m_need_save_resume_data = true;
 	}
 
 	int torrent::download_limit() const
@@ -3706,6 +3897,7 @@ namespace libtorrent
 		if (m_ses.m_auto_manage_time_scaler > 2)
 			m_ses.m_auto_manage_time_scaler = 2;
 		m_error.clear();
+		state_updated();
 	}
 
 	void torrent::auto_managed(bool a)
@@ -3714,6 +3906,7 @@ namespace libtorrent
 
 		if (m_auto_managed == a) return;
 		m_auto_managed = a;
+		m_need_save_resume_data = true;
 		// recalculate which torrents should be
 		// paused
 		m_ses.m_auto_manage_time_scaler = 0;
@@ -3789,7 +3982,7 @@ namespace libtorrent
 			{
 				if (alerts().should_post<save_resume_data_failed_alert>())
 				{
-					alerts().post_alert(save_resume_data_failed_alert(get_handle()
+					alerts().post_alert_ptr(new save_resume_data_failed_alert(get_handle()
 						, "won't save resume data, torrent does not have a complete resume state yet"));
 				}
 			}
@@ -3803,7 +3996,7 @@ namespace libtorrent
 		{
 			if (alerts().should_post<save_resume_data_failed_alert>())
 			{
-				alerts().post_alert(save_resume_data_failed_alert(get_handle()
+				alerts().post_alert_ptr(new save_resume_data_failed_alert(get_handle()
 					, "save resume data failed, torrent is being destructed"));
 			}
 		}
@@ -3820,6 +4013,7 @@ namespace libtorrent
 
 		if (m_paused) return;
 		m_paused = true;
+		m_need_save_resume_data = true;
 		if (m_ses.is_paused()) return;
 		do_pause();
 	}
@@ -3827,6 +4021,7 @@ namespace libtorrent
 	void torrent::do_pause()
 	{
 		if (!is_paused()) return;
+		state_updated();
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		for (extension_list_t::iterator i = m_extensions.begin()
@@ -3862,7 +4057,7 @@ namespace libtorrent
 		else
 		{
 			if (alerts().should_post<torrent_paused_alert>())
-				alerts().post_alert(torrent_paused_alert(get_handle()));
+				alerts().post_alert_ptr(new torrent_paused_alert(get_handle()));
 		}
 
 		disconnect_all();
@@ -3875,12 +4070,14 @@ namespace libtorrent
 
 		if (!m_paused) return;
 		m_paused = false;
+		m_need_save_resume_data = true;
 		do_resume();
 	}
 
 	void torrent::do_resume()
 	{
 		if (is_paused()) return;
+		state_updated();
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		for (extension_list_t::iterator i = m_extensions.begin()
@@ -3897,11 +4094,17 @@ namespace libtorrent
 #endif
 
 		if (alerts().should_post<torrent_resumed_alert>())
-			alerts().post_alert(torrent_resumed_alert(get_handle()));
+			alerts().post_alert_ptr(new torrent_resumed_alert(get_handle()));
 
 		m_started = time_now();
 		m_error.clear();
 		start_announcing();
+
+		// pick up allocating the storage where it was paused
+		if (m_allocation_progress < 1.f
+			&& m_state != torrent_status::queued_for_checking
+			&& m_state != torrent_status::checking_files)
+			start_allocating();
 	}
 
 	void torrent::restart_tracker_timer(ptime announce_at)
@@ -3956,10 +4159,25 @@ namespace libtorrent
 			announce_with_tracker(tracker_request::stopped);
 	}
 
+	void torrent::state_updated()
+	{
+		if (m_in_state_updates) return;
+		m_ses.m_state_updates.push_back(shared_from_this());
+		m_in_state_updates = true;
+	}
+
 	void torrent::second_tick(stat& accumulator, float tick_interval)
 	{
 		INVARIANT_CHECK;
 
+		// any torrent that is transferring or has peers
+		// will have changed its status this tick
+		if (!m_connections.empty()
+			|| m_stat.download_rate() > 0.f
+			|| m_stat.upload_rate() > 0.f
+			|| m_state == torrent_status::checking_files)
+			state_updated();
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		for (extension_list_t::iterator i = m_extensions.begin()
 			, end(m_extensions.end()); i != end; ++i)
@@ -4003,28 +4221,36 @@ namespace libtorrent
 		if (!is_finished() && !m_web_seeds.empty())
 		{
 			// keep trying web-seeds if there are any
-			// first find out which web seeds we are connected to
-			std::set<std::string> web_seeds;
+			// first find out how many connections we have to each web seed
+			std::map<std::string, int> web_seeds;
 			for (peer_iterator i = m_connections.begin();
 				i != m_connections.end(); ++i)
 			{
 				web_peer_connection* p
 					= dynamic_cast<web_peer_connection*>(*i);
 				if (!p) continue;
-				web_seeds.insert(p->url());
+				++web_seeds[p->url()];
 			}
 
+			// don't open any more connections to web seeds whose
+			// hostname is still being looked up
+			const int max_connections = m_ses.settings().urlseed_max_connections;
 			for (std::set<std::string>::iterator i = m_resolving_web_seeds.begin()
 				, end(m_resolving_web_seeds.end()); i != end; ++i)
-				web_seeds.insert(web_seeds.begin(), *i);
+				web_seeds[*i] = max_connections;
 
-			// from the list of available web seeds, subtract the ones we are
-			// already connected to.
+			// from the list of available web seeds, pick the ones we
+			// have fewer than the max number of connections to
 			std::vector<std::string> not_connected_web_seeds;
-			std::set_difference(m_web_seeds.begin(), m_web_seeds.end(), web_seeds.begin()
-				, web_seeds.end(), std::back_inserter(not_connected_web_seeds));
+			for (std::set<std::string>::iterator i = m_web_seeds.begin()
+				, end(m_web_seeds.end()); i != end; ++i)
+			{
+				std::map<std::string, int>::iterator j = web_seeds.find(*i);
+				if (j != web_seeds.end() && j->second >= max_connections) continue;
+				not_connected_web_seeds.push_back(*i);
+			}
 
-			// connect to all of those that we aren't connected to
+			// open one more connection to each of them
 			std::for_each(not_connected_web_seeds.begin(), not_connected_web_seeds.end()
 				, bind(&torrent::connect_to_url_seed, this, _1));
 		}
@@ -4130,7 +4356,7 @@ namespace libtorrent
 		if (ret == -1)
 		{
 			if (alerts().should_post<file_error_alert>())
-				alerts().post_alert(file_error_alert(j.error_file, get_handle(), j.str));
+				alerts().post_alert_ptr(new file_error_alert(j.error_file, get_handle(), j.str));
 			m_error = j.str;
 			pause();
 		}
@@ -4152,9 +4378,9 @@ namespace libtorrent
 		file_progress(progress);
 		for (int i = 0; i < m_torrent_file->num_files(); ++i)
 		{
-			file_entry const& f = m_torrent_file->file_at(i);
-			if (f.size == 0) fp[i] = 1.f;
-			else fp[i] = float(progress[i]) / f.size;
+			size_type size = m_torrent_file->files().file_size(i);
+			if (size == 0) fp[i] = 1.f;
+			else fp[i] = float(progress[i]) / size;
 		}
 	}
 
@@ -4167,7 +4393,7 @@ namespace libtorrent
 		if (is_seed())
 		{
 			for (int i = 0; i < m_torrent_file->num_files(); ++i)
-				fp[i] = m_torrent_file->files().at(i).size;
+				fp[i] = m_torrent_file->files().file_size(i);
 			return;
 		}
 		
@@ -4176,7 +4402,7 @@ namespace libtorrent
 		for (int i = 0; i < m_torrent_file->num_files(); ++i)
 		{
 			peer_request ret = m_torrent_file->files().map_file(i, 0, 0);
-			size_type size = m_torrent_file->files().at(i).size;
+			size_type size = m_torrent_file->files().file_size(i);
 
 // zero sized files are considered
 // 100% done all the time
@@ -4295,8 +4521,9 @@ namespace libtorrent
 	{
 		if (m_state == s) return;
 		m_state = s;
+		state_updated();
 		if (m_ses.m_alerts.should_post<state_changed_alert>())
-			m_ses.m_alerts.post_alert(state_changed_alert(get_handle(), s));
+			m_ses.m_alerts.post_alert_ptr(new state_changed_alert(get_handle(), s));
 	}
 
 	torrent_status torrent::status() const
@@ -4307,6 +4534,7 @@ namespace libtorrent
 
 		torrent_status st;
 
+		st.info_hash = info_hash();
 		st.has_incoming = m_has_incoming;
 		st.error = m_error;
 
@@ -4419,6 +4647,8 @@ namespace libtorrent
 
 		TORRENT_ASSERT(st.total_wanted >= st.total_wanted_done);
 
+		st.allocation_progress = m_allocation_progress;
+
 		if (m_state == torrent_status::checking_files)
 			st.progress = m_progress;
 		else if (st.total_wanted == 0) st.progress = 1.f;
@@ -4478,7 +4708,7 @@ namespace libtorrent
 		{
 			if (m_ses.m_alerts.should_post<tracker_error_alert>())
 			{
-				m_ses.m_alerts.post_alert(tracker_error_alert(get_handle()
+				m_ses.m_alerts.post_alert_ptr(new tracker_error_alert(get_handle()
 					, m_failed_trackers + 1, 0, r.url, "tracker timed out"));
 			}
 		}
@@ -4486,7 +4716,7 @@ namespace libtorrent
 		{
 			if (m_ses.m_alerts.should_post<scrape_failed_alert>())
 			{
-				m_ses.m_alerts.post_alert(scrape_failed_alert(get_handle()
+				m_ses.m_alerts.post_alert_ptr(new scrape_failed_alert(get_handle()
 					, r.url, "tracker timed out"));
 			}
 		}
@@ -4512,7 +4742,7 @@ namespace libtorrent
 		{
 			if (m_ses.m_alerts.should_post<tracker_error_alert>())
 			{
-				m_ses.m_alerts.post_alert(tracker_error_alert(get_handle()
+				m_ses.m_alerts.post_alert_ptr(new tracker_error_alert(get_handle()
 					, m_failed_trackers + 1, response_code, r.url, str));
 			}
 		}
@@ -4520,7 +4750,7 @@ namespace libtorrent
 		{
 			if (m_ses.m_alerts.should_post<scrape_failed_alert>())
 			{
-				m_ses.m_alerts.post_alert(scrape_failed_alert(get_handle(), r.url, str));
+				m_ses.m_alerts.post_alert_ptr(new scrape_failed_alert(get_handle(), r.url, str));
 			}
 		}
 
@@ -120,6 +120,23 @@ using libtorrent::aux::session_impl;
 
 #endif
 
+// posts the call to the network thread instead of blocking the
+// calling thread on the session mutex. The torrent is kept alive
+// by the shared_ptr bound into the handler
+#ifdef BOOST_NO_EXCEPTIONS
+#define TORRENT_ASYNC_CALL(f) \
+	boost::shared_ptr<torrent> t = m_torrent.lock(); \
+	if (!t) return; \
+	t->session().m_io_service.post(boost::bind(&call_locked, t \
+		, boost::function<void()>(f)))
+#else
+#define TORRENT_ASYNC_CALL(f) \
+	boost::shared_ptr<torrent> t = m_torrent.lock(); \
+	if (!t) throw_invalid_handle(); \
+	t->session().m_io_service.post(boost::bind(&call_locked, t \
+		, boost::function<void()>(f)))
+#endif
+
 namespace libtorrent
 {
 	namespace fs = boost::filesystem;
@@ -132,6 +149,15 @@ namespace libtorrent
 			throw invalid_handle();
 		}
 #endif
+
+		// executed in the network thread
+		void call_locked(boost::shared_ptr<torrent> t
+			, boost::function<void()> const& f)
+		{
+			session_impl::mutex_t::scoped_lock l(t->session().m_mutex);
+			if (t->is_aborted()) return;
+			f();
+		}
 	}
 
 #ifndef NDEBUG
@@ -265,6 +291,12 @@ namespace libtorrent
 		TORRENT_FORWARD(save_resume_data());
 	}
 
+	bool torrent_handle::need_save_resume_data() const
+	{
+		INVARIANT_CHECK;
+		TORRENT_FORWARD_RETURN(need_save_resume_data(), false);
+	}
+
 	void torrent_handle::force_recheck() const
 	{
 		INVARIANT_CHECK;
@@ -352,6 +384,60 @@ namespace libtorrent
 		TORRENT_FORWARD_RETURN(status(), torrent_status());
 	}
 
+	void torrent_handle::async_get_peer_info() const
+	{
+		INVARIANT_CHECK;
+		TORRENT_ASYNC_CALL(bind(&torrent::post_peer_info, t.get()));
+	}
+
+	void torrent_handle::async_status() const
+	{
+		INVARIANT_CHECK;
+		TORRENT_ASYNC_CALL(bind(&torrent::post_status, t.get()));
+	}
+
+	void torrent_handle::async_file_progress() const
+	{
+		INVARIANT_CHECK;
+		TORRENT_ASYNC_CALL(bind(&torrent::post_file_progress, t.get()));
+	}
+
+	void torrent_handle::async_pause() const
+	{
+		INVARIANT_CHECK;
+		TORRENT_ASYNC_CALL(bind(&torrent::pause, t.get()));
+	}
+
+	void torrent_handle::async_resume() const
+	{
+		INVARIANT_CHECK;
+		TORRENT_ASYNC_CALL(bind(&torrent::resume, t.get()));
+	}
+
+	void torrent_handle::async_piece_priority(int index, int priority) const
+	{
+		INVARIANT_CHECK;
+		TORRENT_ASYNC_CALL(bind(&torrent::set_piece_priority, t.get(), index, priority));
+	}
+
+	void torrent_handle::async_prioritize_pieces(std::vector<int> const& pieces) const
+	{
+		INVARIANT_CHECK;
+		TORRENT_ASYNC_CALL(bind(&torrent::prioritize_pieces, t.get(), pieces));
+	}
+
+	void torrent_handle::async_file_priority(int index, int priority) const
+	{
+		INVARIANT_CHECK;
+		TORRENT_ASYNC_CALL(bind(&torrent::set_file_priority, t.get(), index, priority));
+	}
+
+	void torrent_handle::async_prioritize_files(std::vector<int> const& files) const
+	{
+		INVARIANT_CHECK;
+		TORRENT_ASYNC_CALL(bind(&torrent::prioritize_files, t.get(), files));
+	}
+
 	void torrent_handle::set_sequential_download(bool sd) const
 	{
 		INVARIANT_CHECK;
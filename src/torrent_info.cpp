@@ -341,6 +341,25 @@ namespace libtorrent
 		swap(m_info_dict, ti.m_info_dict);
 	}
 
+	size_type torrent_info::memory_usage() const
+	{
+		size_type ret = sizeof(torrent_info)
+			+ m_files.memory_usage()
+			+ m_info_section_size
+			+ m_urls.capacity() * sizeof(announce_entry)
+			+ m_url_seeds.capacity() * sizeof(std::string)
+			+ m_nodes.capacity() * sizeof(nodes_t::value_type)
+			+ m_comment.capacity()
+			+ m_created_by.capacity();
+		for (std::vector<announce_entry>::const_iterator i = m_urls.begin()
+			, end(m_urls.end()); i != end; ++i)
+			ret += i->url.capacity();
+		for (std::vector<std::string>::const_iterator i = m_url_seeds.begin()
+			, end(m_url_seeds.end()); i != end; ++i)
+			ret += i->capacity();
+		return ret;
+	}
+
 	bool torrent_info::parse_info_section(lazy_entry const& info, std::string& error)
 	{
 		if (info.type() != lazy_entry::dict_t)
@@ -609,7 +628,7 @@ namespace libtorrent
 		os << "piece length: " << piece_length() << "\n";
 		os << "files:\n";
 		for (file_storage::iterator i = m_files.begin(); i != m_files.end(); ++i)
-			os << "  " << std::setw(11) << i->size << "  " << i->path.string() << "\n";
+			os << "  " << std::setw(11) << i->size << "  " << m_files.file_path(*i).string() << "\n";
 	}
 
 // ------- end deprecation -------
@@ -213,6 +213,22 @@ namespace libtorrent
 		}
 		else if (protocol == "udp")
 		{
+			// if there's a scrape to this tracker that hasn't been
+			// sent yet, add this info-hash to it instead of making
+			// a separate request
+			if (req.kind == tracker_request::scrape_request)
+			{
+				for (tracker_connections_t::iterator i = m_connections.begin()
+					, end(m_connections.end()); i != end; ++i)
+				{
+					udp_tracker_connection* uc = dynamic_cast<udp_tracker_connection*>(i->get());
+					if (uc == 0 || !uc->add_scrape(req, c)) continue;
+					if (boost::shared_ptr<request_callback> cb = c.lock())
+						cb->m_manager = this;
+					return;
+				}
+			}
+
 			con = new udp_tracker_connection(
 				ios, cc, *this, req, bind_infc
 				, c, m_settings, m_proxy);
@@ -231,6 +247,40 @@ namespace libtorrent
 		if (cb) cb->m_manager = this;
 	}
 
+	bool tracker_manager::get_udp_connection_id(udp::endpoint const& ep
+		, boost::int64_t& id)
+	{
+		mutex_t::scoped_lock l(m_mutex);
+
+		udp_conn_ids_t::iterator i = m_udp_conn_ids.find(ep);
+		if (i == m_udp_conn_ids.end()) return false;
+		if (i->second.expires < time_now())
+		{
+			m_udp_conn_ids.erase(i);
+			return false;
+		}
+		id = i->second.id;
+		return true;
+	}
+
+	void tracker_manager::set_udp_connection_id(udp::endpoint const& ep
+		, boost::int64_t id)
+	{
+		mutex_t::scoped_lock l(m_mutex);
+
+		udp_connection_id& cid = m_udp_conn_ids[ep];
+		cid.id = id;
+		// the connection ID is valid for one minute. Leave
+		// some margin for the round-trip to the tracker
+		cid.expires = time_now() + seconds(50);
+	}
+
+	void tracker_manager::forget_udp_connection_id(udp::endpoint const& ep)
+	{
+		mutex_t::scoped_lock l(m_mutex);
+		m_udp_conn_ids.erase(ep);
+	}
+
 	void tracker_manager::abort_all_requests()
 	{
 		// removes all connections from m_connections
@@ -267,6 +317,7 @@ namespace libtorrent
 		}
 
 		std::swap(m_connections, keep_connections);
+		m_http_pool.clear();
 	}
 	
 	bool tracker_manager::empty() const
@@ -84,13 +84,14 @@ namespace libtorrent
 		, proxy_settings const& proxy)
 		: tracker_connection(man, req, ios, bind_infc, c)
 		, m_man(man)
-		, m_name_lookup(ios)
 		, m_socket(ios, boost::bind(&udp_tracker_connection::on_receive, self(), _1, _2, _3, _4), cc)
 		, m_transaction_id(0)
 		, m_connection_id(0)
 		, m_settings(stn)
 		, m_attempts(0)
 		, m_state(action_error)
+		, m_cached_connection_id(false)
+		, m_abort(false)
 	{
 		m_socket.set_proxy_settings(proxy);
 
@@ -108,10 +109,8 @@ namespace libtorrent
 			return;
 		}
 		
-		udp::resolver::query q(hostname, boost::lexical_cast<std::string>(port));
-		m_name_lookup.async_resolve(q
-			, boost::bind(
-			&udp_tracker_connection::name_lookup, self(), _1, _2));
+		m_man.host_resolver().async_resolve(hostname, boost::bind(
+			&udp_tracker_connection::name_lookup, self(), _1, _2, port));
 		set_timeout(req.event == tracker_request::stopped
 			? m_settings.stop_tracker_timeout
 			: m_settings.tracker_completion_timeout
@@ -123,10 +122,10 @@ namespace libtorrent
 	}
 
 	void udp_tracker_connection::name_lookup(error_code const& error
-		, udp::resolver::iterator i)
+		, std::vector<address> const& addresses, int port)
 	{
-		if (error == asio::error::operation_aborted) return;
-		if (error || i == udp::resolver::iterator())
+		if (m_abort || error == asio::error::operation_aborted) return;
+		if (error || addresses.empty())
 		{
 			fail(-1, error.message().c_str());
 			return;
@@ -141,10 +140,10 @@ namespace libtorrent
 		// look for an address that has the same kind as the one
 		// we're listening on. To make sure the tracker get our
 		// correct listening address.
-		udp::resolver::iterator target = i;
-		udp::resolver::iterator end;
-		udp::endpoint target_address = *i;
-		for (; target != end && target->endpoint().address().is_v4()
+		std::vector<address>::const_iterator target = addresses.begin();
+		std::vector<address>::const_iterator end = addresses.end();
+		udp::endpoint target_address(addresses.front(), port);
+		for (; target != end && target->is_v4()
 			!= bind_interface().is_v4(); ++target);
 		if (target == end)
 		{
@@ -160,7 +159,7 @@ namespace libtorrent
 		}
 		else
 		{
-			target_address = *target;
+			target_address = udp::endpoint(*target, port);
 		}
 		
 		if (cb) cb->m_tracker_address = tcp::endpoint(target_address.address(), target_address.port());
@@ -172,6 +171,18 @@ namespace libtorrent
 			fail(-1, ec.message().c_str());
 			return;
 		}
+
+		// if another request to this tracker got a connection
+		// ID recently, use it and skip the connect round-trip
+		if (m_man.get_udp_connection_id(m_target, m_connection_id))
+		{
+			m_cached_connection_id = true;
+			if (tracker_req().kind == tracker_request::announce_request)
+				send_udp_announce();
+			else if (tracker_req().kind == tracker_request::scrape_request)
+				send_udp_scrape();
+			return;
+		}
 		send_udp_connect();
 	}
 
@@ -182,7 +193,17 @@ namespace libtorrent
 		if (cb) cb->debug_log("*** UDP_TRACKER [ timed out ]");
 #endif
 		m_socket.close();
-		m_name_lookup.cancel();
+		m_abort = true;
+		extra_scrapes_t extra;
+		{
+			boost::mutex::scoped_lock l(m_scrape_mutex);
+			extra.swap(m_extra_scrapes);
+		}
+		for (extra_scrapes_t::iterator i = extra.begin(), end(extra.end()); i != end; ++i)
+		{
+			boost::shared_ptr<request_callback> cb = i->second.lock();
+			if (cb) cb->tracker_request_timed_out(i->first);
+		}
 		fail_timeout();
 	}
 
@@ -190,10 +211,42 @@ namespace libtorrent
 	{
 		error_code ec;
 		m_socket.close();
-		m_name_lookup.cancel();
+		m_abort = true;
 		tracker_connection::close();
 	}
 
+	void udp_tracker_connection::fail(int code, char const* msg)
+	{
+		// the scrapes that were added to this one fail with it
+		extra_scrapes_t extra;
+		{
+			boost::mutex::scoped_lock l(m_scrape_mutex);
+			extra.swap(m_extra_scrapes);
+		}
+		for (extra_scrapes_t::iterator i = extra.begin(), end(extra.end()); i != end; ++i)
+		{
+			boost::shared_ptr<request_callback> cb = i->second.lock();
+			if (cb) cb->tracker_request_error(i->first, code, msg);
+		}
+		tracker_connection::fail(code, msg);
+	}
+
+	bool udp_tracker_connection::add_scrape(tracker_request const& req
+		, boost::weak_ptr<request_callback> c)
+	{
+		TORRENT_ASSERT(req.kind == tracker_request::scrape_request);
+		boost::mutex::scoped_lock l(m_scrape_mutex);
+		// once the scrape has been sent, it's too late
+		if (m_state == action_scrape) return false;
+		if (tracker_req().kind != tracker_request::scrape_request) return false;
+		if (tracker_req().url != req.url) return false;
+		// the request already carries its own info-hash, so a
+		// full packet has max_scrape_hashes - 1 extra ones
+		if (int(m_extra_scrapes.size()) >= max_scrape_hashes - 1) return false;
+		m_extra_scrapes.push_back(std::make_pair(req, c));
+		return true;
+	}
+
 	void udp_tracker_connection::on_receive(error_code const& e
 		, udp::endpoint const& ep, char const* buf, int size)
 	{
@@ -240,6 +293,17 @@ namespace libtorrent
 
 		if (action == action_error)
 		{
+			if (m_cached_connection_id)
+			{
+				// the connection ID we got from the cache may have
+				// expired on the tracker's end. Get a new one
+				m_man.forget_udp_connection_id(m_target);
+				m_cached_connection_id = false;
+				m_transaction_id = 0;
+				m_attempts = 0;
+				send_udp_connect();
+				return;
+			}
 			fail(-1, std::string(ptr, size - 8).c_str());
 			return;
 		}
@@ -283,6 +347,7 @@ namespace libtorrent
 		m_transaction_id = 0;
 		m_attempts = 0;
 		m_connection_id = detail::read_int64(buf);
+		m_man.set_udp_connection_id(m_target, m_connection_id);
 
 		if (tracker_req().kind == tracker_request::announce_request)
 			send_udp_announce();
@@ -332,7 +397,7 @@ namespace libtorrent
 
 		if (!m_socket.is_open()) return; // the operation was aborted
 
-		char buf[8 + 4 + 4 + 20];
+		char buf[8 + 4 + 4 + 20 * max_scrape_hashes];
 		char* out = buf;
 
 		detail::write_int64(m_connection_id, out); // connection_id
@@ -341,10 +406,22 @@ namespace libtorrent
 		// info_hash
 		std::copy(tracker_req().info_hash.begin(), tracker_req().info_hash.end(), out);
 		out += 20;
-		TORRENT_ASSERT(out - buf == sizeof(buf));
+		// the info-hashes of the scrapes that were added to this one.
+		// Once m_state is action_scrape, no more can be added
+		{
+			boost::mutex::scoped_lock l(m_scrape_mutex);
+			m_state = action_scrape;
+			for (extra_scrapes_t::iterator i = m_extra_scrapes.begin()
+				, end(m_extra_scrapes.end()); i != end; ++i)
+			{
+				std::copy(i->first.info_hash.begin(), i->first.info_hash.end(), out);
+				out += 20;
+			}
+		}
+		TORRENT_ASSERT(out - buf <= int(sizeof(buf)));
 
 		error_code ec;
-		m_socket.send(m_target, buf, sizeof(buf), ec);
+		m_socket.send(m_target, buf, out - buf, ec);
 		m_state = action_scrape;
 		++m_attempts;
 		if (ec)
@@ -387,22 +464,12 @@ namespace libtorrent
 		}
 
 		std::vector<peer_entry> peer_list;
+		std::vector<tcp::endpoint> endpoints;
+		endpoints.reserve(num_peers);
 		for (int i = 0; i < num_peers; ++i)
-		{
-			// TODO: don't use a string here
-			peer_entry e;
-			std::stringstream s;
-			s << (int)detail::read_uint8(buf) << ".";
-			s << (int)detail::read_uint8(buf) << ".";
-			s << (int)detail::read_uint8(buf) << ".";
-			s << (int)detail::read_uint8(buf);
-			e.ip = s.str();
-			e.port = detail::read_uint16(buf);
-			e.pid.clear();
-			peer_list.push_back(e);
-		}
+			endpoints.push_back(detail::read_v4_endpoint<tcp::endpoint>(buf));
 
-		cb->tracker_response(tracker_req(), peer_list, interval
+		cb->tracker_response(tracker_req(), peer_list, endpoints, interval
 			, complete, incomplete, address());
 
 		m_man.remove_request(this);
@@ -411,40 +478,43 @@ namespace libtorrent
 
 	void udp_tracker_connection::on_scrape_response(char const* buf, int size)
 	{
+		// the action and transaction id have already been
+		// verified by on_receive()
 		buf += 8; // skip header
 
 		restart_read_timeout();
-		int action = detail::read_int32(buf);
-		int transaction = detail::read_int32(buf);
 
-		if (transaction != m_transaction_id)
+		// there's one 12 byte entry per info-hash, in the
+		// same order as they were sent in the request
+		int num_extra;
 		{
-			fail(-1, "incorrect transaction id");
-			return;
+			boost::mutex::scoped_lock l(m_scrape_mutex);
+			num_extra = int(m_extra_scrapes.size());
 		}
-
-		if (action == action_error)
+		if (size < 8 + 12 * (1 + num_extra))
 		{
-			fail(-1, std::string(buf, size - 8).c_str());
+			fail(-1, "invalid udp tracker scrape response length");
 			return;
 		}
 
-		if (action != action_scrape)
+		int complete = detail::read_int32(buf);
+		int downloaded = detail::read_int32(buf);
+		int incomplete = detail::read_int32(buf);
+
+		extra_scrapes_t extra;
 		{
-			fail(-1, "invalid action in announce response");
-			return;
+			boost::mutex::scoped_lock l(m_scrape_mutex);
+			extra.swap(m_extra_scrapes);
 		}
-
-		if (size < 20)
+		for (extra_scrapes_t::iterator i = extra.begin(), end(extra.end()); i != end; ++i)
 		{
-			fail(-1, "got a message with size < 20");
-			return;
+			int c = detail::read_int32(buf);
+			int d = detail::read_int32(buf);
+			int inc = detail::read_int32(buf);
+			boost::shared_ptr<request_callback> cb = i->second.lock();
+			if (cb) cb->tracker_scrape_response(i->first, c, inc, d);
 		}
 
-		int complete = detail::read_int32(buf);
-		int downloaded = detail::read_int32(buf);
-		int incomplete = detail::read_int32(buf);
-
 		boost::shared_ptr<request_callback> cb = requester();
 		if (!cb)
 		{
@@ -141,7 +141,7 @@ namespace libtorrent { namespace
 
 				if (m_torrent.alerts().should_post<metadata_failed_alert>())
 				{
-					m_torrent.alerts().post_alert(metadata_failed_alert(
+					m_torrent.alerts().post_alert_ptr(new metadata_failed_alert(
 						m_torrent.get_handle()));
 				}
 
@@ -296,6 +296,7 @@ namespace libtorrent { namespace
 			io::write_uint8(m_message_index, header);
 
 			m_pc.send_buffer(msg, len + 6);
+			m_pc.sent_message();
 			if (metadata_piece_size) m_pc.append_send_buffer(
 				(char*)metadata, metadata_piece_size, &nop);
 		}
@@ -37,6 +37,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
 
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -70,21 +71,56 @@ namespace libtorrent { namespace
 		return true;
 	}
 
+	// used as the destructor of pex messages appended to
+	// send buffers. It keeps the shared message alive until
+	// the connection has sent it
+	void release_pex_msg(boost::shared_ptr<std::vector<char> > const&, char*) {}
+
 	struct ut_pex_plugin: torrent_plugin
 	{
 		ut_pex_plugin(torrent& t): m_torrent(t), m_1_minute(55) {}
 	
 		virtual boost::shared_ptr<peer_plugin> new_connection(peer_connection* pc);
 
-		std::vector<char>& get_ut_pex_msg()
+		boost::shared_ptr<std::vector<char> > const& get_ut_pex_msg() const
 		{
 			return m_ut_pex_msg;
 		}
 
+		boost::shared_ptr<std::vector<char> > const& get_ut_pex_full_msg() const
+		{
+			return m_ut_pex_full_msg;
+		}
+
+		// called by the peer plugins when an outgoing connection
+		// has been established and when it is closed. This keeps
+		// the added and dropped lists up to date without scanning
+		// all connections
+		void peer_connected(bt_peer_connection& p)
+		{
+			tcp::endpoint const& remote = p.remote();
+			if (!m_peers.insert(std::make_pair(remote, &p)).second) return;
+			// if the peer was dropped and came back before the
+			// next message, the other peers never knew it was gone
+			if (m_dropped.erase(remote) == 0) m_added.insert(remote);
+		}
+
+		void peer_disconnected(bt_peer_connection& p)
+		{
+			std::map<tcp::endpoint, bt_peer_connection*>::iterator i
+				= m_peers.find(p.remote());
+			if (i == m_peers.end() || i->second != &p) return;
+			m_peers.erase(i);
+			// if the peer hasn't been sent out yet, there's no
+			// need to tell anyone it was dropped
+			if (m_added.erase(p.remote()) == 0) m_dropped.insert(p.remote());
+		}
+
 		// the second tick of the torrent
 		// each minute the new lists of "added" + "added.f" and "dropped"
-		// are calculated here and the pex message is created
-		// each peer connection will use this message
+		// are encoded here, along with the full list of peers sent
+		// to connections that haven't received any pex message yet.
+		// each peer connection will use these messages
 		// max_peer_entries limits the packet size
 		virtual void tick()
 		{
@@ -106,88 +142,120 @@ namespace libtorrent { namespace
 			std::back_insert_iterator<std::string> pld6_out(pld6);
 			std::back_insert_iterator<std::string> plf6_out(plf6);
 
-			std::set<tcp::endpoint> dropped;
-			m_old_peers.swap(dropped);
-
+			// don't write too big of a package. Peers that don't
+			// fit are sent with the next message
 			int num_added = 0;
-			for (torrent::peer_iterator i = m_torrent.begin()
-				, end(m_torrent.end()); i != end; ++i)
+			while (!m_added.empty() && num_added < max_peer_entries)
 			{
-				peer_connection* peer = *i;
-				if (!send_peer(*peer)) continue;
-
-				tcp::endpoint const& remote = peer->remote();
-				m_old_peers.insert(remote);
-
-				std::set<tcp::endpoint>::iterator di = dropped.find(remote);
-				if (di == dropped.end())
+				std::set<tcp::endpoint>::iterator i = m_added.begin();
+				std::map<tcp::endpoint, bt_peer_connection*>::iterator p
+					= m_peers.find(*i);
+				TORRENT_ASSERT(p != m_peers.end());
+				if (send_peer(*p->second))
 				{
-					// don't write too big of a package
-					if (num_added >= max_peer_entries) break;
-
-					// only send proper bittorrent peers
-					bt_peer_connection* p = dynamic_cast<bt_peer_connection*>(peer);
-					if (!p) continue;
-
-					// no supported flags to set yet
-					// 0x01 - peer supports encryption
-					// 0x02 - peer is a seed
-					int flags = p->is_seed() ? 2 : 0;
-#ifndef TORRENT_DISABLE_ENCRYPTION
-					flags |= p->supports_encryption() ? 1 : 0;
-#endif
-					// i->first was added since the last time
-					if (remote.address().is_v4())
-					{
-						detail::write_endpoint(remote, pla_out);
-						detail::write_uint8(flags, plf_out);
-					}
-					else
-					{
-						detail::write_endpoint(remote, pla6_out);
-						detail::write_uint8(flags, plf6_out);
-					}
+					write_peer(*p->second, pla_out, plf_out, pla6_out, plf6_out);
 					++num_added;
 				}
-				else
-				{
-					// this was in the previous message
-					// so, it wasn't dropped
-					dropped.erase(di);
-				}
+				m_added.erase(i);
 			}
 
-			for (std::set<tcp::endpoint>::const_iterator i = dropped.begin()
-				, end(dropped.end()); i != end; ++i)
+			for (std::set<tcp::endpoint>::const_iterator i = m_dropped.begin()
+				, end(m_dropped.end()); i != end; ++i)
 			{	
 				if (i->address().is_v4())
 					detail::write_endpoint(*i, pld_out);
 				else
 					detail::write_endpoint(*i, pld6_out);
 			}
+			m_dropped.clear();
+
+			// the messages may still be referenced by send buffers,
+			// so new ones are allocated instead of modifying them
+			m_ut_pex_msg.reset(new std::vector<char>);
+			bencode(std::back_inserter(*m_ut_pex_msg), pex);
+
+			entry full;
+			// leave the dropped string empty
+			full["dropped"].string();
+			std::string& fla = full["added"].string();
+			std::string& flf = full["added.f"].string();
+			full["dropped6"].string();
+			std::string& fla6 = full["added6"].string();
+			std::string& flf6 = full["added6.f"].string();
+			std::back_insert_iterator<std::string> fla_out(fla);
+			std::back_insert_iterator<std::string> flf_out(flf);
+			std::back_insert_iterator<std::string> fla6_out(fla6);
+			std::back_insert_iterator<std::string> flf6_out(flf6);
+
+			num_added = 0;
+			for (std::map<tcp::endpoint, bt_peer_connection*>::iterator i = m_peers.begin()
+				, end(m_peers.end()); i != end && num_added < max_peer_entries; ++i)
+			{
+				if (!send_peer(*i->second)) continue;
+				write_peer(*i->second, fla_out, flf_out, fla6_out, flf6_out);
+				++num_added;
+			}
 
-			m_ut_pex_msg.clear();
-			bencode(std::back_inserter(m_ut_pex_msg), pex);
+			m_ut_pex_full_msg.reset(new std::vector<char>);
+			bencode(std::back_inserter(*m_ut_pex_full_msg), full);
 		}
 
 	private:
+
+		template <class OutIt>
+		void write_peer(bt_peer_connection const& p, OutIt& pla_out, OutIt& plf_out
+			, OutIt& pla6_out, OutIt& plf6_out)
+		{
+			// no supported flags to set yet
+			// 0x01 - peer supports encryption
+			// 0x02 - peer is a seed
+			int flags = p.is_seed() ? 2 : 0;
+#ifndef TORRENT_DISABLE_ENCRYPTION
+			flags |= p.supports_encryption() ? 1 : 0;
+#endif
+			tcp::endpoint const& remote = p.remote();
+			if (remote.address().is_v4())
+			{
+				detail::write_endpoint(remote, pla_out);
+				detail::write_uint8(flags, plf_out);
+			}
+			else
+			{
+				detail::write_endpoint(remote, pla6_out);
+				detail::write_uint8(flags, plf6_out);
+			}
+		}
+
 		torrent& m_torrent;
 
-		std::set<tcp::endpoint> m_old_peers;
+		// the outgoing connections that have completed the
+		// handshake, i.e. the peers we tell others about
+		std::map<tcp::endpoint, bt_peer_connection*> m_peers;
+
+		// the peers that have connected or disconnected
+		// since the last message was built
+		std::set<tcp::endpoint> m_added;
+		std::set<tcp::endpoint> m_dropped;
+
 		int m_1_minute;
-		std::vector<char> m_ut_pex_msg;
+
+		// the last diff message and the full list of peers,
+		// bencoded. They are shared by all connections
+		boost::shared_ptr<std::vector<char> > m_ut_pex_msg;
+		boost::shared_ptr<std::vector<char> > m_ut_pex_full_msg;
 	};
 
 
 	struct ut_pex_peer_plugin : peer_plugin
 	{	
-		ut_pex_peer_plugin(torrent& t, peer_connection& pc, ut_pex_plugin& tp)
+		ut_pex_peer_plugin(torrent& t, bt_peer_connection& pc, ut_pex_plugin& tp)
 			: m_torrent(t)
 			, m_pc(pc)
 			, m_tp(tp)
 			, m_1_minute(55)
 			, m_message_index(0)
 			, m_first_time(true)
+			, m_connected(false)
 		{}
 
 		virtual void add_handshake(entry& h)
@@ -196,15 +264,36 @@ namespace libtorrent { namespace
 			messages[extension_name] = extension_index;
 		}
 
+		virtual bool on_handshake(char const* reserved_bits)
+		{
+			if (send_peer(m_pc))
+			{
+				m_tp.peer_connected(m_pc);
+				m_connected = true;
+			}
+			return true;
+		}
+
+		virtual void on_disconnect()
+		{
+			if (!m_connected) return;
+			m_tp.peer_disconnected(m_pc);
+			m_connected = false;
+		}
+
+		// this plugin stays attached even if the other end doesn't
+		// support ut_pex, since it keeps track of the connection
+		// for the torrent plugin. Without a message index, nothing
+		// is sent to the peer
 		virtual bool on_extension_handshake(lazy_entry const& h)
 		{
 			m_message_index = 0;
-			if (h.type() != lazy_entry::dict_t) return false;
+			if (h.type() != lazy_entry::dict_t) return true;
 			lazy_entry const* messages = h.dict_find("m");
-			if (!messages || messages->type() != lazy_entry::dict_t) return false;
+			if (!messages || messages->type() != lazy_entry::dict_t) return true;
 
 			int index = messages->dict_find_int_value(extension_name, -1);
-			if (index == -1) return false;
+			if (index == -1) return true;
 			m_message_index = index;
 			return true;
 		}
@@ -284,9 +373,12 @@ namespace libtorrent { namespace
 			if (!m_message_index) return;	// no handshake yet
 			if (++m_1_minute <= 60) return;
 
+			// the diffs are relative to the full list, so try
+			// again every second until the torrent plugin has
+			// built one
 			if (m_first_time)
 			{
-				send_ut_peer_list();
+				if (!send_ut_peer_list()) return;
 				m_first_time = false;
 			}
 			else
@@ -298,89 +390,49 @@ namespace libtorrent { namespace
 
 	private:
 
-		void send_ut_peer_diff()
+		bool send_ut_peer_diff()
 		{
-			std::vector<char> const& pex_msg = m_tp.get_ut_pex_msg();
-
-			buffer::interval i = m_pc.allocate_send_buffer(6 + pex_msg.size());
-
-			detail::write_uint32(1 + 1 + pex_msg.size(), i.begin);
-			detail::write_uint8(bt_peer_connection::msg_extended, i.begin);
-			detail::write_uint8(m_message_index, i.begin);
-			std::copy(pex_msg.begin(), pex_msg.end(), i.begin);
-			i.begin += pex_msg.size();
-
-			TORRENT_ASSERT(i.begin == i.end);
-			m_pc.setup_send();
+			return send_pex_msg(m_tp.get_ut_pex_msg());
 		}
 
-		void send_ut_peer_list()
+		bool send_ut_peer_list()
 		{
-			entry pex;
-			// leave the dropped string empty
-			pex["dropped"].string();
-			std::string& pla = pex["added"].string();
-			std::string& plf = pex["added.f"].string();
-			pex["dropped6"].string();
-			std::string& pla6 = pex["added6"].string();
-			std::string& plf6 = pex["added6.f"].string();
-			std::back_insert_iterator<std::string> pla_out(pla);
-			std::back_insert_iterator<std::string> plf_out(plf);
-			std::back_insert_iterator<std::string> pla6_out(pla6);
-			std::back_insert_iterator<std::string> plf6_out(plf6);
-
-			int num_added = 0;
-			for (torrent::peer_iterator i = m_torrent.begin()
-				, end(m_torrent.end()); i != end; ++i)
-			{
-				peer_connection* peer = *i;
-				if (!send_peer(*peer)) continue;
+			return send_pex_msg(m_tp.get_ut_pex_full_msg());
+		}
 
-				// don't write too big of a package
-				if (num_added >= max_peer_entries) break;
+		// returns false if there was no message to send
+		bool send_pex_msg(boost::shared_ptr<std::vector<char> > const& pex_msg)
+		{
+			// the torrent plugin hasn't built any message yet
+			if (!pex_msg) return false;
 
-				// only send proper bittorrent peers
-				bt_peer_connection* p = dynamic_cast<bt_peer_connection*>(peer);
-				if (!p) continue;
+			char msg[6];
+			char* ptr = msg;
+			detail::write_uint32(1 + 1 + pex_msg->size(), ptr);
+			detail::write_uint8(bt_peer_connection::msg_extended, ptr);
+			detail::write_uint8(m_message_index, ptr);
+			m_pc.send_buffer(msg, sizeof(msg));
+			m_pc.sent_message();
 
-				// no supported flags to set yet
-				// 0x01 - peer supports encryption
-				// 0x02 - peer is a seed
-				int flags = p->is_seed() ? 2 : 0;
 #ifndef TORRENT_DISABLE_ENCRYPTION
-				flags |= p->supports_encryption() ? 1 : 0;
-#endif
-				tcp::endpoint const& remote = peer->remote();
-				// i->first was added since the last time
-				if (remote.address().is_v4())
-				{
-					detail::write_endpoint(remote, pla_out);
-					detail::write_uint8(flags, plf_out);
-				}
-				else
-				{
-					detail::write_endpoint(remote, pla6_out);
-					detail::write_uint8(flags, plf6_out);
-				}
-				++num_added;
+			if (m_pc.rc4_encrypted())
+			{
+				// the buffer is encrypted in place, so this
+				// connection needs its own copy of the message
+				std::vector<char> copy(*pex_msg);
+				m_pc.send_buffer(&copy[0], copy.size());
+				m_pc.setup_send();
+				return true;
 			}
-			std::vector<char> pex_msg;
-			bencode(std::back_inserter(pex_msg), pex);
-
-			buffer::interval i = m_pc.allocate_send_buffer(6 + pex_msg.size());
-
-			detail::write_uint32(1 + 1 + pex_msg.size(), i.begin);
-			detail::write_uint8(bt_peer_connection::msg_extended, i.begin);
-			detail::write_uint8(m_message_index, i.begin);
-			std::copy(pex_msg.begin(), pex_msg.end(), i.begin);
-			i.begin += pex_msg.size();
-
-			TORRENT_ASSERT(i.begin == i.end);
+#endif
+			m_pc.append_send_buffer(&(*pex_msg)[0], pex_msg->size()
+				, boost::bind(&release_pex_msg, pex_msg, _1));
 			m_pc.setup_send();
+			return true;
 		}
 
 		torrent& m_torrent;
-		peer_connection& m_pc;
+		bt_peer_connection& m_pc;
 		ut_pex_plugin& m_tp;
 		int m_1_minute;
 		int m_message_index;
@@ -390,6 +442,10 @@ namespace libtorrent { namespace
 		// it is used to know if a diff message or a full
 		// message should be sent.
 		bool m_first_time;
+
+		// true if this connection has been reported to
+		// the torrent plugin with peer_connected()
+		bool m_connected;
 	};
 
 	boost::shared_ptr<peer_plugin> ut_pex_plugin::new_connection(peer_connection* pc)
@@ -397,7 +453,7 @@ namespace libtorrent { namespace
 		bt_peer_connection* c = dynamic_cast<bt_peer_connection*>(pc);
 		if (!c) return boost::shared_ptr<peer_plugin>();
 		return boost::shared_ptr<peer_plugin>(new ut_pex_peer_plugin(m_torrent
-			, *pc, *this));
+			, *c, *this));
 	}
 }}
 
@@ -67,6 +67,8 @@ namespace libtorrent
 		: peer_connection(ses, t, s, remote, peerinfo)
 		, m_url(url)
 		, m_first_request(true)
+		, m_piece(ses, 0)
+		, m_piece_size(0)
 		, m_range_pos(0)
 	{
 		INVARIANT_CHECK;
@@ -82,14 +84,16 @@ namespace libtorrent
 		TORRENT_ASSERT(tor);
 		int blocks_per_piece = tor->torrent_file().piece_length() / tor->block_size();
 
-		// we always prefer downloading 1 MB chunks
-		// from web seeds
-		prefer_whole_pieces((1024 * 1024) / tor->torrent_file().piece_length());
+		// we always prefer downloading at least 1 MB
+		// chunks from web seeds. on_tick() grows this
+		// as the download rate picks up
+		prefer_whole_pieces((std::max)((1024 * 1024)
+			/ tor->torrent_file().piece_length(), 1));
 		
-		// multiply with the blocks per piece since that many requests are
+		// multiply with the blocks per request since that many requests are
 		// merged into one http request
 		m_max_out_request_queue = ses.settings().urlseed_pipeline_size
-			* blocks_per_piece;
+			* blocks_per_piece * prefer_whole_pieces();
 
 		// since this is a web seed, change the timeout
 		// according to the settings.
@@ -126,9 +130,9 @@ namespace libtorrent
 		piece_block_progress ret;
 
 		ret.piece_index = m_requests.front().piece;
-		if (!m_piece.empty())
+		if (m_piece_size > 0)
 		{
-			ret.bytes_downloaded = int(m_piece.size());
+			ret.bytes_downloaded = m_piece_size;
 		}
 		else
 		{
@@ -151,6 +155,48 @@ namespace libtorrent
 		return ret;
 	}
 
+	void web_peer_connection::on_tick()
+	{
+		boost::shared_ptr<torrent> t = associated_torrent().lock();
+		TORRENT_ASSERT(t);
+		if (!t->valid_metadata()) return;
+
+		// request as many whole pieces at a time as we can
+		// download in about one second, but at least 1 MB.
+		// This keeps the number of HTTP requests (and responses
+		// spanning several files) down on fast servers
+		const int piece_length = t->torrent_file().piece_length();
+		int request_size = (std::max)(int(statistics().download_payload_rate())
+			, 1024 * 1024);
+		int num_pieces = (std::max)(request_size / piece_length, 1);
+		// m_prefer_whole_pieces is 8 bits
+		if (num_pieces > 255) num_pieces = 255;
+		prefer_whole_pieces(num_pieces);
+
+		// allow urlseed_pipeline_size requests of this size
+		// to be outstanding
+		m_max_out_request_queue = m_ses.settings().urlseed_pipeline_size
+			* (piece_length / t->block_size()) * num_pieces;
+	}
+
+	bool web_peer_connection::append_to_piece(char const* buf, int size)
+	{
+		if (!m_piece)
+		{
+			TORRENT_ASSERT(m_piece_size == 0);
+			char* buffer = m_ses.allocate_disk_buffer();
+			if (buffer == 0)
+			{
+				disconnect("out of memory");
+				return false;
+			}
+			m_piece.reset(buffer);
+		}
+		std::memcpy(m_piece.get() + m_piece_size, buf, size);
+		m_piece_size += size;
+		return true;
+	}
+
 	void web_peer_connection::on_connected()
 	{
 		boost::shared_ptr<torrent> t = associated_torrent().lock();
@@ -255,13 +301,13 @@ namespace libtorrent
 				if (using_proxy)
 				{
 					request += m_url;
-					std::string path = info.files().at(f.file_index).path.string();
+					std::string path = info.files().file_path(f.file_index).string();
 					request += escape_path(path.c_str(), path.length());
 				}
 				else
 				{
 					std::string path = m_path;
-					path += info.files().at(f.file_index).path.string();
+					path += info.files().file_path(f.file_index).string();
 					request += escape_path(path.c_str(), path.length());
 				}
 				request += " HTTP/1.1\r\n";
@@ -389,7 +435,7 @@ namespace libtorrent
 					if (m_ses.m_alerts.should_post<url_seed_alert>())
 					{
 						session_impl::mutex_t::scoped_lock l(m_ses.m_mutex);
-						m_ses.m_alerts.post_alert(url_seed_alert(t->get_handle(), url()
+						m_ses.m_alerts.post_alert_ptr(new url_seed_alert(t->get_handle(), url()
 							, error_msg));
 					}
 					disconnect(error_msg.c_str(), 1);
@@ -434,7 +480,7 @@ namespace libtorrent
 						int file_index = m_file_requests.front();
 
 						torrent_info const& info = t->torrent_file();
-						std::string path = info.files().at(file_index).path.string();
+						std::string path = info.files().file_path(file_index).string();
 						path = escape_path(path.c_str(), path.length());
 						size_t i = location.rfind(path);
 						if (i == std::string::npos)
@@ -550,12 +596,12 @@ namespace libtorrent
 			// 3. the start of a block
 			// in that order, these parts are parsed.
 
-			bool range_overlaps_request = re > fs + int(m_piece.size());
+			bool range_overlaps_request = re > fs + m_piece_size;
 
 			if (!range_overlaps_request)
 			{
 				// this means the end of the incoming request ends _before_ the
-				// first expected byte (fs + m_piece.size())
+				// first expected byte (fs + m_piece_size)
 				disconnect("invalid range in HTTP response", 2);
 				return;
 			}
@@ -572,19 +618,17 @@ namespace libtorrent
 				// (if it completed) call incoming_piece() with
 				// m_piece as buffer.
 				
-				int piece_size = int(m_piece.size());
-				int copy_size = (std::min)((std::min)(front_request.length - piece_size
+				int copy_size = (std::min)((std::min)(front_request.length - m_piece_size
 					, recv_buffer.left()), int(range_end - range_start - m_received_body));
-				m_piece.resize(piece_size + copy_size);
 				TORRENT_ASSERT(copy_size > 0);
-				std::memcpy(&m_piece[0] + piece_size, recv_buffer.begin, copy_size);
-				TORRENT_ASSERT(int(m_piece.size()) <= front_request.length);
+				if (!append_to_piece(recv_buffer.begin, copy_size)) return;
+				TORRENT_ASSERT(m_piece_size <= front_request.length);
 				recv_buffer.begin += copy_size;
 				m_received_body += copy_size;
 				m_body_start += copy_size;
 				TORRENT_ASSERT(m_received_body <= range_end - range_start);
-				TORRENT_ASSERT(int(m_piece.size()) <= front_request.length);
-				if (int(m_piece.size()) == front_request.length)
+				TORRENT_ASSERT(m_piece_size <= front_request.length);
+				if (m_piece_size == front_request.length)
 				{
 					// each call to incoming_piece() may result in us becoming
 					// a seed. If we become a seed, all seeds we're connected to
@@ -592,14 +636,17 @@ namespace libtorrent
 					// check for the disconnect condition after the call.
 
 					m_requests.pop_front();
-					incoming_piece(front_request, &m_piece[0]);
+					// the disk buffer is passed on as is, incoming_piece()
+					// takes ownership of it
+					m_piece_size = 0;
+					incoming_piece(front_request, m_piece);
+					m_piece.reset();
 					if (associated_torrent().expired()) return;
 					cut_receive_buffer(m_body_start, t->block_size() + 1024);
 					m_body_start = 0;
 					recv_buffer = receive_buffer();
 					TORRENT_ASSERT(m_received_body <= range_end - range_start);
-					m_piece.clear();
-					TORRENT_ASSERT(m_piece.empty());
+					TORRENT_ASSERT(!m_piece);
 				}
 			}
 
@@ -625,19 +672,17 @@ namespace libtorrent
 			if (!m_requests.empty())
 			{
 				range_overlaps_request = in_range.start + in_range.length
-					> m_requests.front().start + int(m_piece.size());
+					> m_requests.front().start + m_piece_size;
 
 				if (in_range.start + in_range.length < m_requests.front().start + m_requests.front().length
 					&& (m_received_body + recv_buffer.left() >= range_end - range_start))
 				{
-					int piece_size = int(m_piece.size());
-					int copy_size = (std::min)((std::min)(m_requests.front().length - piece_size
+					int copy_size = (std::min)((std::min)(m_requests.front().length - m_piece_size
 						, recv_buffer.left()), int(range_end - range_start - m_received_body));
 					TORRENT_ASSERT(copy_size >= 0);
 					if (copy_size > 0)
 					{
-						m_piece.resize(piece_size + copy_size);
-						std::memcpy(&m_piece[0] + piece_size, recv_buffer.begin, copy_size);
+						if (!append_to_piece(recv_buffer.begin, copy_size)) return;
 						recv_buffer.begin += copy_size;
 						m_received_body += copy_size;
 						m_body_start += copy_size;
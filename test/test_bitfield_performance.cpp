@@ -0,0 +1,88 @@
+#include "libtorrent/bitfield.hpp"
+#include <cstdlib>
+#include <iostream>
+
+#include "test.hpp"
+#include "libtorrent/time.hpp"
+
+using namespace libtorrent;
+
+int test_main()
+{
+	using namespace libtorrent;
+
+	const int num_bits = 1000000 + 7;
+	const int iterations = 100;
+
+	std::srand(10);
+	bitfield a(num_bits, false);
+	bitfield b(num_bits, false);
+	// a is dense, b is sparse
+	for (int i = 0; i < num_bits; ++i)
+	{
+		if (std::rand() & 1) a.set_bit(i);
+		if ((std::rand() % 1000) == 0) b.set_bit(i);
+	}
+
+	// the reference results, one bit at a time
+	int ref_count = 0;
+	int ref_common = 0;
+	int ref_sparse = 0;
+	ptime start(time_now());
+	for (int k = 0; k < iterations; ++k)
+	{
+		ref_count = 0;
+		ref_common = 0;
+		ref_sparse = 0;
+		for (int i = 0; i < num_bits; ++i)
+		{
+			if (a[i]) ++ref_count;
+			if (a[i] && b[i]) ++ref_common;
+			if (b[i]) ++ref_sparse;
+		}
+	}
+	ptime stop(time_now());
+	std::cout << "bit by bit: " << total_microseconds(stop - start) / iterations
+		<< " us per iteration" << std::endl;
+
+	int count = 0;
+	start = time_now();
+	for (int k = 0; k < iterations; ++k) count = a.count();
+	stop = time_now();
+	std::cout << "count: " << total_microseconds(stop - start) / iterations
+		<< " us per iteration" << std::endl;
+	TEST_CHECK(count == ref_count);
+
+	int common = 0;
+	start = time_now();
+	for (int k = 0; k < iterations; ++k) common = a.count_common(b);
+	stop = time_now();
+	std::cout << "count_common: " << total_microseconds(stop - start) / iterations
+		<< " us per iteration" << std::endl;
+	TEST_CHECK(common == ref_common);
+
+	int sparse = 0;
+	start = time_now();
+	for (int k = 0; k < iterations; ++k)
+	{
+		sparse = 0;
+		for (int i = b.find_next_set(0); i != -1; i = b.find_next_set(i + 1))
+			++sparse;
+	}
+	stop = time_now();
+	std::cout << "find_next_set: " << total_microseconds(stop - start) / iterations
+		<< " us per iteration" << std::endl;
+	TEST_CHECK(sparse == ref_sparse);
+
+	bitfield c(a);
+	start = time_now();
+	for (int k = 0; k < iterations; ++k) c.clear_bits(b);
+	stop = time_now();
+	std::cout << "clear_bits: " << total_microseconds(stop - start) / iterations
+		<< " us per iteration" << std::endl;
+	TEST_CHECK(c.count() == ref_count - ref_common);
+	TEST_CHECK(c.count_common(b) == 0);
+
+	return 0;
+}
+
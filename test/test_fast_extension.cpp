@@ -34,8 +34,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "setup_transfer.hpp"
 #include "libtorrent/socket.hpp"
 #include "libtorrent/io.hpp"
+#include "libtorrent/session.hpp"
 #include <cstring>
 #include <boost/bind.hpp>
+#include <boost/filesystem/operations.hpp>
 
 using namespace libtorrent;
 
@@ -110,7 +112,8 @@ void send_unchoke(stream_socket& s)
 	}
 }
 
-void do_handshake(stream_socket& s, sha1_hash const& ih, char* buffer)
+void do_handshake(stream_socket& s, sha1_hash const& ih, char* buffer
+	, bool have_all = true)
 {
 	char handshake[] = "\x13" "BitTorrent protocol\0\0\0\0\0\0\0\x04"
 		"                    " // space for info-hash
@@ -119,7 +122,10 @@ void do_handshake(stream_socket& s, sha1_hash const& ih, char* buffer)
 	std::cout << "send handshake" << std::endl;
 	error_code ec;
 	std::memcpy(handshake + 28, ih.begin(), 20);
-	libtorrent::asio::write(s, libtorrent::asio::buffer(handshake, sizeof(handshake) - 1), libtorrent::asio::transfer_all(), ec);
+	// leave out the have_all message if the peer should
+	// announce its pieces some other way
+	int size = sizeof(handshake) - 1 - (have_all ? 0 : 5);
+	libtorrent::asio::write(s, libtorrent::asio::buffer(handshake, size), libtorrent::asio::transfer_all(), ec);
 	if (ec)
 	{
 		std::cout << ec.message() << std::endl;
@@ -288,10 +294,241 @@ void test_respect_suggest()
 	TEST_CHECK(fail_counter > 0);
 }
 
+void write_buffer(stream_socket& s, std::vector<char> const& buf)
+{
+	error_code ec;
+	libtorrent::asio::write(s, libtorrent::asio::buffer(&buf[0], buf.size())
+		, libtorrent::asio::transfer_all(), ec);
+	if (ec)
+	{
+		std::cout << ec.message() << std::endl;
+		exit(1);
+	}
+}
+
+// sends several messages, and the first part of a piece message,
+// in a single write. This makes sure the receive path handles
+// all the messages it reads at once, including copying the part
+// of the piece payload that was read ahead into the disk buffer
+void test_read_ahead()
+{
+	using namespace libtorrent::detail;
+
+	boost::filesystem::remove_all("./tmp1_read_ahead");
+	boost::intrusive_ptr<torrent_info> t = ::create_torrent();
+	sha1_hash ih = t->info_hash();
+	session ses1(fingerprint("LT", 0, 1, 0, 0), std::make_pair(48900, 49000));
+	torrent_handle h = ses1.add_torrent(t, "./tmp1_read_ahead");
+
+	test_sleep(2000);
+
+	io_service ios;
+	stream_socket s(ios);
+	s.connect(tcp::endpoint(address::from_string("127.0.0.1"), ses1.listen_port()));
+
+	char recv_buffer[1000];
+	do_handshake(s, ih, recv_buffer);
+
+	// suggest_piece 0, 1, 2 and unchoke, back to back
+	std::vector<char> msgs;
+	for (int i = 0; i < 3; ++i)
+	{
+		char msg[] = "\0\0\0\x05\x0d\0\0\0\0";
+		char* ptr = msg + 5;
+		write_int32(i, ptr);
+		msgs.insert(msgs.end(), msg, msg + 9);
+	}
+	char unchoke[] = "\0\0\0\x01\x01";
+	msgs.insert(msgs.end(), unchoke, unchoke + 5);
+	write_buffer(s, msgs);
+
+	int piece = -1;
+	int start = 0;
+	int length = 0;
+	for (int fail_counter = 100; fail_counter > 0; --fail_counter)
+	{
+		read_message(s, recv_buffer);
+		if (recv_buffer[0] != 0x6) continue;
+		char* ptr = recv_buffer + 1;
+		piece = read_int32(ptr);
+		start = read_int32(ptr);
+		length = read_int32(ptr);
+		break;
+	}
+	TEST_CHECK(piece >= 0);
+	TEST_CHECK(start == 0);
+	TEST_CHECK(length == t->piece_length());
+	if (piece < 0 || start != 0 || length != t->piece_length()) return;
+
+	// the same data create_torrent() hashed
+	std::vector<char> payload(length);
+	for (int i = 0; i < length; ++i)
+		payload[i] = (i % 26) + 'A';
+
+	// a have message, followed by the piece header and the
+	// first 1000 bytes of the payload
+	msgs.clear();
+	char have[] = "\0\0\0\x05\x04\0\0\0\0";
+	char* ptr = have + 5;
+	write_int32(piece, ptr);
+	msgs.insert(msgs.end(), have, have + 9);
+	char header[13];
+	ptr = header;
+	write_int32(9 + length, ptr);
+	write_uint8(7, ptr);
+	write_int32(piece, ptr);
+	write_int32(start, ptr);
+	msgs.insert(msgs.end(), header, header + 13);
+	msgs.insert(msgs.end(), payload.begin(), payload.begin() + 1000);
+	write_buffer(s, msgs);
+
+	test_sleep(500);
+
+	// and the rest of the payload
+	msgs.assign(payload.begin() + 1000, payload.end());
+	write_buffer(s, msgs);
+
+	for (int i = 0; i < 50; ++i)
+	{
+		if (h.status().num_pieces > 0) break;
+		test_sleep(100);
+	}
+	// the piece passes the hash check only if the payload
+	// made it into the disk buffer intact
+	TEST_CHECK(h.status().num_pieces == 1);
+}
+
+// waits for the torrent to become interested, or not
+// interested, in the single peer it's connected to
+bool wait_for_interest(torrent_handle const& h, bool interesting)
+{
+	for (int i = 0; i < 50; ++i)
+	{
+		std::vector<peer_info> peers;
+		h.get_peer_info(peers);
+		if (peers.size() == 1
+			&& bool(peers[0].flags & peer_info::interesting) == interesting)
+			return true;
+		test_sleep(100);
+	}
+	return false;
+}
+
+// makes sure the count of wanted pieces each peer has is kept
+// up to date by bitfield and have messages and priority changes
+void test_interest()
+{
+	using namespace libtorrent::detail;
+
+	boost::filesystem::remove_all("./tmp1_interest");
+	boost::intrusive_ptr<torrent_info> t = ::create_torrent();
+	sha1_hash ih = t->info_hash();
+	session ses1(fingerprint("LT", 0, 1, 0, 0), std::make_pair(48900, 49000));
+	torrent_handle h = ses1.add_torrent(t, "./tmp1_interest");
+	const int num_pieces = t->num_pieces();
+
+	test_sleep(2000);
+
+	io_service ios;
+	stream_socket s(ios);
+	s.connect(tcp::endpoint(address::from_string("127.0.0.1"), ses1.listen_port()));
+
+	char recv_buffer[1000];
+	do_handshake(s, ih, recv_buffer, false);
+
+	// a bitfield with only piece 5
+	std::vector<char> msg(5 + (num_pieces + 7) / 8, 0);
+	char* ptr = &msg[0];
+	write_int32(msg.size() - 4, ptr);
+	write_uint8(5, ptr);
+	msg[5 + 5 / 8] |= 0x80 >> (5 & 7);
+	write_buffer(s, msg);
+	TEST_CHECK(wait_for_interest(h, true));
+
+	// the torrent still wants other pieces, but not
+	// the one this peer has
+	h.piece_priority(5, 0);
+	TEST_CHECK(wait_for_interest(h, false));
+
+	msg.resize(9);
+	ptr = &msg[0];
+	write_int32(5, ptr);
+	write_uint8(4, ptr);
+	write_int32(7, ptr);
+	write_buffer(s, msg);
+	TEST_CHECK(wait_for_interest(h, true));
+
+	// the peer has 5 and 7, one of them is enough
+	h.piece_priority(5, 1);
+	h.piece_priority(7, 0);
+	TEST_CHECK(wait_for_interest(h, true));
+	h.piece_priority(5, 0);
+	TEST_CHECK(wait_for_interest(h, false));
+
+	std::vector<int> prio(num_pieces, 1);
+	prio[5] = 0;
+	prio[7] = 0;
+	h.prioritize_pieces(prio);
+	TEST_CHECK(wait_for_interest(h, false));
+
+	prio[7] = 1;
+	h.prioritize_pieces(prio);
+	TEST_CHECK(wait_for_interest(h, true));
+}
+
+// the messages a connection queues while handling one event are
+// sent with a single write, and each of them is still counted
+void test_coalesce_sends()
+{
+	boost::filesystem::remove_all("./tmp1_coalesce");
+	boost::intrusive_ptr<torrent_info> t = ::create_torrent();
+	sha1_hash ih = t->info_hash();
+	session ses1(fingerprint("LT", 0, 1, 0, 0), std::make_pair(48900, 49000));
+	ses1.add_torrent(t, "./tmp1_coalesce");
+
+	test_sleep(2000);
+
+	io_service ios;
+	stream_socket s(ios);
+	s.connect(tcp::endpoint(address::from_string("127.0.0.1"), ses1.listen_port()));
+
+	// the handshake ends with have_all. In response the torrent,
+	// which doesn't have any pieces, sends have_none and
+	// interested, and the extension handshake
+	char recv_buffer[1000];
+	do_handshake(s, ih, recv_buffer);
+
+	bool have_none = false;
+	bool interested = false;
+	for (int i = 0; i < 10 && !(have_none && interested); ++i)
+	{
+		int len = read_message(s, recv_buffer);
+		if (len == 0) continue;
+		if (recv_buffer[0] == 0x0f) have_none = true;
+		if (recv_buffer[0] == 0x02) interested = true;
+	}
+	TEST_CHECK(have_none);
+	TEST_CHECK(interested);
+
+	// let the session update its rates
+	test_sleep(1500);
+
+	session_status st = ses1.status();
+	std::cerr << "sent messages: " << st.sent_message_rate
+		<< " send calls: " << st.send_call_rate
+		<< " received messages: " << st.received_message_rate << std::endl;
+	TEST_CHECK(st.received_message_rate > 0.f);
+	TEST_CHECK(st.send_call_rate > 0.f);
+	TEST_CHECK(st.sent_message_rate > st.send_call_rate);
+}
+
 int test_main()
 {
 	test_reject_fast();
 	test_respect_suggest();
+	test_read_ahead();
+	test_interest();
+	test_coalesce_sends();
 	return 0;
 }
 
@@ -124,6 +124,69 @@ void run_test(std::string const& url, int size, int status, int connected
 	TEST_CHECK(http_status == status || status == -1);
 }
 
+void run_pool_test(std::string const& url)
+{
+	std::cerr << " ===== TESTING CONNECTION POOL: " << url << " =====" << std::endl;
+
+	http_connection_pool pool;
+	for (int i = 0; i < 2; ++i)
+	{
+		reset_globals();
+		boost::shared_ptr<http_connection> h(new http_connection(ios, cq
+			, &::http_handler, true, &::http_connect_handler, &pool));
+		h->get(url, seconds(5), 0);
+		ios.reset();
+		ios.run();
+
+		TEST_CHECK(handler_called == 1);
+		TEST_CHECK(data_size == 3216);
+		TEST_CHECK(http_status == 200);
+		// the second request is sent over the connection
+		// the first one left in the pool
+		TEST_CHECK(connect_handler_called == (i == 0 ? 1 : 0));
+		TEST_CHECK(pool.num_idle() == 1);
+	}
+}
+
+int resolver_handler_called = 0;
+void resolver_handler(error_code const& ec, std::vector<address> const& addresses)
+{
+	++resolver_handler_called;
+	TEST_CHECK(!ec);
+	TEST_CHECK(!addresses.empty());
+}
+
+void run_resolver_test(std::string const& url)
+{
+	std::cerr << " ===== TESTING RESOLVER CACHE: " << url << " =====" << std::endl;
+
+	resolver r(ios);
+
+	// these three lookups are all served by a single query
+	for (int i = 0; i < 3; ++i)
+		r.async_resolve("localhost", &resolver_handler);
+	TEST_CHECK(resolver_handler_called == 0);
+	ios.reset();
+	ios.run();
+	TEST_CHECK(resolver_handler_called == 3);
+	TEST_CHECK(r.num_lookups() == 3);
+	TEST_CHECK(r.num_cache_hits() == 2);
+
+	reset_globals();
+	boost::shared_ptr<http_connection> h(new http_connection(ios, cq
+		, &::http_handler, true, &::http_connect_handler, 0, &r));
+	h->get(url, seconds(5), 0);
+	ios.reset();
+	ios.run();
+
+	TEST_CHECK(handler_called == 1);
+	TEST_CHECK(data_size == 3216);
+	TEST_CHECK(http_status == 200);
+	// the host name was still in the cache
+	TEST_CHECK(r.num_lookups() == 4);
+	TEST_CHECK(r.num_cache_hits() == 3);
+}
+
 void run_suite(std::string const& protocol, proxy_settings const& ps)
 {
 	if (ps.type != proxy_settings::none)
@@ -175,6 +238,8 @@ int test_main()
 		ps.type = (proxy_settings::proxy_type)i;
 		run_suite("http", ps);
 	}
+	run_pool_test("http://127.0.0.1:8001/test_file");
+	run_resolver_test("http://localhost:8001/test_file");
 	stop_web_server(8001);
 
 #ifdef TORRENT_USE_OPENSSL
@@ -0,0 +1,107 @@
+#include "libtorrent/piece_picker.hpp"
+#include "libtorrent/bitfield.hpp"
+#include "libtorrent/time.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "test.hpp"
+
+using namespace libtorrent;
+
+// the old way of determining interest in a peer, scanning
+// all pieces until we find one we want that the peer has
+bool scan_interest(piece_picker const& p, bitfield const& have)
+{
+	for (int j = 0; j < p.num_pieces(); ++j)
+	{
+		if (!p.have_piece(j) && p.piece_priority(j) > 0 && have[j])
+			return true;
+	}
+	return false;
+}
+
+struct interest_peer
+{
+	bitfield have;
+	int num_wanted;
+};
+
+// simulates what happens to every peer when we complete a piece.
+// The pieces we still want are at the end of the torrent, which
+// is the worst case for the scan
+int test_main()
+{
+	// close to the maximum number of pieces the picker supports
+	const int num_pieces = 250000;
+	const int num_peers = 20;
+	const int remaining = 20;
+
+	piece_picker p;
+	p.init(1, num_pieces);
+	for (int i = 0; i < num_pieces - remaining; ++i)
+		p.we_have(i);
+	// filter one of the remaining pieces, it should not
+	// make anyone interesting
+	p.set_piece_priority(num_pieces - 1, 0);
+
+	bitfield wanted;
+	p.wanted_pieces(wanted);
+	TEST_CHECK(wanted.count() == remaining - 1);
+
+	std::srand(10);
+	std::vector<interest_peer> peers(num_peers);
+	for (int i = 0; i < num_peers; ++i)
+	{
+		interest_peer& pe = peers[i];
+		pe.have.resize(num_pieces, false);
+		for (int j = 0; j < num_pieces; ++j)
+			if (std::rand() & 1) pe.have.set_bit(j);
+		pe.num_wanted = pe.have.count_common(wanted);
+
+		int count = 0;
+		for (int j = 0; j < num_pieces; ++j)
+			if (pe.have[j] && wanted[j]) ++count;
+		TEST_CHECK(pe.num_wanted == count);
+		TEST_CHECK((pe.num_wanted > 0) == scan_interest(p, pe.have));
+	}
+
+	time_duration scan_time = seconds(0);
+	time_duration count_time = seconds(0);
+	for (int i = num_pieces - remaining; i < num_pieces - 1; ++i)
+	{
+		p.we_have(i);
+
+		std::vector<bool> interested(num_peers);
+		ptime start(time_now());
+		for (int k = 0; k < num_peers; ++k)
+		{
+			if (!peers[k].have[i]) continue;
+			interested[k] = scan_interest(p, peers[k].have);
+		}
+		ptime mid(time_now());
+		for (int k = 0; k < num_peers; ++k)
+		{
+			if (!peers[k].have[i]) continue;
+			--peers[k].num_wanted;
+		}
+		ptime stop(time_now());
+		scan_time += mid - start;
+		count_time += stop - mid;
+
+		for (int k = 0; k < num_peers; ++k)
+		{
+			if (!peers[k].have[i]) continue;
+			TEST_CHECK(interested[k] == (peers[k].num_wanted > 0));
+		}
+	}
+
+	for (int k = 0; k < num_peers; ++k)
+		TEST_CHECK(peers[k].num_wanted == 0);
+
+	std::cout << "interest scan: " << total_microseconds(scan_time)
+		<< " us, interest counters: " << total_microseconds(count_time)
+		<< " us (" << num_pieces << " pieces, " << num_peers << " peers)" << std::endl;
+
+	return 0;
+}
@@ -31,7 +31,10 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "libtorrent/ip_filter.hpp"
+#include "libtorrent/time.hpp"
 #include <boost/utility.hpp>
+#include <cstdlib>
+#include <iostream>
 
 #include "test.hpp"
 
@@ -76,6 +79,115 @@ void test_rules_invariant(std::vector<ip_range<address_v4> > const& r, ip_filter
 	}
 }
 
+address_v4 rand_v4()
+{
+	return address_v4((unsigned long)(std::rand() & 0xffff) << 16 | (std::rand() & 0xffff));
+}
+
+address_v6 rand_v6()
+{
+	address_v6::bytes_type b;
+	for (int i = 0; i < 16; ++i) b[i] = std::rand() & 0xff;
+	return address_v6(b);
+}
+
+template <class Addr>
+void add_random_rule(ip_filter& f, Addr (*gen)())
+{
+	Addr a = gen();
+	Addr b = gen();
+	if (b < a) std::swap(a, b);
+	f.add_rule(a, b, std::rand() & 1 ? ip_filter::blocked : 0);
+}
+
+// makes sure the compiled filter gives the same answers
+// as the set it was built from
+void test_compiled_filter()
+{
+	ip_filter f;
+	for (int i = 0; i < 1000; ++i)
+	{
+		add_random_rule(f, &rand_v4);
+		add_random_rule(f, &rand_v6);
+	}
+
+	ip_filter compiled(f);
+	compiled.compile();
+
+	ip_filter::filter_tuple_t ranges = f.export_filter();
+	ip_filter::filter_tuple_t compiled_ranges = compiled.export_filter();
+	TEST_CHECK(boost::get<0>(ranges).size() == boost::get<0>(compiled_ranges).size());
+	TEST_CHECK(std::equal(boost::get<0>(ranges).begin(), boost::get<0>(ranges).end()
+		, boost::get<0>(compiled_ranges).begin(), &compare<address_v4>));
+	TEST_CHECK(boost::get<1>(ranges).size() == boost::get<1>(compiled_ranges).size());
+	TEST_CHECK(std::equal(boost::get<1>(ranges).begin(), boost::get<1>(ranges).end()
+		, boost::get<1>(compiled_ranges).begin(), &compare<address_v6>));
+	test_rules_invariant(boost::get<0>(compiled_ranges), compiled);
+
+	for (int i = 0; i < 10000; ++i)
+	{
+		address a = rand_v4();
+		TEST_CHECK(f.access(a) == compiled.access(a));
+		a = rand_v6();
+		TEST_CHECK(f.access(a) == compiled.access(a));
+	}
+	TEST_CHECK(compiled.access(address::from_string("0.0.0.0"))
+		== f.access(address::from_string("0.0.0.0")));
+	TEST_CHECK(compiled.access(address::from_string("255.255.255.255"))
+		== f.access(address::from_string("255.255.255.255")));
+
+	// adding a rule to a compiled filter
+	f.add_rule(address::from_string("10.0.0.0"), address::from_string("10.255.255.255"), ip_filter::blocked);
+	compiled.add_rule(address::from_string("10.0.0.0"), address::from_string("10.255.255.255"), ip_filter::blocked);
+	TEST_CHECK(compiled.access(address::from_string("10.1.2.3")) == ip_filter::blocked);
+	for (int i = 0; i < 10000; ++i)
+	{
+		address a = rand_v4();
+		TEST_CHECK(f.access(a) == compiled.access(a));
+	}
+}
+
+// prints the number of lookups per second with a large
+// block list, before and after compiling the filter
+void test_lookup_performance()
+{
+	const int num_rules = 200000;
+	const int num_lookups = 2000000;
+
+	ip_filter f;
+	for (int i = 0; i < num_rules; ++i)
+	{
+		address_v4 a = rand_v4();
+		unsigned long len = std::rand() & 0xfff;
+		if (a.to_ulong() > 0xffffffff - len) continue;
+		f.add_rule(a, address_v4(a.to_ulong() + len), ip_filter::blocked);
+	}
+
+	std::vector<address> addrs;
+	addrs.reserve(4096);
+	for (int i = 0; i < 4096; ++i) addrs.push_back(rand_v4());
+
+	int blocked = 0;
+	ptime start(time_now());
+	for (int i = 0; i < num_lookups; ++i)
+		blocked += f.access(addrs[i & 4095]);
+	ptime stop(time_now());
+	std::cout << "set: " << (num_lookups * 1000000.0 / (std::max)(total_microseconds(stop - start), boost::int64_t(1)))
+		<< " lookups/second" << std::endl;
+
+	f.compile();
+
+	int compiled_blocked = 0;
+	start = time_now();
+	for (int i = 0; i < num_lookups; ++i)
+		compiled_blocked += f.access(addrs[i & 4095]);
+	stop = time_now();
+	std::cout << "compiled: " << (num_lookups * 1000000.0 / (std::max)(total_microseconds(stop - start), boost::int64_t(1)))
+		<< " lookups/second" << std::endl;
+
+	TEST_CHECK(blocked == compiled_blocked);
+}
+
 int test_main()
 {
 	using namespace libtorrent;
@@ -222,6 +334,9 @@ int test_main()
 	TEST_CHECK(pf.access(6881) == 0);
 	TEST_CHECK(pf.access(65535) == 0);
 
+	test_compiled_filter();
+	test_lookup_performance();
+
 	return 0;
 }
 
@@ -0,0 +1,62 @@
+#include "libtorrent/file_storage.hpp"
+#include <boost/lexical_cast.hpp>
+#include <iostream>
+
+#include "test.hpp"
+#include "libtorrent/time.hpp"
+
+using namespace libtorrent;
+
+int test_main()
+{
+	using namespace libtorrent;
+
+	const int num_files = 1000000;
+	const int block_size = 16 * 1024;
+
+	file_storage fs;
+	for (int i = 0; i < num_files; ++i)
+	{
+		fs.add_file("temp_storage/" + boost::lexical_cast<std::string>(i / 1000)
+			+ "/" + boost::lexical_cast<std::string>(i), 1000 + i % 50000);
+	}
+	fs.set_piece_length(256 * 1024);
+	fs.set_num_pieces(int((fs.total_size() + fs.piece_length() - 1) / fs.piece_length()));
+
+	std::cout << "memory usage: " << fs.memory_usage() << " bytes" << std::endl;
+
+	const int blocks_per_piece = fs.piece_length() / block_size;
+	const int num_blocks = 1000000;
+	size_type total_slices = 0;
+
+	ptime start(time_now());
+
+	for (int i = 0; i < num_blocks; ++i)
+	{
+		int piece = int(size_type(i) * 7919 % (fs.num_pieces() - 1));
+		int block = i % blocks_per_piece;
+		std::vector<file_slice> slices = fs.map_block(piece, block * block_size, block_size);
+		TEST_CHECK(!slices.empty());
+		total_slices += slices.size();
+	}
+	ptime stop(time_now());
+
+	std::cout << "done in " << total_milliseconds(stop - start) / 1000.
+		<< " seconds per million blocks (" << total_slices << " slices)" << std::endl;
+
+	// make sure file_at_offset agrees with the slices map_block returns
+	for (int i = 0; i < 1000; ++i)
+	{
+		int piece = int(size_type(i) * 7919 % (fs.num_pieces() - 1));
+		size_type offset = piece * size_type(fs.piece_length());
+		file_storage::iterator file_iter = fs.file_at_offset(offset);
+		TEST_CHECK(file_iter != fs.end());
+		std::vector<file_slice> slices = fs.map_block(piece, 0, block_size);
+		TEST_CHECK(slices[0].file_index == file_iter - fs.begin());
+		TEST_CHECK(slices[0].offset == offset - file_iter->offset);
+	}
+	TEST_CHECK(fs.file_at_offset(fs.total_size()) == fs.end());
+
+	return 0;
+}
+
@@ -37,7 +37,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/alert_types.hpp"
 #include "libtorrent/aux_/session_impl.hpp"
 #include "libtorrent/create_torrent.hpp"
+#include "libtorrent/disk_buffer_holder.hpp"
+#include "libtorrent/allocator.hpp"
 
+#include <cstring>
 #include <boost/utility.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/convenience.hpp>
@@ -255,6 +258,28 @@ void test_remove(path const& test_path)
 	TEST_CHECK(!exists(test_path / "temp_storage"));	
 }
 
+void test_allocate(path const& test_path)
+{
+	file_storage fs;
+	fs.add_file("temp_storage/test1.tmp", 17);
+	fs.add_file("temp_storage/test2.tmp", 612);
+
+	file_pool fp;
+	boost::scoped_ptr<storage_interface> s(
+		default_storage_constructor(fs, test_path, fp));
+	s->initialize(true);
+
+	// reserving space in a range spanning both files
+	// must not change their sizes
+	TEST_CHECK(s->allocate(10, 600) >= 0);
+	TEST_CHECK(!s->error());
+	s->release_files();
+
+	TEST_CHECK(file_size(test_path / "temp_storage/test1.tmp") == 17);
+	TEST_CHECK(file_size(test_path / "temp_storage/test2.tmp") == 612);
+	remove_all(test_path / "temp_storage");
+}
+
 namespace
 {
 	void check_files_fill_array(int ret, disk_io_job const& j, bool* array, bool* done)
@@ -333,6 +358,87 @@ void test_check_files(path const& test_path
 	io.join();
 }
 
+void on_hash_piece(int ret, disk_io_job const& j)
+{
+	std::cerr << "on_hash_piece piece: " << j.piece << " ret: " << ret << std::endl;
+	TEST_CHECK(ret == 0);
+}
+
+void test_compact_defrag(path const& test_path)
+{
+	remove_all(test_path / "temp_storage");
+	file_storage fs;
+	fs.add_file("temp_storage/test1.tmp", piece_size * 3);
+
+	libtorrent::create_torrent t(fs, piece_size);
+	t.set_hash(0, hasher(piece0, piece_size).final());
+	t.set_hash(1, hasher(piece1, piece_size).final());
+	t.set_hash(2, hasher(piece2, piece_size).final());
+
+	boost::intrusive_ptr<torrent_info> info(new torrent_info(t.generate()));
+
+	{
+	file_pool fp;
+	libtorrent::asio::io_service ios;
+	disk_io_thread io(ios);
+	boost::shared_ptr<int> dummy(new int);
+	boost::intrusive_ptr<piece_manager> pm = new piece_manager(dummy, info
+		, test_path, fp, io, default_storage_constructor, storage_mode_compact);
+
+	lazy_entry frd;
+	pm->async_check_fastresume(&frd, &on_check_resume_data);
+	ios.reset();
+	ios.run();
+
+	bool pieces[3] = {false, false, false};
+	bool done = false;
+	pm->async_check_files(bind(&check_files_fill_array, _1, _2, pieces, &done));
+	while (!done)
+	{
+		ios.reset();
+		ios.run_one();
+	}
+
+	// write the pieces in an order that makes them end up
+	// in each other's slots. They are moved into place by
+	// the disk thread once it's idle
+	char const* data[] = {piece0, piece1, piece2};
+	int order[] = {2, 0, 1};
+	for (int i = 0; i < 3; ++i)
+	{
+		peer_request r;
+		r.piece = order[i];
+		r.start = 0;
+		r.length = piece_size;
+		disk_buffer_holder h(io, io.allocate_buffer());
+		std::memcpy(h.get(), data[order[i]], piece_size);
+		pm->async_write(r, h, boost::function<void(int, disk_io_job const&)>());
+		pm->async_hash(order[i], &on_hash_piece);
+	}
+
+	test_sleep(2000);
+	ios.reset();
+	ios.poll();
+
+	pm->async_release_files();
+	io.join();
+	}
+
+	// every piece should be in its own slot now
+	file_pool fp;
+	boost::scoped_ptr<storage_interface> s(
+		default_storage_constructor(fs, test_path, fp));
+	char const* data[] = {piece0, piece1, piece2};
+	char piece[piece_size];
+	for (int i = 0; i < 3; ++i)
+	{
+		TEST_CHECK(s->read(piece, i, 0, piece_size) == piece_size);
+		TEST_CHECK(std::equal(piece, piece + piece_size, data[i]));
+	}
+	s->release_files();
+	remove_all(test_path / "temp_storage");
+}
+
 void run_test(path const& test_path)
 {
 	std::cerr << "\n=== " << test_path.string() << " ===\n" << std::endl;
@@ -375,7 +481,7 @@ void run_test(path const& test_path)
 	file_storage fs;
 	fs.add_file("temp_storage/test1.tmp", 17 + 612 + 1);
 	libtorrent::create_torrent t(fs, piece_size);
-	TEST_CHECK(fs.begin()->path == "temp_storage/test1.tmp");
+	TEST_CHECK(fs.file_path(*fs.begin()) == "temp_storage/test1.tmp");
 	t.set_hash(0, hasher(piece0, piece_size).final());
 	t.set_hash(1, hasher(piece1, piece_size).final());
 	t.set_hash(2, hasher(piece2, piece_size).final());
@@ -413,6 +519,16 @@ void run_test(path const& test_path)
 	std::cerr << "=== test 6 ===" << std::endl;
 	test_check_files(test_path, storage_mode_sparse);
 	test_check_files(test_path, storage_mode_compact);
+
+// ==============================================
+
+	std::cerr << "=== test 7 ===" << std::endl;
+	test_compact_defrag(test_path);
+
+// ==============================================
+
+	std::cerr << "=== test 8 ===" << std::endl;
+	test_allocate(test_path);
 }
 
 void test_fastresume()
@@ -472,6 +588,120 @@ void test_fastresume()
 	}
 }
 
+void test_file_storage()
+{
+	file_storage fs;
+	fs.add_file("temp_storage/test1.tmp", 8);
+	fs.add_file("temp_storage/folder1/test2.tmp", 8);
+	fs.add_file("temp_storage/folder1/test3.tmp", 0);
+	fs.add_file("temp_storage/folder2/test4.tmp", 3);
+	fs.set_piece_length(4);
+	fs.set_num_pieces(5);
+
+	TEST_CHECK(fs.num_files() == 4);
+	TEST_CHECK(fs.total_size() == 19);
+	TEST_CHECK(fs.name() == "temp_storage");
+	TEST_CHECK(fs.file_path(0) == "temp_storage/test1.tmp");
+	TEST_CHECK(fs.file_path(1) == "temp_storage/folder1/test2.tmp");
+	TEST_CHECK(fs.file_path(2) == "temp_storage/folder1/test3.tmp");
+	TEST_CHECK(fs.file_path(3) == "temp_storage/folder2/test4.tmp");
+	TEST_CHECK(std::strcmp(fs.file_name(2), "test3.tmp") == 0);
+
+	// files in the same directory share the path string
+	TEST_CHECK(fs.internal_at(1).path_index == fs.internal_at(2).path_index);
+	TEST_CHECK(fs.internal_at(0).path_index != fs.internal_at(1).path_index);
+
+	TEST_CHECK(fs.file_offset(3) == 16);
+	TEST_CHECK(fs.file_size(3) == 3);
+	file_entry e = fs.at(3);
+	TEST_CHECK(e.path == "temp_storage/folder2/test4.tmp");
+	TEST_CHECK(e.offset == 16);
+	TEST_CHECK(e.size == 3);
+
+	fs.rename_file(1, "temp_storage/folder3/renamed.tmp");
+	TEST_CHECK(fs.file_path(1) == "temp_storage/folder3/renamed.tmp");
+	TEST_CHECK(fs.file_path(2) == "temp_storage/folder1/test3.tmp");
+
+	// a name that fits is written over the old one
+	boost::uint32_t name_offset = fs.internal_at(1).name_offset;
+	fs.rename_file(1, "temp_storage/folder1/a.tmp");
+	TEST_CHECK(fs.internal_at(1).name_offset == name_offset);
+	TEST_CHECK(fs.file_path(1) == "temp_storage/folder1/a.tmp");
+	// and the directory is shared with the files already in it
+	TEST_CHECK(fs.internal_at(1).path_index == fs.internal_at(2).path_index);
+
+	// renaming back and forth must not grow the name pool
+	std::string long_name1(100, 'a');
+	std::string long_name2(101, 'b');
+	fs.rename_file(3, long_name1);
+	size_type usage = fs.memory_usage();
+	for (int i = 0; i < 1000; ++i)
+		fs.rename_file(3, (i & 1) ? long_name1 : long_name2);
+	TEST_CHECK(fs.memory_usage() <= usage + 1000);
+	TEST_CHECK(fs.file_path(3) == long_name1);
+	TEST_CHECK(fs.file_path(0) == "temp_storage/test1.tmp");
+	TEST_CHECK(fs.file_path(1) == "temp_storage/folder1/a.tmp");
+	TEST_CHECK(fs.file_path(2) == "temp_storage/folder1/test3.tmp");
+
+	TEST_CHECK(fs.memory_usage() > 0);
+}
+
+// reads and writes through a file_pool in no_buffer mode. Aligned
+// operations use O_DIRECT where the filesystem supports it, the
+// unaligned ones fall back to the page cache
+void test_no_buffer(path const& test_path)
+{
+	const int size = page_size() * 4;
+	char* buf = page_aligned_allocator::malloc(size);
+	char* check = page_aligned_allocator::malloc(size);
+	for (int i = 0; i < size; ++i) buf[i] = char(i % 251);
+
+	create_directory(test_path / "temp_storage");
+	path p = test_path / "temp_storage" / "no_buffer.tmp";
+
+	{
+		file_pool fp;
+		fp.set_no_buffer(true);
+		error_code ec;
+		boost::shared_ptr<file> f = fp.open_file(&fp, p, file::in | file::out, ec);
+		TEST_CHECK(f);
+		if (!f) return;
+
+		// aligned buffer, offset and size
+		TEST_CHECK(f->write(buf, size, ec) == size);
+		bool direct = f->direct_io();
+		std::cerr << "no_buffer: O_DIRECT "
+			<< (direct ? "used" : "not used") << std::endl;
+
+		// the offset is aligned, the size isn't
+		TEST_CHECK(f->write(buf, 100, ec) == 100);
+		TEST_CHECK(!f->direct_io());
+
+		// unaligned offset and buffer
+		TEST_CHECK(f->write(buf + 1, 100, ec) == 100);
+		TEST_CHECK(!f->direct_io());
+
+		// back to an aligned read, which turns O_DIRECT on
+		// again if the first write used it
+		f->seek(0, file::begin, ec);
+		std::memset(check, 0, size);
+		TEST_CHECK(f->read(check, size, ec) == size);
+		TEST_CHECK(f->direct_io() == direct);
+		TEST_CHECK(std::memcmp(buf, check, size) == 0);
+
+		// and an unaligned read of the tail
+		std::memset(check, 0, size);
+		TEST_CHECK(f->read(check + 1, 200, ec) == 200);
+		TEST_CHECK(!f->direct_io());
+		TEST_CHECK(std::memcmp(buf, check + 1, 100) == 0);
+		TEST_CHECK(std::memcmp(buf + 1, check + 101, 100) == 0);
+	}
+
+	page_aligned_allocator::free(buf);
+	page_aligned_allocator::free(check);
+	remove_all(test_path / "temp_storage");
+}
+
 int test_main()
 {
 	std::vector<path> test_paths;
@@ -491,8 +721,10 @@ int test_main()
 	}
 
 	std::for_each(test_paths.begin(), test_paths.end(), bind(&run_test, _1));
+	std::for_each(test_paths.begin(), test_paths.end(), bind(&test_no_buffer, _1));
 
 	test_fastresume();
+	test_file_storage();
 
 	return 0;
 }
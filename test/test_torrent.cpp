@@ -2,6 +2,8 @@
 #include "libtorrent/session_settings.hpp"
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/create_torrent.hpp"
+#include "libtorrent/time.hpp"
+#include "libtorrent/alert_types.hpp"
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 
@@ -51,8 +53,147 @@ void test_running_torrent(boost::intrusive_ptr<torrent_info> info, size_type fil
 	TEST_CHECK(st.total_wanted_done == 0);
 }
 
+// a small torrent without trackers, so that nothing
+// but the test itself changes its state
+boost::intrusive_ptr<torrent_info> make_torrent(char const* name)
+{
+	file_storage fs;
+	fs.add_file(name, 16 * 1024);
+	libtorrent::create_torrent t(fs, 16 * 1024);
+	sha1_hash ph;
+	ph.clear();
+	t.set_hash(0, ph);
+
+	std::vector<char> tmp;
+	std::back_insert_iterator<std::vector<char> > out(tmp);
+	bencode(out, t.generate());
+	return boost::intrusive_ptr<torrent_info>(new torrent_info(&tmp[0], tmp.size()));
+}
+
+bool is_paused(torrent_status const& st) { return st.paused; }
+
+void test_status_queries()
+{
+	session ses(fingerprint("LT", 0, 1, 0, 0), std::make_pair(48170, 48180));
+
+	boost::intrusive_ptr<torrent_info> info1 = make_torrent("test_status1");
+	boost::intrusive_ptr<torrent_info> info2 = make_torrent("test_status2");
+
+	add_torrent_params p;
+	p.save_path = ".";
+	p.auto_managed = false;
+	p.ti = info1;
+	p.paused = false;
+	torrent_handle h1 = ses.add_torrent(p);
+	p.ti = info2;
+	p.paused = true;
+	ses.add_torrent(p);
+
+	// let the torrents finish checking
+	test_sleep(1000);
+
+	std::vector<torrent_status> st;
+	ses.get_torrent_status(&st);
+	TEST_CHECK(st.size() == 2);
+
+	st.clear();
+	ses.get_torrent_status(&st, &is_paused);
+	TEST_CHECK(st.size() == 1);
+	if (st.size() == 1) TEST_CHECK(st[0].info_hash == info2->info_hash());
+
+	// the torrents changed state when they were checked,
+	// the first call returns them and clears the list
+	st.clear();
+	ses.get_updated_torrent_status(&st);
+	TEST_CHECK(!st.empty() && st.size() <= 2);
+	st.clear();
+	ses.get_updated_torrent_status(&st);
+	TEST_CHECK(st.empty());
+
+	// a torrent that changes is returned once
+	h1.pause();
+	st.clear();
+	ses.get_updated_torrent_status(&st);
+	TEST_CHECK(st.size() == 1);
+	if (st.size() == 1)
+	{
+		TEST_CHECK(st[0].info_hash == info1->info_hash());
+		TEST_CHECK(st[0].paused);
+	}
+	st.clear();
+	ses.get_updated_torrent_status(&st);
+	TEST_CHECK(st.empty());
+}
+
+// counts the replies to the async queries that have been
+// posted so far, and frees all alerts
+void count_replies(session& ses, int& peer_info, int& status, int& file_progress
+	, int num_files)
+{
+	std::vector<alert*> alerts;
+	ses.pop_alerts(&alerts);
+	for (std::vector<alert*>::iterator i = alerts.begin()
+		, end(alerts.end()); i != end; ++i)
+	{
+		if (dynamic_cast<peer_info_alert*>(*i)) ++peer_info;
+		if (dynamic_cast<torrent_status_alert*>(*i)) ++status;
+		if (file_progress_alert* fa = dynamic_cast<file_progress_alert*>(*i))
+		{
+			TEST_CHECK(int(fa->progress.size()) == num_files);
+			++file_progress;
+		}
+		delete *i;
+	}
+}
+
+// every async query is answered with exactly one alert, also
+// when its category is masked out and the alert queue is full
+void test_async_queries(boost::intrusive_ptr<torrent_info> info)
+{
+	session ses(fingerprint("LT", 0, 1, 0, 0), std::make_pair(48150, 48160));
+
+	add_torrent_params p;
+	p.ti = info;
+	p.save_path = ".";
+	torrent_handle h = ses.add_torrent(p);
+
+	for (int round = 0; round < 2; ++round)
+	{
+		if (round == 1)
+		{
+			ses.set_alert_mask(0);
+			ses.set_alert_queue_size_limit(0);
+		}
+
+		h.async_get_peer_info();
+		h.async_status();
+		h.async_file_progress();
+
+		int peer_info = 0;
+		int status = 0;
+		int file_progress = 0;
+		ptime end = time_now() + seconds(5);
+		while (peer_info + status + file_progress < 3 && time_now() < end)
+		{
+			ses.wait_for_alert(milliseconds(100));
+			count_replies(ses, peer_info, status, file_progress, info->num_files());
+		}
+		// make sure no query is answered twice
+		test_sleep(200);
+		count_replies(ses, peer_info, status, file_progress, info->num_files());
+
+		std::cout << "round " << round << ": peer_info: " << peer_info
+			<< " status: " << status << " file_progress: " << file_progress << std::endl;
+		TEST_CHECK(peer_info == 1);
+		TEST_CHECK(status == 1);
+		TEST_CHECK(file_progress == 1);
+	}
+}
+
 int test_main()
 {
+	test_status_queries();
+
 	{
 		file_storage fs;
 		size_type file_size = 1 * 1024 * 1024 * 1024;
@@ -92,6 +233,7 @@ int test_main()
 		bencode(out, t.generate());
 		boost::intrusive_ptr<torrent_info> info(new torrent_info(&tmp[0], tmp.size()));
 		test_running_torrent(info, 0);
+		test_async_queries(info);
 	}
 
 	return 0;
@@ -101,6 +101,69 @@ void test_rate()
 
 }
 
+// the request queue starts in slow start, and is then sized
+// from the round trip time and download rate. The queue limit
+// is set above 65535 to make sure it isn't truncated
+void test_request_queue()
+{
+	session ses1(fingerprint("LT", 0, 1, 0, 0), std::make_pair(48275, 49000));
+	session ses2(fingerprint("LT", 0, 1, 0, 0), std::make_pair(49275, 50000));
+
+	const int max_queue = 100000;
+	session_settings settings;
+	settings.max_out_request_queue = max_queue;
+	ses2.set_settings(settings);
+	ses1.set_upload_rate_limit(200000);
+
+	torrent_handle tor1;
+	torrent_handle tor2;
+
+	create_directory("./tmp1_transfer");
+	std::ofstream file("./tmp1_transfer/temporary");
+	boost::intrusive_ptr<torrent_info> t = ::create_torrent(&file, 16 * 1024, 200);
+	file.close();
+
+	boost::tie(tor1, tor2, ignore) = setup_transfer(&ses1, &ses2, 0
+		, true, false, true, "_transfer", 0, &t);
+
+	bool saw_slow_start = false;
+	bool saw_slow_start_end = false;
+	bool saw_rtt = false;
+
+	for (int i = 0; i < 200; ++i)
+	{
+		print_alerts(ses1, "ses1");
+		print_alerts(ses2, "ses2");
+
+		std::vector<peer_info> peers;
+		tor2.get_peer_info(peers);
+		for (std::vector<peer_info>::iterator j = peers.begin()
+			, end(peers.end()); j != end; ++j)
+		{
+			std::cerr << "queue: " << j->target_dl_queue_length
+				<< " rtt: " << j->request_rtt
+				<< " slow start: " << ((j->flags & peer_info::slow_start) != 0)
+				<< " rate: " << j->down_speed << std::endl;
+
+			TEST_CHECK(j->target_dl_queue_length >= 1);
+			TEST_CHECK(j->target_dl_queue_length <= max_queue);
+			if (j->request_rtt > 0) saw_rtt = true;
+			if (j->flags & peer_info::slow_start) saw_slow_start = true;
+			else if (saw_slow_start) saw_slow_start_end = true;
+		}
+
+		if (tor2.is_seed()) break;
+		test_sleep(200);
+	}
+
+	TEST_CHECK(tor2.is_seed());
+	TEST_CHECK(saw_rtt);
+	TEST_CHECK(saw_slow_start);
+	// the upload rate limit keeps the download rate flat,
+	// which ends slow start
+	TEST_CHECK(saw_slow_start_end);
+}
+
 void test_transfer()
 {
 	session ses1(fingerprint("LT", 0, 1, 0, 0), std::make_pair(48075, 49000));
@@ -305,6 +368,11 @@ int test_main()
 	try { remove_all("./tmp2_transfer"); } catch (std::exception&) {}
 #endif
 
+	test_request_queue();
+
+	try { remove_all("./tmp1_transfer"); } catch (std::exception&) {}
+	try { remove_all("./tmp2_transfer"); } catch (std::exception&) {}
+
 	test_transfer();
 	
 	try { remove_all("./tmp1_transfer"); } catch (std::exception&) {}